@@ -0,0 +1,91 @@
+"""Compare a faster thinning with the serial Hamilton-Jacobi thinning over a mask corpus (see generate_corpus.py).
+
+    python benchmark/compare_thinning.py --corpus benchmark/corpus --flux-band 0.1 --num-threads 8
+    python benchmark/compare_thinning.py --engine guo-hall --tolerance 3 --max-outliers 0.2
+
+--engine parallel is the flux band thinning (ThinningMode.PARALLEL), --engine guo-hall the Guo-Hall thinning
+(SkeletonEngine.GUO_HALL), which does not follow the flux and is expected to differ more.
+
+For every mask, a skeleton pixel of one mode is an outlier if no skeleton pixel of the other mode lies within
+--tolerance pixels (chessboard distance). The script exits with status 1 when the outliers exceed --max-outliers
+(fraction of the skeleton pixels) or when the number of skeleton components differs. The component check assumes
+the thinned skeleton is returned as is, so anisotropic diffusion, whose two-pass mode intersects two skeletons,
+is off unless --anisotropic-diffusion is given.
+"""
+import argparse
+import json
+import sys
+import time
+from pathlib import Path
+
+import cv2
+import numpy as np
+from pyhjs import BinaryFrame, Output, PyHJS, SkeletonEngine, ThinningMode
+
+SCRIPT_DIR = Path(__file__).resolve().parent
+
+
+def load_corpus(corpus_dir):
+    with open(Path(corpus_dir) / "manifest.json") as f:
+        manifest = json.load(f)
+    return [(entry["file"], cv2.imread(str(Path(corpus_dir) / entry["file"]), cv2.IMREAD_GRAYSCALE)) for entry in manifest["masks"]]
+
+
+def outliers(skeleton, reference, tolerance):
+    """Pixels of skeleton farther than tolerance from every pixel of reference."""
+    if not reference.any():
+        return int(skeleton.sum())
+    distance = cv2.distanceTransform((reference == 0).astype(np.uint8), cv2.DIST_C, 3)
+    return int(np.count_nonzero(skeleton & (distance > tolerance)))
+
+
+def skeletonize(hjs, frame, anisotropic_diffusion):
+    start = time.perf_counter()
+    hjs.compute(frame, enable_anisotropic_diffusion=anisotropic_diffusion, outputs=Output.SKELETON)
+    return hjs.get_skeleton_image().astype(bool), time.perf_counter() - start
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--corpus", default=str(SCRIPT_DIR / "corpus"))
+    parser.add_argument("--engine", choices=["parallel", "guo-hall"], default="parallel")
+    parser.add_argument("--flux-band", type=float, default=0.1, help="of --engine parallel")
+    parser.add_argument("--num-threads", type=int, default=0, help="0: OpenCV's shared pool")
+    parser.add_argument("--tolerance", type=int, default=1, help="[px]")
+    parser.add_argument("--max-outliers", type=float, default=0.01, help="allowed fraction of skeleton pixels")
+    parser.add_argument("--anisotropic-diffusion", action="store_true")
+    parser.add_argument("--gamma", type=float, default=2.5)
+    parser.add_argument("--epsilon", type=float, default=1.0)
+    args = parser.parse_args()
+
+    serial = PyHJS(args.gamma, args.epsilon, 0, args.num_threads)
+    parallel = PyHJS(args.gamma, args.epsilon, 0, args.num_threads)
+    if args.engine == "guo-hall":
+        parallel.set_skeleton_engine(SkeletonEngine.GUO_HALL)
+    else:
+        parallel.set_thinning_mode(ThinningMode.PARALLEL, flux_band=args.flux_band)
+
+    num_failures = 0
+    serial_time = parallel_time = 0.0
+    for name, mask in load_corpus(args.corpus):
+        frame = BinaryFrame(mask)
+        skeleton_serial, elapsed_serial = skeletonize(serial, frame, args.anisotropic_diffusion)
+        skeleton_parallel, elapsed_parallel = skeletonize(parallel, frame, args.anisotropic_diffusion)
+        serial_time += elapsed_serial
+        parallel_time += elapsed_parallel
+
+        num_pixels = max(1, int(skeleton_serial.sum()))
+        fraction = max(outliers(skeleton_serial, skeleton_parallel, args.tolerance), outliers(skeleton_parallel, skeleton_serial, args.tolerance)) / num_pixels
+        components_serial = cv2.connectedComponents(skeleton_serial.astype(np.uint8), connectivity=8)[0] - 1
+        components_parallel = cv2.connectedComponents(skeleton_parallel.astype(np.uint8), connectivity=8)[0] - 1
+        failed = fraction > args.max_outliers or components_serial != components_parallel
+        num_failures += failed
+        print(f"{'FAIL' if failed else 'ok':4s} {name}: outliers {fraction * 100:.2f}%, components {components_serial} -> {components_parallel}, "
+              f"{elapsed_serial * 1000:.1f} -> {elapsed_parallel * 1000:.1f} ms")
+
+    print(f"{num_failures} mask(s) beyond tolerance; total {serial_time:.2f} s serial, {parallel_time:.2f} s {args.engine}")
+    sys.exit(1 if num_failures > 0 else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,100 @@
+"""Wall-clock checks of PyHJS under threads, which tests/ leaves out because they depend on the machine and its load.
+
+    python benchmark/concurrency_timing.py
+    python benchmark/concurrency_timing.py --size 2048 --max-parallel-ratio 0.6
+
+"gil": while one thread is inside compute(), the main thread spins; its largest stall must stay below
+--max-gil-stall of the compute() time (holding the GIL would stall it for the whole call).
+"parallel": one PyHJS per thread, each with one thread, over as many masks as usable cores (at most 4); the
+threaded run must take less than --max-parallel-ratio of the serial one. Skipped with a single usable core.
+The script exits with status 1 when a check fails.
+"""
+import argparse
+import os
+import sys
+import threading
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+from pyhjs import BinaryFrame, PyHJS
+
+
+def make_mask(size, seed):
+    """A disk with rectangular notches and a hole, as in tests/test_concurrency.py."""
+    rng = np.random.default_rng(seed)
+    y, x = np.mgrid[0:size, 0:size]
+    center = size / 2 + rng.uniform(-size / 16, size / 16, 2)
+    mask = (x - center[0]) ** 2 + (y - center[1]) ** 2 < (size * 0.4) ** 2
+    for _ in range(6):
+        x0, y0 = rng.integers(0, size - size // 8, 2)
+        mask[y0 : y0 + size // 8, x0 : x0 + size // 32] = False
+    mask[(x - center[0]) ** 2 + (y - center[1]) ** 2 < (size * 0.05) ** 2] = False
+    return mask.astype(np.uint8) * 255
+
+
+def gil_stall(size):
+    """Largest stall of the main thread relative to the compute() time."""
+    hjs = PyHJS(2.5, 1.0)
+    frame = BinaryFrame(make_mask(int(size * 1.5), 0))
+    timing = {}
+
+    def run():
+        start = time.perf_counter()
+        hjs.compute(frame)
+        timing["duration"] = time.perf_counter() - start
+
+    thread = threading.Thread(target=run)
+    ticks = [time.perf_counter()]
+    thread.start()
+    while thread.is_alive():
+        ticks.append(time.perf_counter())
+    thread.join()
+    ticks.append(time.perf_counter())
+    return max(b - a for a, b in zip(ticks, ticks[1:])) / timing["duration"]
+
+
+def parallel_ratio(size, num_workers):
+    """Threaded over serial time of num_workers instances."""
+    instances = [PyHJS(2.5, 1.0, 0, 1) for _ in range(num_workers)]
+    frames = [BinaryFrame(make_mask(size, seed)) for seed in range(num_workers)]
+    instances[0].compute(frames[0])  # warm-up
+
+    start = time.perf_counter()
+    for hjs, frame in zip(instances, frames):
+        hjs.compute(frame)
+    serial_time = time.perf_counter() - start
+
+    start = time.perf_counter()
+    with ThreadPoolExecutor(max_workers=num_workers) as pool:
+        list(pool.map(lambda pair: pair[0].compute(pair[1]), zip(instances, frames)))
+    return (time.perf_counter() - start) / serial_time
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--size", type=int, default=1024, help="mask size [px] of the parallel check, 1.5x for gil")
+    parser.add_argument("--max-gil-stall", type=float, default=0.5)
+    parser.add_argument("--max-parallel-ratio", type=float, default=0.8)
+    args = parser.parse_args()
+
+    num_failures = 0
+    stall = gil_stall(args.size)
+    status = "ok" if stall < args.max_gil_stall else "FAILED"
+    num_failures += status != "ok"
+    print(f"{status:6s} gil: largest stall {stall * 100:.1f} % of compute()")
+
+    num_cores = len(os.sched_getaffinity(0)) if hasattr(os, "sched_getaffinity") else (os.cpu_count() or 1)
+    num_workers = min(4, num_cores)
+    if num_workers < 2:
+        print(f"{'skip':6s} parallel: needs at least two usable cores")
+    else:
+        ratio = parallel_ratio(args.size, num_workers)
+        status = "ok" if ratio < args.max_parallel_ratio else "FAILED"
+        num_failures += status != "ok"
+        print(f"{status:6s} parallel: {num_workers} threads take {ratio * 100:.0f} % of the serial time")
+    sys.exit(1 if num_failures > 0 else 0)
+
+
+if __name__ == "__main__":
+    main()
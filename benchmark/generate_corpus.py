@@ -0,0 +1,122 @@
+"""Generate a reproducible corpus of binary masks for benchmark/run_benchmark.py.
+
+Masks are unions of star-shaped blobs and thick curved strokes (limb- or stem-like shapes), with holes cut out.
+Every axis of the grid below (image size, foreground fraction, component count, hole count, boundary roughness)
+is varied independently; the generator is seeded, so the same arguments always give the same corpus.
+
+    python benchmark/generate_corpus.py --output benchmark/corpus
+"""
+import argparse
+import itertools
+import json
+from pathlib import Path
+
+import cv2
+import numpy as np
+
+SCRIPT_DIR = Path(__file__).resolve().parent
+
+SIZES = [128, 256, 512, 1024]
+FOREGROUND_FRACTIONS = [0.05, 0.2, 0.5]
+COMPONENT_COUNTS = [1, 4, 16]
+HOLE_COUNTS = [0, 3]
+ROUGHNESS_LEVELS = [0.0, 0.15]
+
+
+def star_polygon(rng, center, radius, roughness, num_vertices=96):
+    """Closed contour whose radius is modulated by a few random harmonics (roughness: relative amplitude)."""
+    angles = np.linspace(0, 2 * np.pi, num_vertices, endpoint=False)
+    radii = np.ones_like(angles)
+    for harmonic in range(2, 12):
+        amplitude = roughness * rng.uniform(0, 1) / np.sqrt(harmonic - 1)
+        radii += amplitude * np.sin(harmonic * angles + rng.uniform(0, 2 * np.pi))
+    radii = radius * np.clip(radii, 0.3, None)
+    points = np.stack([center[0] + radii * np.cos(angles), center[1] + radii * np.sin(angles)], axis=1)
+    return np.round(points).astype(np.int32)
+
+
+def curved_stroke(rng, size, thickness):
+    """Quadratic Bezier curve across the image, drawn as a thick polyline."""
+    control_points = rng.uniform(0.1 * size, 0.9 * size, (3, 2))
+    t = np.linspace(0, 1, 64)[:, None]
+    curve = (1 - t) ** 2 * control_points[0] + 2 * (1 - t) * t * control_points[1] + t**2 * control_points[2]
+    return np.round(curve).astype(np.int32), max(2, int(thickness))
+
+
+def generate_mask(rng, size, foreground_fraction, num_components, num_holes, roughness):
+    mask = np.zeros((size, size), np.uint8)
+    # area budget per component; blobs and strokes alternate
+    component_area = foreground_fraction * size * size / num_components
+    for k in range(num_components):
+        if k % 2 == 0:
+            radius = np.sqrt(component_area / np.pi)
+            center = rng.uniform(radius, size - radius, 2) if radius < size / 2 else np.array([size / 2, size / 2])
+            cv2.fillPoly(mask, [star_polygon(rng, center, radius, roughness)], 255)
+        else:
+            curve, thickness = curved_stroke(rng, size, component_area / size)
+            cv2.polylines(mask, [curve], False, 255, thickness)
+
+    foreground = np.argwhere(mask > 0)
+    for _ in range(num_holes if len(foreground) > 0 else 0):
+        y, x = foreground[rng.integers(len(foreground))]
+        radius = max(2.0, np.sqrt(foreground_fraction * size * size / num_components / np.pi) * rng.uniform(0.1, 0.25))
+        cv2.fillPoly(mask, [star_polygon(rng, (x, y), radius, roughness, num_vertices=32)], 0)
+
+    # the skeleton is not defined on the image border
+    mask[0, :] = mask[-1, :] = mask[:, 0] = mask[:, -1] = 0
+    return mask
+
+
+def describe(mask):
+    """Measured properties, as opposed to the requested ones."""
+    num_components, _ = cv2.connectedComponents((mask > 0).astype(np.uint8), connectivity=8)
+    num_background, _ = cv2.connectedComponents((mask == 0).astype(np.uint8), connectivity=4)
+    return {
+        "foreground_fraction": float(np.mean(mask > 0)),
+        "num_components": int(num_components - 1),
+        "num_holes": int(num_background - 2),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--output", default=str(SCRIPT_DIR / "corpus"))
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--max-size", type=int, default=max(SIZES), help="skip sizes above this")
+    parser.add_argument("--real-mask", default=str(SCRIPT_DIR.parent / "example" / "mask.png"), help="added as is and downscaled by 4")
+    args = parser.parse_args()
+
+    output_dir = Path(args.output)
+    output_dir.mkdir(parents=True, exist_ok=True)
+    rng = np.random.default_rng(args.seed)
+    entries = []
+
+    grid = itertools.product(SIZES, FOREGROUND_FRACTIONS, COMPONENT_COUNTS, HOLE_COUNTS, ROUGHNESS_LEVELS)
+    for size, foreground_fraction, num_components, num_holes, roughness in grid:
+        if size > args.max_size:
+            continue
+        mask = generate_mask(rng, size, foreground_fraction, num_components, num_holes, roughness)
+        name = f"synthetic_s{size}_f{foreground_fraction}_c{num_components}_h{num_holes}_r{roughness}.png"
+        cv2.imwrite(str(output_dir / name), mask)
+        parameters = dict(size=size, foreground_fraction=foreground_fraction, num_components=num_components, num_holes=num_holes, roughness=roughness)
+        entries.append({"file": name, "kind": "synthetic", "requested": parameters, "measured": describe(mask)})
+
+    real_mask_path = Path(args.real_mask)
+    if real_mask_path.exists():
+        image = cv2.imread(str(real_mask_path), cv2.IMREAD_ANYDEPTH)
+        for scale in [1.0, 0.25]:
+            resized = cv2.resize(image, None, fx=scale, fy=scale, interpolation=cv2.INTER_NEAREST)
+            mask = np.where(resized > 0, 255, 0).astype(np.uint8)
+            mask[0, :] = mask[-1, :] = mask[:, 0] = mask[:, -1] = 0
+            name = f"real_{real_mask_path.stem}_x{scale}.png"
+            cv2.imwrite(str(output_dir / name), mask)
+            entries.append({"file": name, "kind": "real", "requested": {"scale": scale}, "measured": describe(mask)})
+
+    manifest = {"seed": args.seed, "masks": entries}
+    with open(output_dir / "manifest.json", "w") as f:
+        json.dump(manifest, f, indent=2)
+    print(f"{len(entries)} masks written to {output_dir}")
+
+
+if __name__ == "__main__":
+    main()
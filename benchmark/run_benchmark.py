@@ -0,0 +1,194 @@
+"""End-to-end benchmark of PyHJS.compute over a mask corpus (see generate_corpus.py).
+
+    python benchmark/run_benchmark.py run --corpus benchmark/corpus --output result.json
+    python benchmark/run_benchmark.py compare baseline.json result.json
+
+"run" measures every configuration of the grid (anisotropic diffusion, pruning thresholds, thread count) in a
+fresh subprocess, so that the peak RSS of one configuration does not leak into the next. "compare" exits with
+status 1 when a configuration got slower or larger than the baseline beyond the tolerances.
+"""
+import argparse
+import itertools
+import json
+import os
+import platform
+import resource
+import subprocess
+import sys
+import time
+from pathlib import Path
+
+import cv2
+import numpy as np
+
+SCRIPT_DIR = Path(__file__).resolve().parent
+
+ANISOTROPIC_DIFFUSION = [False, True]
+PRUNING = [
+    {"threshold_arc_angle": 0, "threshold_branch_length": 0},
+    {"threshold_arc_angle": 60, "threshold_branch_length": 30},
+]
+NUM_THREADS = [0, 1, 4]
+
+
+def config_key(config):
+    return ",".join(f"{key}={config[key]}" for key in sorted(config))
+
+
+def peak_rss_mb():
+    peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    return peak / 1024**2 if sys.platform == "darwin" else peak / 1024  # bytes on macOS, KiB on Linux
+
+
+def load_corpus(corpus_dir):
+    with open(Path(corpus_dir) / "manifest.json") as f:
+        manifest = json.load(f)
+    return [(entry["file"], cv2.imread(str(Path(corpus_dir) / entry["file"]), cv2.IMREAD_GRAYSCALE)) for entry in manifest["masks"]]
+
+
+def measure(config, corpus_dir, repeat, warmup):
+    """Run one configuration in this process; latencies are per mask and call."""
+    from pyhjs import PyHJS, BinaryFrame
+
+    hjs = PyHJS(config["gamma"], config["epsilon"], config["threshold_arc_angle"], config["num_threads"])
+    hjs.set_branch_pruning_parameters(threshold_branch_length=config["threshold_branch_length"])
+    masks = load_corpus(corpus_dir)
+    frames = [BinaryFrame(mask) for _, mask in masks]
+
+    for frame in frames[:warmup]:
+        hjs.compute(frame, enable_anisotropic_diffusion=config["anisotropic_diffusion"])
+
+    latencies = []
+    num_pixels = 0
+    start = time.perf_counter()
+    for _ in range(repeat):
+        for (_, mask), frame in zip(masks, frames):
+            t0 = time.perf_counter()
+            hjs.compute(frame, enable_anisotropic_diffusion=config["anisotropic_diffusion"])
+            latencies.append(time.perf_counter() - t0)
+            num_pixels += mask.size
+    elapsed = time.perf_counter() - start
+
+    latencies_ms = np.array(latencies) * 1000
+    return {
+        "config": config,
+        "num_calls": len(latencies),
+        "latency_ms": {
+            "mean": float(latencies_ms.mean()),
+            "p50": float(np.percentile(latencies_ms, 50)),
+            "p90": float(np.percentile(latencies_ms, 90)),
+            "p99": float(np.percentile(latencies_ms, 99)),
+            "max": float(latencies_ms.max()),
+        },
+        "throughput_masks_per_s": len(latencies) / elapsed,
+        "throughput_mpix_per_s": num_pixels / elapsed / 1e6,
+        "peak_rss_mb": peak_rss_mb(),
+    }
+
+
+def git_revision():
+    try:
+        return subprocess.check_output(["git", "rev-parse", "HEAD"], cwd=SCRIPT_DIR, stderr=subprocess.DEVNULL).decode().strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def run(args):
+    configs = []
+    for anisotropic_diffusion, pruning, num_threads in itertools.product(ANISOTROPIC_DIFFUSION, PRUNING, NUM_THREADS):
+        config = dict(gamma=args.gamma, epsilon=args.epsilon, anisotropic_diffusion=anisotropic_diffusion, num_threads=num_threads)
+        config.update(pruning)
+        configs.append(config)
+
+    results = []
+    for config in configs:
+        command = [sys.executable, __file__, "measure", "--corpus", args.corpus, "--repeat", str(args.repeat), "--warmup", str(args.warmup)]
+        command += ["--config", json.dumps(config)]
+        output = subprocess.check_output(command)
+        result = json.loads(output)
+        results.append(result)
+        latency = result["latency_ms"]
+        print(f"{config_key(config)}: p50 {latency['p50']:.2f} ms, p99 {latency['p99']:.2f} ms, "
+              f"{result['throughput_masks_per_s']:.1f} masks/s, peak RSS {result['peak_rss_mb']:.0f} MB", file=sys.stderr)
+
+    report = {
+        "meta": {
+            "git_revision": git_revision(),
+            "python": platform.python_version(),
+            "platform": platform.platform(),
+            "processor": platform.processor(),
+            "cpu_count": os.cpu_count(),
+            "opencv": cv2.__version__,
+            "corpus": str(args.corpus),
+            "repeat": args.repeat,
+        },
+        "results": results,
+    }
+    with open(args.output, "w") as f:
+        json.dump(report, f, indent=2)
+    print(f"written to {args.output}", file=sys.stderr)
+
+
+def compare(args):
+    with open(args.baseline) as f:
+        baseline = {config_key(result["config"]): result for result in json.load(f)["results"]}
+    with open(args.current) as f:
+        current = {config_key(result["config"]): result for result in json.load(f)["results"]}
+
+    num_regressions = 0
+    for key in sorted(set(baseline) & set(current)):
+        checks = [
+            ("p50", baseline[key]["latency_ms"]["p50"], current[key]["latency_ms"]["p50"], args.latency_tolerance),
+            ("p99", baseline[key]["latency_ms"]["p99"], current[key]["latency_ms"]["p99"], args.tail_tolerance),
+            ("rss", baseline[key]["peak_rss_mb"], current[key]["peak_rss_mb"], args.rss_tolerance),
+        ]
+        for name, before, after, tolerance in checks:
+            ratio = after / before if before > 0 else 1.0
+            status = "REGRESSION" if ratio > 1 + tolerance else "ok"
+            num_regressions += status != "ok"
+            if status != "ok" or args.verbose:
+                print(f"{status:10s} {key} {name}: {before:.2f} -> {after:.2f} ({(ratio - 1) * 100:+.1f}%)")
+
+    for key in sorted(set(baseline) ^ set(current)):
+        print(f"{'missing':10s} {key} (only in {'baseline' if key in baseline else 'current'})")
+    print(f"{num_regressions} regression(s) over {len(set(baseline) & set(current))} configuration(s)")
+    sys.exit(1 if num_regressions > 0 else 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    run_parser = subparsers.add_parser("run", help="measure every configuration and write a JSON report")
+    run_parser.add_argument("--corpus", default=str(SCRIPT_DIR / "corpus"))
+    run_parser.add_argument("--output", default="benchmark_result.json")
+    run_parser.add_argument("--repeat", type=int, default=3)
+    run_parser.add_argument("--warmup", type=int, default=3, help="number of masks computed before timing")
+    run_parser.add_argument("--gamma", type=float, default=2.5)
+    run_parser.add_argument("--epsilon", type=float, default=1.0)
+
+    measure_parser = subparsers.add_parser("measure", help="(internal) measure one configuration, JSON on stdout")
+    measure_parser.add_argument("--corpus", required=True)
+    measure_parser.add_argument("--config", required=True)
+    measure_parser.add_argument("--repeat", type=int, default=3)
+    measure_parser.add_argument("--warmup", type=int, default=3)
+
+    compare_parser = subparsers.add_parser("compare", help="flag regressions of a report against a baseline")
+    compare_parser.add_argument("baseline")
+    compare_parser.add_argument("current")
+    compare_parser.add_argument("--latency-tolerance", type=float, default=0.10, help="allowed relative p50 increase")
+    compare_parser.add_argument("--tail-tolerance", type=float, default=0.25, help="allowed relative p99 increase")
+    compare_parser.add_argument("--rss-tolerance", type=float, default=0.10, help="allowed relative peak RSS increase")
+    compare_parser.add_argument("--verbose", action="store_true")
+
+    args = parser.parse_args()
+    if args.command == "run":
+        run(args)
+    elif args.command == "measure":
+        print(json.dumps(measure(json.loads(args.config), args.corpus, args.repeat, args.warmup)))
+    else:
+        compare(args)
+
+
+if __name__ == "__main__":
+    main()
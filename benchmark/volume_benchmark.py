@@ -0,0 +1,84 @@
+"""Time and peak memory of PyHJS3D.compute on synthetic volumes.
+
+    python benchmark/volume_benchmark.py --sizes 256 512 --num-threads 1
+
+The volume of size N is the N^3 box where sin(0.05 x) + sin(0.07 y) + sin(0.06 z) > 0.5, a porous shape with
+tunnels and cavities (about 40 % of the voxels), background on the volume border. Every (size, outputs) pair is
+measured in a fresh subprocess; "peak" is the peak RSS of the compute() call beyond the RSS once the volume exists.
+"""
+import argparse
+import json
+import resource
+import subprocess
+import sys
+import time
+
+import numpy as np
+
+OUTPUTS = ["skeleton", "all"]
+
+
+def peak_rss_mb():
+    peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    return peak / 1024**2 if sys.platform == "darwin" else peak / 1024  # bytes on macOS, KiB on Linux
+
+
+def make_volume(size):
+    """Built plane by plane, so that no temporary of the size of the volume raises the peak RSS."""
+    waves = [np.sin(np.arange(size, dtype=np.float32) * frequency) for frequency in (0.05, 0.07, 0.06)]
+    volume = np.zeros((size, size, size), np.uint8)
+    for z in range(1, size - 1):
+        plane = (waves[1][:, None] + waves[0][None, :] + waves[2][z]) > 0.5
+        volume[z, 1:-1, 1:-1] = plane[1:-1, 1:-1]
+    return volume
+
+
+def measure(size, outputs, num_threads):
+    from pyhjs import Output, PyHJS3D
+
+    flags = Output.SKELETON if outputs == "skeleton" else Output.SKELETON | Output.DISTANCE_TRANSFORM | Output.FLUX
+    volume = make_volume(size)
+    hjs = PyHJS3D(2.5, num_threads)
+    rss_before = peak_rss_mb()
+    start = time.perf_counter()
+    hjs.compute(volume, outputs=int(flags))
+    elapsed = time.perf_counter() - start
+    return {
+        "size": size,
+        "outputs": outputs,
+        "num_threads": num_threads,
+        "shape_voxels": int(np.count_nonzero(volume)),
+        "skeleton_voxels": int(np.count_nonzero(hjs.get_skeleton_image())),
+        "seconds": elapsed,
+        "peak_mb": peak_rss_mb() - rss_before,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--sizes", type=int, nargs="+", default=[128, 256])
+    parser.add_argument("--outputs", choices=OUTPUTS, nargs="+", default=OUTPUTS)
+    parser.add_argument("--num-threads", type=int, default=1, help="0: OpenCV's shared pool")
+    parser.add_argument("--output", help="JSON report")
+    parser.add_argument("--measure", nargs=2, metavar=("SIZE", "OUTPUTS"), help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    if args.measure:
+        print(json.dumps(measure(int(args.measure[0]), args.measure[1], args.num_threads)))
+        return
+
+    results = []
+    for size in args.sizes:
+        for outputs in args.outputs:
+            command = [sys.executable, __file__, "--measure", str(size), outputs, "--num-threads", str(args.num_threads)]
+            result = json.loads(subprocess.check_output(command))
+            results.append(result)
+            print(f"{size}^3 ({result['shape_voxels'] / 1e6:.1f} M shape voxels), {outputs}: {result['seconds']:.2f} s, "
+                  f"peak {result['peak_mb']:.0f} MB ({result['peak_mb'] * 1024**2 / size**3:.1f} B/voxel)")
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
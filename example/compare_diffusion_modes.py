@@ -0,0 +1,58 @@
+import cv2
+import numpy as np
+from pyhjs import PyHJS, BinaryFrame, DiffusionMode
+from pathlib import Path
+import time
+
+import matplotlib.pyplot as plt
+
+SCRIPT_DIR = str(Path().parent)
+
+
+def count_nodes(skeleton):
+    """Number of end points (one neighbor) and junction pixels (more than two neighbors)."""
+    neighbors = cv2.filter2D(skeleton.astype(np.uint8), -1, np.ones((3, 3), np.float32), borderType=cv2.BORDER_CONSTANT) - skeleton
+    return int(np.sum((skeleton > 0) & (neighbors == 1))), int(np.sum((skeleton > 0) & (neighbors > 2)))
+
+
+def chamfer(skeleton_from, skeleton_to):
+    """Mean and max distance from the pixels of skeleton_from to skeleton_to."""
+    distance = cv2.distanceTransform((skeleton_to == 0).astype(np.uint8), cv2.DIST_L2, cv2.DIST_MASK_PRECISE)
+    values = distance[skeleton_from > 0]
+    return (float(values.mean()), float(values.max())) if values.size > 0 else (0.0, 0.0)
+
+
+def compute(hjs, label_mask, mode, repeat=5):
+    hjs.set_diffusion_mode(mode)
+    frame = BinaryFrame(label_mask)
+    start = time.time()
+    for _ in range(repeat):
+        hjs.compute(frame, enable_anisotropic_diffusion=True)
+    elapsed = (time.time() - start) / repeat
+    return hjs.get_skeleton_image().copy(), elapsed
+
+
+image = cv2.imread(f"{SCRIPT_DIR}/example/mask.png", cv2.IMREAD_ANYDEPTH)
+image = cv2.resize(image, None, fx=0.25, fy=0.25, interpolation=cv2.INTER_NEAREST)
+label_mask = np.zeros_like(image, dtype=np.uint8)
+label_mask[image > 0] = 255
+
+for threshold_branch_length in [0, 30]:
+    hjs = PyHJS(gamma=2.5, epsilon=1.5)
+    hjs.set_branch_pruning_parameters(threshold_branch_length=threshold_branch_length)
+    skeleton_two_pass, time_two_pass = compute(hjs, label_mask, DiffusionMode.TWO_PASS)
+    skeleton_single_pass, time_single_pass = compute(hjs, label_mask, DiffusionMode.SINGLE_PASS)
+
+    print(f"threshold_branch_length = {threshold_branch_length}")
+    for name, skeleton, elapsed in [("two-pass", skeleton_two_pass, time_two_pass), ("single-pass", skeleton_single_pass, time_single_pass)]:
+        num_end_points, num_junctions = count_nodes(skeleton)
+        print(f"  {name:12s} pixels {int(skeleton.sum()):5d}  end points {num_end_points:3d}  junctions {num_junctions:3d}  {elapsed * 1000:.1f} ms")
+    print("  single -> two-pass distance: mean %.2f, max %.1f px" % chamfer(skeleton_single_pass, skeleton_two_pass))
+    print("  two -> single-pass distance: mean %.2f, max %.1f px" % chamfer(skeleton_two_pass, skeleton_single_pass))
+
+fig, axes = plt.subplots(1, 2)
+for axis, title, skeleton in zip(axes, ["two-pass", "single-pass"], [skeleton_two_pass, skeleton_single_pass]):
+    axis.imshow(label_mask // 4 + skeleton * 192, cmap="gray")
+    axis.set_title(title)
+    axis.axis("off")
+plt.show()
@@ -0,0 +1,30 @@
+import cv2
+import numpy as np
+from pyhjs import PyHJS, BinaryFrame, Executor, Output
+from pathlib import Path
+import time
+
+SCRIPT_DIR = str(Path().parent)
+
+
+def load_masks(num_frames):
+    """Stand-in for a decoding loop: yields shifted copies of the example mask."""
+    image = cv2.imread(f"{SCRIPT_DIR}/example/mask.png", cv2.IMREAD_ANYDEPTH)
+    image = cv2.resize(image, None, fx=0.25, fy=0.25, interpolation=cv2.INTER_NEAREST)
+    label_mask = np.zeros_like(image, dtype=np.uint8)
+    label_mask[image > 0] = 255
+    for i in range(num_frames):
+        yield np.roll(label_mask, i, axis=1)
+
+
+hjs = PyHJS(gamma=2.5, epsilon=1.5, num_threads=1)
+hjs.set_branch_pruning_parameters(threshold_branch_length=30)
+
+# frames are computed by background workers while the loop keeps decoding;
+# submit() blocks once max_pending frames are in flight
+start = time.time()
+with Executor(num_workers=4, max_pending=8, ordered=True) as executor:
+    futures = [executor.submit(hjs, BinaryFrame(mask), outputs=Output.SKELETON) for mask in load_masks(32)]
+    skeletons = [future.result().skeleton_image for future in futures]
+end = time.time()
+print(f"{len(skeletons)} frames: {end - start:.3f} s")
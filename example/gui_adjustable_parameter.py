@@ -1,6 +1,6 @@
 import cv2
 import numpy as np
-from pyhjs import PyHJS, BinaryFrame
+from pyhjs import PyHJS, BinaryFrame, Output
 from pathlib import Path
 import cvui
 
@@ -24,10 +24,15 @@ class Skeletonizer(object):
 
     def compute(self, input_mask):
         frame = BinaryFrame(input_mask)
-        self._hjs.compute(frame, enable_anisotropic_diffusion=True)
-        skeleton = self._hjs.get_skeleton_image()
+        self._hjs.compute(frame, enable_anisotropic_diffusion=True, outputs=Output.ALL | Output.REPRUNE)
+        skeleton = self._hjs.get_skeleton_image().copy()  # results are read-only views
         return skeleton
 
+    def reprune(self, arc_angle_threshold):
+        # only the arc angle pruning is redone, from the state kept by compute() with Output.REPRUNE
+        self._hjs.reprune(arc_angle_threshold)
+        return self._hjs.get_skeleton_image().copy()
+
     def set_parameters(self, gamma, epsilon, arc_angle_threshold=0):
         self._hjs.set_parameters(gamma, epsilon, arc_angle_threshold)
 
@@ -59,6 +64,9 @@ def main():
     frame_height = image_viz_height + 400
     frame = np.zeros((frame_height, frame_width, 3), np.uint8)
 
+    parameters = None
+    skeleton_img = None
+
     WINDOW_NAME = "Skeletonization"
     cvui.init(WINDOW_NAME)
     while True:
@@ -74,8 +82,12 @@ def main():
         cvui.text(frame, 10, image_viz_height + 110, "angle_threshold, (default: 0.0)")
         cvui.trackbar(frame, 10, image_viz_height + 240, 180, angle_thresh, 0.0, 180.0)
 
-        skeletonizer.set_parameters(gamma[0], epsilon[0], angle_thresh[0])
-        skeleton_img = skeletonizer.compute(input_mask)
+        if parameters is None or parameters[:2] != (gamma[0], epsilon[0]):
+            skeletonizer.set_parameters(gamma[0], epsilon[0], angle_thresh[0])
+            skeleton_img = skeletonizer.compute(input_mask)
+        elif parameters[2] != angle_thresh[0]:
+            skeleton_img = skeletonizer.reprune(angle_thresh[0])
+        parameters = (gamma[0], epsilon[0], angle_thresh[0])
         skeleton_img = fill_boundary_zero(skeleton_img)
         skeleton_viz_img = (skeleton_img * 255).astype(np.uint8)
         skeleton_viz_img = cv2.cvtColor(cv2.resize(skeleton_viz_img, None, fx=scale, fy=scale), cv2.COLOR_GRAY2BGR)
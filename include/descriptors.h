@@ -0,0 +1,33 @@
+#ifndef PYHJS_INCLUDE_DESCRIPTORS_H_
+#define PYHJS_INCLUDE_DESCRIPTORS_H_
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "pruning.h"
+
+/*
+Shape descriptors of a skeleton, from the graph of its pixels and their radius (distance to the boundary).
+Pixels are neighbours when 8-adjacent, except diagonal pairs that share an axial neighbour on the skeleton (the
+corner of a staircase), so that a one pixel wide curve is a path whatever its connectivity. Pixels with more than
+two neighbours are junction pixels; a branch is a connected component of the other pixels, i.e. a path or a loop.
+Lengths add 1 per axial and sqrt(2) per diagonal step between neighbours.
+*/
+struct SkeletonDescriptors {
+    int32_t num_points;      // skeleton pixels
+    int32_t num_end_points;  // pixels with at most one neighbour
+    int32_t num_junctions;   // connected clusters of junction pixels
+    float total_length;      // [px]
+    std::vector<float> branch_length;       // [px], including the steps onto the junction pixels it touches
+    std::vector<int32_t> branch_offsets;    // branch b: width_profile[branch_offsets[b]] to width_profile[branch_offsets[b + 1] - 1]
+    std::vector<float> width_profile;       // 2 * radius of the pixels of each branch, from one end to the other [px]
+    std::vector<int32_t> radius_histogram;  // number of skeleton pixels with a radius in [k, k + 1) px
+
+    SkeletonDescriptors() : num_points(0), num_end_points(0), num_junctions(0), total_length(0) {}
+
+    size_t numBranches() const { return branch_length.size(); }
+};
+
+void describeSkeleton(const InscribedCircles &circles, const cv::Mat &skeleton_image, SkeletonDescriptors &descriptors);
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef PYHJS_INCLUDE_DISTANCE_TRANSFORM_H_
+#define PYHJS_INCLUDE_DISTANCE_TRANSFORM_H_
+
+#include <opencv2/opencv.hpp>
+
+void distanceTransformExact(const cv::Mat &mask_image, cv::Mat &distance_image, cv::Mat &feature_image, int num_threads = 0);
+
+#endif
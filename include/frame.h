@@ -1,30 +1,185 @@
 #ifndef PYHJS_INCLUDE_FRAME_H_
 #define PYHJS_INCLUDE_FRAME_H_
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <vector>
+
+#include "rle.h"
 
 class BinaryFrame
 {
 public:
-    BinaryFrame(const cv::Mat &binary_image)
+    /*
+    The frame refers to binary_image without copying it.
+    owner (optional) keeps the memory behind binary_image alive as long as the frame exists.
+    */
+    BinaryFrame(const cv::Mat &binary_image, const std::shared_ptr<void> &owner = std::shared_ptr<void>())
+        : owner_(owner)
+    {
+        SetBinaryImage(binary_image);
+        roi = cv::Rect(0, 0, binary_image.cols, binary_image.rows);
+        frame_width = image_width;
+        frame_height = image_height;
+    }
+
+    /*
+    Decode only the foreground bounding box of a run-length mask, grown by padding pixels (clipped to the frame).
+    cvmat then covers roi of the frame. The gradient and flux stencils reach two pixels outside the shape,
+    so with padding >= 2 the skeleton is the one of the decoded whole frame.
+    */
+    BinaryFrame(const RunLengthMask &mask, int padding = 4)
     {
+        CV_Assert(mask.height > 0 && mask.width > 0 && padding >= 0);
+        cv::Rect frame_rect(0, 0, mask.width, mask.height);
+        cv::Rect bounding_box = runLengthBoundingBox(mask);
+        if (bounding_box.area() == 0)
+            bounding_box = cv::Rect(0, 0, 1, 1);
+        roi = cv::Rect(bounding_box.x - padding, bounding_box.y - padding,
+                       bounding_box.width + 2 * padding, bounding_box.height + 2 * padding) &
+              frame_rect;
+
+        cv::Mat binary_image;
+        decodeRunLength(mask, roi, binary_image);
+        SetBinaryImage(binary_image);
+        frame_width = mask.width;
+        frame_height = mask.height;
+    }
+
+    /*
+    Rasterize polygons into a frame of frame_size. Each polygon is a closed ring of whole frame pixel coordinates
+    multiplied by scale; holes are rings of their own, and a pixel is inside if an odd number of rings enclose it
+    (cv::fillPoly). Pixels on the edges belong to the shape. As with a run-length mask, only the bounding box of the
+    rings grown by padding pixels (clipped to the frame) is rasterized. The pixels on the edges are the contour points
+    the thinning starts from, so they are not searched again in the raster; the skeleton can differ by a pixel from
+    the one of the same raster given as an image, where candidates of equal flux are removed in another order.
+    */
+    BinaryFrame(const std::vector<std::vector<cv::Point2f>> &polygons, const cv::Size &frame_size, float scale = 1, int padding = 4)
+    {
+        CV_Assert(frame_size.height > 0 && frame_size.width > 0 && scale > 0 && padding >= 0);
+        std::vector<std::vector<cv::Point>> rings;
+        int x_min = frame_size.width, y_min = frame_size.height, x_max = -1, y_max = -1;
+        for (const std::vector<cv::Point2f> &polygon : polygons)
+        {
+            if (polygon.empty())
+                continue;
+            rings.emplace_back();
+            for (const cv::Point2f &vertex : polygon)
+            {
+                cv::Point point(cvRound(vertex.x * scale), cvRound(vertex.y * scale));
+                rings.back().push_back(point);
+                x_min = std::min(x_min, point.x);
+                x_max = std::max(x_max, point.x);
+                y_min = std::min(y_min, point.y);
+                y_max = std::max(y_max, point.y);
+            }
+        }
+        cv::Rect frame_rect(0, 0, frame_size.width, frame_size.height);
+        roi = (x_max < x_min || y_max < y_min) ? cv::Rect()
+                                                : cv::Rect(x_min - padding, y_min - padding, x_max - x_min + 1 + 2 * padding, y_max - y_min + 1 + 2 * padding) & frame_rect;
+        if (roi.area() == 0)
+            roi = cv::Rect(0, 0, 1, 1);
+
+        cv::Mat binary_image = cv::Mat::zeros(roi.size(), CV_8UC1);
+        if (!rings.empty())
+        {
+            cv::fillPoly(binary_image, rings, cv::Scalar(255), cv::LINE_8, 0, -roi.tl());
+            for (std::vector<cv::Point> &ring : rings)
+            {
+                for (cv::Point &point : ring)
+                    point -= roi.tl();
+                cv::polylines(binary_image, ring, true, cv::Scalar(255), 1, cv::LINE_8);
+                for (size_t k = 0; k < ring.size(); k++)
+                {
+                    cv::LineIterator edge(binary_image, ring[k], ring[(k + 1) % ring.size()], 8);
+                    for (int n = 0; n < edge.count; n++, ++edge)
+                        contour_points.push_back(edge.pos());
+                }
+            }
+        }
         SetBinaryImage(binary_image);
+        frame_width = frame_size.width;
+        frame_height = frame_size.height;
     }
 
-    cv::Mat cvmat, cvmat_f;
-    std::vector<float> data;
-    size_t image_width, image_height;
+    /*
+    Bounding box of the foreground (values above the midpoint of min_value and max_value) in cvmat,
+    grown by padding pixels and clipped to cvmat; the whole of cvmat if there is no foreground.
+    */
+    cv::Rect foregroundBoundingBox(int padding) const
+    {
+        int threshold = (int(min_value) + int(max_value)) / 2;
+        int x_min = cvmat.cols, y_min = cvmat.rows, x_max = -1, y_max = -1;
+        for (int y = 0; y < cvmat.rows; y++)
+        {
+            const unsigned char *row = cvmat.ptr<unsigned char>(y);
+            for (int x = 0; x < cvmat.cols; x++)
+            {
+                if (row[x] <= threshold)
+                    continue;
+                x_min = std::min(x_min, x);
+                x_max = std::max(x_max, x);
+                y_min = std::min(y_min, y);
+                y_max = std::max(y_max, y);
+            }
+        }
+        if (x_max < 0)
+            return growBoundingBox(cv::Rect(), padding);
+        return growBoundingBox(cv::Rect(x_min, y_min, x_max - x_min + 1, y_max - y_min + 1), padding);
+    }
+
+    /* bounding_box of a foreground in cvmat grown by padding pixels and clipped to cvmat; the whole of cvmat if empty */
+    cv::Rect growBoundingBox(const cv::Rect &bounding_box, int padding) const
+    {
+        cv::Rect image_rect(0, 0, cvmat.cols, cvmat.rows);
+        if (bounding_box.area() == 0)
+            return image_rect;
+        return cv::Rect(bounding_box.x - padding, bounding_box.y - padding, bounding_box.width + 2 * padding, bounding_box.height + 2 * padding) & image_rect;
+    }
+
+    /*
+    Frame of the region rect of cvmat, sharing its memory. The threshold of this frame (min_value, max_value)
+    is kept, so the foreground is the same even if the region holds a single value.
+    */
+    BinaryFrame crop(const cv::Rect &rect) const
+    {
+        BinaryFrame cropped(cvmat(rect), owner_);
+        cropped.roi = cv::Rect(roi.x + rect.x, roi.y + rect.y, rect.width, rect.height);
+        cropped.frame_width = frame_width;
+        cropped.frame_height = frame_height;
+        cropped.min_value = min_value;
+        cropped.max_value = max_value;
+        for (const cv::Point &point : contour_points)
+        {
+            if (rect.contains(point))
+                cropped.contour_points.push_back(point - rect.tl());
+        }
+        return cropped;
+    }
+
+    /* float view of the mask, derived on demand */
+    cv::Mat getFloatImage() const
+    {
+        cv::Mat float_image;
+        cvmat.convertTo(float_image, CV_32F);
+        return float_image;
+    }
+
+    cv::Mat cvmat;
+    size_t image_width, image_height;  // size of cvmat
+    cv::Rect roi;                      // region of the whole frame held in cvmat
+    size_t frame_width, frame_height;  // size of the whole frame
     unsigned char max_value, min_value;
+    std::vector<cv::Point> contour_points;  // in cvmat; empty: searched in cvmat when needed
 
 private:
     void SetBinaryImage(const cv::Mat &binary_image)
     {
-        cvmat = binary_image.clone();
-        cvmat.convertTo(cvmat_f, CV_32F);
-
         TypeValidationBinaryImage(binary_image);
-        binary_image_ = binary_image;
+        cvmat = binary_image;
         image_width = binary_image.cols;
         image_height = binary_image.rows;
 
@@ -32,20 +187,9 @@ private:
         cv::minMaxLoc(binary_image, &min_value_d, &max_value_d);
         min_value = static_cast<unsigned char>(min_value_d);
         max_value = static_cast<unsigned char>(max_value_d);
-
-        std::vector<float> data_(image_width * image_height, 0);
-        for (size_t v = 0; v < image_height; v++)
-        {
-            for (size_t u = 0; u < image_width; u++)
-            {
-                size_t k = v * image_width + u;
-                data_[k] = static_cast<float>(binary_image.at<unsigned char>(v, u));
-            }
-        }
-        data = data_;
     }
 
-    void TypeValidationBinaryImage(const cv::Mat binary_image)
+    void TypeValidationBinaryImage(const cv::Mat &binary_image)
     {
         if (binary_image.type() != CV_8UC1)
         {
@@ -54,7 +198,7 @@ private:
         }
     }
 
-    cv::Mat binary_image_;
+    std::shared_ptr<void> owner_;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,8 @@
+#ifndef PYHJS_INCLUDE_GUO_HALL_H_
+#define PYHJS_INCLUDE_GUO_HALL_H_
+
+#include <opencv2/opencv.hpp>
+
+void guoHallThinning(const cv::Mat &mask_image, cv::Mat &skeleton_image, int threshold = 0, int num_threads = 0);
+
+#endif
@@ -3,115 +3,790 @@
 
 #include <chrono>
 #include <iostream>
+#include <memory>
+#include <numeric>
 #include <opencv2/opencv.hpp>
+#include <vector>
 
+#include "descriptors.h"
+#include "distance_transform.h"
 #include "frame.h"
+#include "guo_hall.h"
+#include "memory_tracker.h"
+#include "parallel.h"
 #include "pruning.h"
+#include "result_cache.h"
+#include "rle.h"
 #include "skeleton.h"
 #include "thinning.h"
 #include "anisotropic_diffusion.h"
 
+/* outputs retained by HamiltonJacobiSkeleton::compute() */
+enum SkeletonOutput
+{
+    kOutputSkeleton = 1,
+    kOutputDistanceTransform = 2,
+    kOutputFlux = 4,
+    kOutputPoints = 8,
+    kOutputRunLength = 16,
+    kOutputArcAngle = 32,
+    kOutputAll = kOutputSkeleton | kOutputDistanceTransform | kOutputFlux | kOutputPoints | kOutputRunLength | kOutputArcAngle,
+    kOutputDescriptors = 64,  // SkeletonDescriptors of the pruned skeleton; not in kOutputAll
+    kOutputReprune = 128      // not an output: compute() keeps the circles, distance and flux reprune() needs; not in kOutputAll
+};
+
+/* how compute() uses the anisotropically diffused distance */
+enum DiffusionMode
+{
+    kDiffusionTwoPass = 0,    // thin both distance maps, AND the raw skeleton with the dilated diffused one
+    kDiffusionSinglePass = 1  // thin the raw distance map only, keeping end points where the diffused flux is a sink
+};
+
+/* how compute() thins the shape into the skeleton */
+enum SkeletonEngine
+{
+    kEngineHamiltonJacobi = 0,  // homotopy preserving thinning in flux order
+    kEngineGuoHall = 1          // Guo-Hall parallel thinning: faster, without flux ordering, diffusion or coarse-to-fine
+};
+
+/* how the thinning removes the candidates */
+enum ThinningMode
+{
+    kThinningSerial = 0,   // one at a time in flux order
+    kThinningParallel = 1  // in flux bands, each sub-field of a band in parallel (see HomotopyPreservingThinning::setBatchRemoval)
+};
+
+/* lower-memory strategies compute() applies when a frame would exceed the memory budget */
+enum MemoryStrategy
+{
+    kMemoryCrop = 1,                // process the foreground bounding box only, then paste the images back
+    kMemoryPingPongDiffusion = 2,   // diffuse with two buffers instead of eight images per iteration
+    kMemoryBandedFlux = 4           // compute the gradient and flux a band of rows at a time
+};
+
+/* skeleton pixels in raster order and whole frame coordinates, as parallel arrays */
+struct SkeletonPoints
+{
+    std::vector<int32_t> x, y;
+    std::vector<float> radius;     // distance to the boundary [px]
+    std::vector<float> flux;
+    std::vector<float> arc_angle;  // largest angle spanned by the touching points of the inscribed circle [rad]
+
+    size_t size() const { return x.size(); }
+};
+
+/* outputs produced by HamiltonJacobiSkeleton::process(); empty when not requested */
+struct SkeletonResult
+{
+    cv::Mat skeleton_image;
+    cv::Mat distance_transform_image;
+    cv::Mat flux_image;
+    cv::Mat arc_angle_image;  // arc angle [rad] of every skeleton pixel before pruning, 0 elsewhere
+    SkeletonPoints points;
+    RunLengthMask skeleton_run_length;  // skeleton of the whole frame
+    SkeletonDescriptors descriptors;
+    MemoryReport memory;
+};
+
+/*
+compute() touches no shared state: separate instances can run concurrently from different threads.
+A single instance must not be used from several threads at once.
+*/
 class HamiltonJacobiSkeleton
 {
 public:
-    HamiltonJacobiSkeleton(float gamma, float epsilon, float threshold_arc_angle_inscribed_circle = 0)
-        : gamma_(gamma), epsilon_(epsilon), threshold_arc_angle_inscribed_circle_(threshold_arc_angle_inscribed_circle){};
+    /*
+    num_threads: thread budget of the parallel regions of compute() (0: OpenCV's shared pool). With num_threads > 1
+    they run on a pool of workers owned by the instance (and shared by its copies), started once.
+    The OpenCV calls of the pipeline (cv::Sobel, cv::dilate, cv::resize, cv::threshold, cv::connectedComponents)
+    are not bound by it: they use OpenCV's global pool, see cv::setNumThreads().
+    */
+    HamiltonJacobiSkeleton(float gamma, float epsilon, float threshold_arc_angle_inscribed_circle = 0, int num_threads = 0)
+        : gamma_(gamma), epsilon_(epsilon), threshold_arc_angle_inscribed_circle_(threshold_arc_angle_inscribed_circle),
+          threshold_branch_length_(0), threshold_branch_salience_(0), threshold_branch_radius_ratio_(0), num_threads_(num_threads),
+          diffusion_mode_(kDiffusionTwoPass), skeleton_engine_(kEngineHamiltonJacobi), thinning_mode_(kThinningSerial), thinning_flux_band_(kDefaultThinningFluxBand), coarse_to_fine_factor_(0), coarse_to_fine_radius_(0), memory_budget_(0),
+          memory_tracking_(false)
+    {
+        setNumThreads(num_threads);
+    };
     ~HamiltonJacobiSkeleton(){};
 
-    void compute(const BinaryFrame &frame, bool enable_anisotropic_diffusion = true)
+    /*
+    outputs: combination of SkeletonOutput flags; images not requested are not retained after the call
+    */
+    void compute(const BinaryFrame &frame, bool enable_anisotropic_diffusion = true, int outputs = kOutputAll)
     {
-        /* normalize and copy the images */
-        double min_frame_value, max_frame_value;
-        cv::Mat L_mat = frame.cvmat_f.clone();
-        cv::minMaxLoc(L_mat, &min_frame_value, &max_frame_value);
-        cv::normalize(L_mat, L_mat, 1, 0, cv::NORM_MINMAX);
-        cv::Mat L_mat_raw = L_mat.clone();
-        cv::threshold(L_mat, L_mat, 0.5, 1.0, cv::THRESH_BINARY_INV);
+        /* results are assigned to fresh buffers, so images handed out by a previous call stay untouched */
+        pruning_state_ = PruningState();
+        SkeletonResult result = run(frame, enable_anisotropic_diffusion, outputs, (outputs & kOutputReprune) ? &pruning_state_ : nullptr);
+        skeleton_image_ = result.skeleton_image;
+        distance_transform_image_ = result.distance_transform_image;
+        flux_image_ = result.flux_image;
+        arc_angle_image_ = result.arc_angle_image;
+        skeleton_points_ = std::move(result.points);
+        skeleton_run_length_ = std::move(result.skeleton_run_length);
+        skeleton_descriptors_ = std::move(result.descriptors);
+        memory_report_ = std::move(result.memory);
+    }
 
-        /* compute the distance function inside the silhouette */
-        cv::Mat D_mat;
-        cv::distanceTransform(frame.cvmat, D_mat, cv::DIST_L2, 3);
-        std::vector<cv::Point> contour_points = getContourPoints(frame.cvmat);
+    /*
+    Same pipeline as compute(), but the results are returned instead of kept in the instance.
+    It only reads the parameters, so one instance can serve several threads as long as nobody changes them meanwhile.
+    Throws cv::Exception for an empty frame.
+    */
+    SkeletonResult process(const BinaryFrame &frame, bool enable_anisotropic_diffusion = true, int outputs = kOutputAll) const
+    {
+        return run(frame, enable_anisotropic_diffusion, outputs, nullptr);
+    }
 
-        cv::Mat F_mat;
-        if (enable_anisotropic_diffusion)
+    /*
+    Prune the skeleton of the last compute() again with another threshold_arc_angle_inscribed_circle [deg]:
+    one pass over the inscribed circles kept by compute(), then the branch pruning with the current parameters.
+    Updates the skeleton image, points, run-length skeleton and descriptors; the distance transform, flux, thinning and
+    touching points are not recomputed. compute() must have been called with kOutputReprune.
+    */
+    void reprune(float threshold_arc_angle_inscribed_circle)
+    {
+        CV_Assert(!pruning_state_.D_mat.empty());
+        threshold_arc_angle_inscribed_circle_ = threshold_arc_angle_inscribed_circle;
+        ThreadPool::Scope pool_scope(thread_pool_.get());
+
+        PruningState &state = pruning_state_;
+        state.circles.applyThreshold(threshold_arc_angle_inscribed_circle);
+        SkeletonResult result;
+        pruneSkeleton(state.circles, state.D_mat, state.F_mat, state.offset, state.frame_size, state.outputs, result);
+        if (state.crop_rect.area() > 0)
+            pasteImages(state.crop_rect, state.pasted_size, result);
+
+        skeleton_image_ = result.skeleton_image;
+        skeleton_points_ = std::move(result.points);
+        skeleton_run_length_ = std::move(result.skeleton_run_length);
+        skeleton_descriptors_ = std::move(result.descriptors);
+    }
+
+    /*
+    Bytes of the cv::Mat buffers compute() is expected to hold at once for frame with the given MemoryStrategy flags.
+    Buffers of OpenCV internals and of the std containers (contour points, thinning queue, pruning graph) are not included.
+    */
+    int64_t estimateMemory(const BinaryFrame &frame, bool enable_anisotropic_diffusion = true, int outputs = kOutputAll, int strategies = 0) const
+    {
+        cv::Size working_size = frame.cvmat.size();
+        if (strategies & kMemoryCrop)
+            working_size = frame.foregroundBoundingBox(kMemoryCropPadding).size();
+        return estimateWorkingMemory(working_size, frame.cvmat.size(), enable_anisotropic_diffusion, outputs, strategies);
+    }
+
+    void setParameters(const float &gamma, const float &epsilon, float threshold_arc_angle_inscribed_circle = 0)
+    {
+        gamma_ = gamma;
+        epsilon_ = epsilon;
+        if (threshold_arc_angle_inscribed_circle > 0)
+        {
+            threshold_arc_angle_inscribed_circle_ = threshold_arc_angle_inscribed_circle;
+        }
+    }
+
+    /*
+    Terminal branches shorter than threshold_branch_length [px], with integrated |flux| below threshold_branch_salience
+    or shorter than threshold_branch_radius_ratio times the radius of their junction are removed (0 disables each test)
+    */
+    void setBranchPruningParameters(float threshold_branch_length, float threshold_branch_salience = 0, float threshold_branch_radius_ratio = 0)
+    {
+        threshold_branch_length_ = threshold_branch_length;
+        threshold_branch_salience_ = threshold_branch_salience;
+        threshold_branch_radius_ratio_ = threshold_branch_radius_ratio;
+    }
+
+    void setNumThreads(int num_threads)
+    {
+        num_threads_ = num_threads;
+        thread_pool_.reset(num_threads > 1 ? new ThreadPool(num_threads) : nullptr);
+    }
+
+    /*
+    Run the parallel regions on pool, which other instances can share (e.g. one pool per process), with a budget of
+    its size. Replaces setNumThreads(); nullptr is setNumThreads(0).
+    */
+    void setThreadPool(const std::shared_ptr<ThreadPool> &pool)
+    {
+        thread_pool_ = pool;
+        num_threads_ = pool ? pool->size() : 0;
+    }
+
+    int getNumThreads() const { return num_threads_; }
+
+    void setDiffusionMode(DiffusionMode diffusion_mode) { diffusion_mode_ = diffusion_mode; }
+
+    DiffusionMode getDiffusionMode() const { return diffusion_mode_; }
+
+    /*
+    kEngineGuoHall: a topologically correct, one pixel wide skeleton for tight latency budgets. The distance transform,
+    arc angle and branch pruning and the outputs are the same; anisotropic diffusion, coarse-to-fine and the
+    thinning mode do not apply. The flux is only computed if the flux image or the branch salience needs it
+    (the flux of the skeleton points is 0 otherwise).
+    */
+    void setSkeletonEngine(SkeletonEngine skeleton_engine) { skeleton_engine_ = skeleton_engine; }
+
+    SkeletonEngine getSkeletonEngine() const { return skeleton_engine_; }
+
+    /*
+    kThinningParallel: the thinning removes all candidates whose flux is within flux_band of the largest queued one
+    as a batch, using the num_threads budget. The skeleton has the same topology as the serial one but can move by a
+    pixel where the order within a band matters; it does not depend on the number of threads.
+    */
+    void setThinningMode(ThinningMode thinning_mode, float flux_band = kDefaultThinningFluxBand)
+    {
+        thinning_mode_ = thinning_mode;
+        thinning_flux_band_ = flux_band;
+    }
+
+    ThinningMode getThinningMode() const { return thinning_mode_; }
+
+    float getThinningFluxBand() const { return thinning_flux_band_; }
+
+    /*
+    factor > 1: skeletonize the mask downsampled by factor first, then thin at full resolution only within radius
+    pixels of the upsampled coarse skeleton (0: radius = factor). The anisotropic diffusion setting applies to the
+    coarse pass. Falls back to the full computation when the corridor changes the topology of the shape.
+    The flux image is zero outside the corridor. Without anisotropic diffusion, the skeleton has the components and
+    holes of the full resolution one and lies within 2 pixels of it; branches of details that the downsampling
+    removes are missing.
+    */
+    void setCoarseToFine(int factor, int radius = 0)
+    {
+        coarse_to_fine_factor_ = factor;
+        coarse_to_fine_radius_ = radius;
+    }
+
+    int getCoarseToFineFactor() const { return coarse_to_fine_factor_; }
+
+    int getCoarseToFineRadius() const { return coarse_to_fine_radius_; }
+
+    /*
+    budget_bytes > 0: when estimateMemory() of a frame exceeds the budget, compute() crops to the foreground, then
+    diffuses with ping-pong buffers, then computes the flux in row bands, stopping at the first combination that
+    fits (or applying all of them). The results are the same as without a budget.
+    */
+    void setMemoryBudget(int64_t budget_bytes) { memory_budget_ = budget_bytes; }
+
+    int64_t getMemoryBudget() const { return memory_budget_; }
+
+    /* measure the cv::Mat bytes of each compute() call (see MemoryTracker); the report is in getMemoryReport() */
+    void setMemoryTracking(bool enable) { memory_tracking_ = enable; }
+
+    bool getMemoryTracking() const { return memory_tracking_; }
+
+    const MemoryReport &getMemoryReport() const { return memory_report_; }
+
+    /*
+    Serve compute() and process() from cache when the same mask was processed with the same parameters and outputs
+    before, and store what is computed otherwise (nullptr: no cache). The cache can be shared by several instances.
+    A hit has no memory report. compute() with kOutputReprune is never served from the cache, so reprune() always
+    has its state.
+    */
+    void setResultCache(const std::shared_ptr<ResultCache> &cache) { result_cache_ = cache; }
+
+    std::shared_ptr<ResultCache> getResultCache() const { return result_cache_; }
+
+    /*
+    The accessors share the result buffers (no copy); they must not be modified in place.
+    The skeleton is CV_8U (0 or 1), the distance transform and flux CV_32F. Empty if not requested in compute().
+    The images cover frame.roi (the whole frame unless it was built from a run-length mask); the skeleton points and
+    the run-length skeleton are in whole frame coordinates.
+    */
+    cv::Mat getSkeletonImage() const { return skeleton_image_; }
+
+    cv::Mat getDistanceTransformImage() const { return distance_transform_image_; }
+
+    cv::Mat getFluxImage() const { return flux_image_; }
+
+    /* CV_32F, [rad]; unlike the skeleton image it does not depend on the pruning thresholds */
+    cv::Mat getArcAngleImage() const { return arc_angle_image_; }
+
+    const SkeletonPoints &getSkeletonPoints() const { return skeleton_points_; }
+
+    const RunLengthMask &getSkeletonRunLength() const { return skeleton_run_length_; }
+
+    /* branch lengths, width profiles, end point and junction counts and radius histogram of the pruned skeleton */
+    const SkeletonDescriptors &getSkeletonDescriptors() const { return skeleton_descriptors_; }
+
+private:
+    /* what reprune() needs of the last compute(); D_mat is empty if there is none */
+    struct PruningState
+    {
+        PruningState() : outputs(0){};
+
+        InscribedCircles circles;
+        cv::Mat D_mat, F_mat;  // of the frame processed, i.e. of crop_rect if cropped
+        cv::Point offset;      // of the frame processed in whole frame coordinates
+        cv::Size frame_size;   // whole frame (BinaryFrame::frame_width, frame_height)
+        cv::Rect crop_rect;    // empty unless kMemoryCrop was applied
+        cv::Size pasted_size;  // size of the images crop_rect is pasted into
+        int outputs;
+    };
+
+    /* process(); state: if given, filled in for reprune() */
+    SkeletonResult run(const BinaryFrame &frame, bool enable_anisotropic_diffusion, int outputs, PruningState *state) const
+    {
+        CV_Assert(!frame.cvmat.empty());
+        ThreadPool::Scope pool_scope(thread_pool_.get());
+        /* a hit cannot fill state, so a compute() for reprune() skips the lookup; its result is stored as a plain one */
+        int cached_outputs = outputs & ~kOutputReprune;
+        CacheKey key;
+        if (result_cache_)
+        {
+            key = cacheKey(frame, enable_anisotropic_diffusion, cached_outputs);
+            SkeletonResult cached;
+            if (!state && result_cache_->load(key, cached_outputs, frame, cached))
+                return cached;
+        }
+
+        std::unique_ptr<MemoryTracker> tracker(memory_tracking_ ? new MemoryTracker() : nullptr);
+        MemoryReport report;
+        report.budget_bytes = memory_budget_;
+
+        /* one boundary pass per frame: the thinning seeds (unless the frame has its polygon edges) and the crop */
+        markStage(tracker.get(), "boundary");
+        MaskBoundary boundary;
+        extractBoundary(frame.cvmat, boundary, (int(frame.min_value) + int(frame.max_value)) / 2, num_threads_);
+        if (!frame.contour_points.empty())
+            boundary.points.clear();
+
+        cv::Rect crop_rect;
+        report.strategies = selectMemoryStrategies(frame, boundary.bounding_box, enable_anisotropic_diffusion, outputs, crop_rect, report.estimated_bytes);
+
+        SkeletonResult result;
+        if (report.strategies & kMemoryCrop)
+        {
+            for (cv::Point &point : boundary.points)
+                point -= crop_rect.tl();
+            result = processFrame(frame.crop(crop_rect), boundary.points, enable_anisotropic_diffusion, outputs, report.strategies, tracker.get(), state);
+            pasteImages(crop_rect, frame.cvmat.size(), result);
+            if (state)
+            {
+                state->crop_rect = crop_rect;
+                state->pasted_size = frame.cvmat.size();
+            }
+        }
+        else
+        {
+            result = processFrame(frame, boundary.points, enable_anisotropic_diffusion, outputs, report.strategies, tracker.get(), state);
+        }
+
+        if (tracker)
+            tracker->finish(report);
+        result.memory = report;
+        if (result_cache_)
+            result_cache_->store(key, cached_outputs, frame, result);
+        return result;
+    }
+
+    /*
+    Everything the results depend on: the mask as processed (with its position in the frame and the contour points
+    of a polygon frame) and the parameters. The thread count and the memory budget do not change the results.
+    */
+    CacheKey cacheKey(const BinaryFrame &frame, bool enable_anisotropic_diffusion, int outputs) const
+    {
+        CacheKeyHasher hasher;
+        hasher.updateImage(frame.cvmat);
+        const int32_t settings[] = {
+            static_cast<int32_t>(kResultCacheVersion), frame.roi.x, frame.roi.y,
+            static_cast<int32_t>(frame.frame_width), static_cast<int32_t>(frame.frame_height),
+            enable_anisotropic_diffusion, outputs, diffusion_mode_, skeleton_engine_, thinning_mode_,
+            coarse_to_fine_factor_, coarse_to_fine_radius_};
+        const float parameters[] = {
+            gamma_, epsilon_, threshold_arc_angle_inscribed_circle_, threshold_branch_length_, threshold_branch_salience_,
+            threshold_branch_radius_ratio_, thinning_flux_band_};
+        hasher.update(settings, sizeof(settings));
+        hasher.update(parameters, sizeof(parameters));
+        hasher.update(frame.contour_points.data(), frame.contour_points.size() * sizeof(cv::Point));
+        return hasher.digest();
+    }
+
+    /*
+    pipeline of process() on frame as given; boundary_points: boundary of frame.cvmat, unused if the frame has contour
+    points; strategies: MemoryStrategy flags except kMemoryCrop
+    */
+    SkeletonResult processFrame(const BinaryFrame &frame, const std::vector<cv::Point> &boundary_points, bool enable_anisotropic_diffusion, int outputs,
+                                int strategies, MemoryTracker *tracker, PruningState *state) const
+    {
+        const std::vector<cv::Point> &contour_points = frame.contour_points.empty() ? boundary_points : frame.contour_points;
+
+        markStage(tracker, "distance_transform");
+
+        /* background label: min-max normalized mask <= 0.5, i.e. 2 * value <= min + max, in one byte pass */
+        cv::Mat L_mat;
+        cv::threshold(frame.cvmat, L_mat, (int(frame.min_value) + int(frame.max_value)) / 2, 1, cv::THRESH_BINARY_INV);
+
+        /* compute the distance function inside the silhouette and the nearest boundary pixels */
+        cv::Mat D_mat, feature_mat;
+        distanceTransformExact(frame.cvmat, D_mat, feature_mat, num_threads_);
+
+        cv::Mat F_mat, skeleton_image, corridor;
+        bool coarse_to_fine = false;
+        if (coarse_to_fine_factor_ > 1 && skeleton_engine_ == kEngineHamiltonJacobi)
+        {
+            markStage(tracker, "coarse_to_fine");
+            coarse_to_fine = getCoarseCorridor(frame, enable_anisotropic_diffusion, corridor);
+        }
+
+        if (skeleton_engine_ == kEngineGuoHall)
+        {
+            markStage(tracker, "thinning");
+            guoHallThinning(frame.cvmat, skeleton_image, (int(frame.min_value) + int(frame.max_value)) / 2, num_threads_);
+            if ((outputs & kOutputFlux) || threshold_branch_salience_ > 0)
+                getFlux(D_mat, frame.image_width, frame.image_height, F_mat, cv::Mat(), strategies);
+            else if (threshold_branch_length_ > 0 || threshold_branch_radius_ratio_ > 0)
+                F_mat = cv::Mat::zeros(D_mat.size(), CV_32F);
+        }
+        else if (coarse_to_fine)
+        {
+            /*
+            Thin only the corridor around the coarse skeleton: the rest of the shape is marked removed from the start
+            and the thinning is seeded with the corridor boundary. The flux is computed inside the corridor only.
+            */
+            cv::Mat L_mat_corridor;
+            cv::threshold(corridor, L_mat_corridor, 0, 1, cv::THRESH_BINARY_INV);
+            MaskBoundary corridor_boundary;
+            extractBoundary(corridor, corridor_boundary, 0, num_threads_);
+            markStage(tracker, "thinning");
+            getSkeletonFromSlopyImage(D_mat, L_mat_corridor, frame.image_width, frame.image_height, skeleton_image, F_mat, corridor_boundary.points, cv::Mat(), corridor,
+                                      strategies);
+        }
+        else if (enable_anisotropic_diffusion && diffusion_mode_ == kDiffusionSinglePass)
+        {
+            /*
+            One thinning of the raw distance map; end points survive only near the sinks of the diffused flux,
+            where the skeleton of the diffused map would end. Spurious branches are eroded back to their junctions.
+            */
+            markStage(tracker, "diffusion");
+            cv::Mat end_point_mask;
+            {
+                cv::Mat D_mat_ad = diffuse(D_mat, strategies);
+                cv::Mat F_mat_ad;
+                float flux_threshold_ad = getFlux(D_mat_ad, frame.image_width, frame.image_height, F_mat_ad, cv::Mat(), strategies);
+                end_point_mask = F_mat_ad <= flux_threshold_ad;
+            }
+            cv::dilate(end_point_mask, end_point_mask, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3)));
+            markStage(tracker, "thinning");
+            getSkeletonFromSlopyImage(D_mat, L_mat, frame.image_width, frame.image_height, skeleton_image, F_mat, contour_points, end_point_mask, cv::Mat(), strategies);
+        }
+        else if (enable_anisotropic_diffusion)
         {
             /*
             Generate skeleton with anisotropic diffusion
             (the skeleton is less likely to generate sprious skeleton. But it doesn't have completely thinned structure.)
             */
+            markStage(tracker, "diffusion");
             cv::Mat skeleton_image_ad;
-            cv::Mat D_mat_ad = anisotropicDiffusionOMP(D_mat, 0.05, 0.2, 50);
-            getSkeletonFromSlopyImage(D_mat_ad, L_mat, frame.image_width, frame.image_height, skeleton_image_ad, F_mat, contour_points);
+            {
+                cv::Mat D_mat_ad = diffuse(D_mat, strategies);
+                markStage(tracker, "thinning");
+                getSkeletonFromSlopyImage(D_mat_ad, L_mat, frame.image_width, frame.image_height, skeleton_image_ad, F_mat, contour_points, cv::Mat(), cv::Mat(), strategies);
+            }
 
             /* Get thinned skeleton combined with two skeletons */
             cv::dilate(skeleton_image_ad, skeleton_image_ad, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3)));
-            getSkeletonFromSlopyImage(D_mat, L_mat, frame.image_width, frame.image_height, skeleton_image_, F_mat, contour_points);
-            skeleton_image_ = skeleton_image_ & skeleton_image_ad;
+            getSkeletonFromSlopyImage(D_mat, L_mat, frame.image_width, frame.image_height, skeleton_image, F_mat, contour_points, cv::Mat(), cv::Mat(), strategies);
+            skeleton_image = skeleton_image & skeleton_image_ad;
         }
         else
         {
-            getSkeletonFromSlopyImage(D_mat, L_mat, frame.image_width, frame.image_height, skeleton_image_, F_mat, contour_points);
+            markStage(tracker, "thinning");
+            getSkeletonFromSlopyImage(D_mat, L_mat, frame.image_width, frame.image_height, skeleton_image, F_mat, contour_points, cv::Mat(), cv::Mat(), strategies);
         }
 
-        cv::Mat contour_mask = getContourMask(frame.cvmat);
-        PruningSkeleton pruning = PruningSkeleton(threshold_arc_angle_inscribed_circle_);
-        pruning.setImages(skeleton_image_, D_mat, contour_mask);
+        markStage(tracker, "pruning");
+        PruningSkeleton pruning = PruningSkeleton(threshold_arc_angle_inscribed_circle_, num_threads_);
+        pruning.setImages(skeleton_image, D_mat, feature_mat);
         pruning.setInscribedCircles();
-        skeleton_image_ = pruning.getPrunedSkeleton();
+        skeleton_image.release();
+
+        SkeletonResult result;
+        cv::Size frame_size(frame.frame_width, frame.frame_height);
+        pruneSkeleton(pruning.getInscribedCircles(), D_mat, F_mat, frame.roi.tl(), frame_size, outputs, result, tracker);
+        if (outputs & kOutputDistanceTransform)
+            result.distance_transform_image = D_mat;
+        if (outputs & kOutputFlux)
+            result.flux_image = F_mat;
+        if (outputs & kOutputArcAngle)
+            result.arc_angle_image = PruningSkeleton::getArcAngleImage(pruning.getInscribedCircles(), frame.cvmat.size());
 
-        distance_transform_image_ = D_mat;
-        flux_image_ = F_mat;
+        if (state)
+        {
+            state->circles = pruning.releaseInscribedCircles();
+            state->D_mat = D_mat;
+            state->F_mat = F_mat;
+            state->offset = frame.roi.tl();
+            state->frame_size = frame_size;
+            state->outputs = outputs;
+        }
+        return result;
     }
 
-    void setParameters(const float &gamma, const float &epsilon, float threshold_arc_angle_inscribed_circle = 0)
+    /*
+    Skeleton, points, run-length skeleton and descriptors of result from the circles left by the arc angle pruning,
+    after the branch pruning; offset: of D_mat in whole frame coordinates, frame_size: of the whole frame
+    */
+    void pruneSkeleton(const InscribedCircles &circles, const cv::Mat &D_mat, const cv::Mat &F_mat, const cv::Point &offset, const cv::Size &frame_size,
+                       int outputs, SkeletonResult &result, MemoryTracker *tracker = nullptr) const
     {
-        gamma_ = gamma;
-        epsilon_ = epsilon;
-        if (threshold_arc_angle_inscribed_circle > 0)
+        /* with points or descriptors only and no branch pruning, the pruned skeleton is read from the circles without a dense image */
+        cv::Mat skeleton_image;
+        bool enable_branch_pruning = threshold_branch_length_ > 0 || threshold_branch_salience_ > 0 || threshold_branch_radius_ratio_ > 0;
+        if ((outputs & kOutputSkeleton) || enable_branch_pruning)
+            skeleton_image = PruningSkeleton::getPrunedSkeleton(circles, D_mat.size());
+
+        if (enable_branch_pruning)
         {
-            threshold_arc_angle_inscribed_circle_ = threshold_arc_angle_inscribed_circle;
+            BranchPruning branch_pruning = BranchPruning(threshold_branch_length_, threshold_branch_salience_, threshold_branch_radius_ratio_);
+            branch_pruning.setImages(skeleton_image, D_mat, F_mat);
+            branch_pruning.compute();
+            skeleton_image = branch_pruning.getPrunedSkeleton();
         }
+
+        markStage(tracker, "outputs");
+        if (outputs & kOutputSkeleton)
+            result.skeleton_image = skeleton_image;
+        if (outputs & (kOutputPoints | kOutputRunLength))
+            collectSkeletonPoints(circles, skeleton_image, F_mat, offset, result.points);
+        if (outputs & kOutputRunLength)
+            encodeRunLength(result.points.x, result.points.y, frame_size.height, frame_size.width, result.skeleton_run_length);
+        if (!(outputs & kOutputPoints))
+            result.points = SkeletonPoints();
+        if (outputs & kOutputDescriptors)
+            describeSkeleton(circles, skeleton_image, result.descriptors);
     }
 
-    cv::Mat getSkeletonImage() { return skeleton_image_.clone(); }
+    static constexpr float kDefaultThinningFluxBand = 0.1f;
+    static const int kMemoryCropPadding = 4;
+    static const int kFluxBandRows = 64;
 
-    cv::Mat getDistanceTransformImage() { return distance_transform_image_.clone(); }
+    static void markStage(MemoryTracker *tracker, const char *name)
+    {
+        if (tracker)
+            tracker->beginStage(name);
+    }
 
-    cv::Mat getFluxImage() { return flux_image_.clone(); }
+    /* cv::Mat bytes held at once by processFrame() on working_size, plus the pasted output images of frame_size */
+    int64_t estimateWorkingMemory(const cv::Size &working_size, const cv::Size &frame_size, bool enable_anisotropic_diffusion, int outputs, int strategies) const
+    {
+        int64_t pixels = int64_t(working_size.width) * working_size.height;
+        int64_t flux_row_bytes = int64_t(working_size.width) * sizeof(float);
+        /* label (1), distance (4) and feature map (4) live through the whole pipeline */
+        int64_t base = 9 * pixels;
+        /* gradient (8) while the flux (4) is computed; a band of each with kMemoryBandedFlux */
+        int64_t flux = (strategies & kMemoryBandedFlux) ? 4 * pixels + 3 * (kFluxBandRows + 4) * flux_row_bytes : 12 * pixels;
+        /* flux (4), thinning status (1) and skeleton (1) */
+        int64_t thinning = 6 * pixels;
 
-private:
-    void getSkeletonFromSlopyImage(const cv::Mat &D_mat, const cv::Mat &L_mat, int image_width, int image_height, cv::Mat &skeleton_mat, cv::Mat &F_mat, std::vector<cv::Point> &contour_points)
+        int64_t working = base + std::max(flux, thinning);
+        if (enable_anisotropic_diffusion)
+        {
+            /* diffused distance (4) and its buffers: eight images per iteration, or a second one with ping-pong */
+            int64_t diffusion = (strategies & kMemoryPingPongDiffusion) ? 8 * pixels : 40 * pixels;
+            /* the diffused distance is kept through the first thinning, whose skeleton (1) is kept through the second */
+            working = base + std::max(diffusion, 4 * pixels + std::max(flux, thinning) + pixels);
+        }
+        if (coarse_to_fine_factor_ > 1)
+            working += pixels;  // corridor
+
+        int64_t pasted = 0;
+        if (strategies & kMemoryCrop)
+        {
+            int64_t frame_pixels = int64_t(frame_size.width) * frame_size.height;
+            pasted = frame_pixels * (((outputs & kOutputSkeleton) ? 1 : 0) + ((outputs & kOutputDistanceTransform) ? 4 : 0) + ((outputs & kOutputFlux) ? 4 : 0) +
+                                    ((outputs & kOutputArcAngle) ? 4 : 0));
+        }
+        return working + pasted;
+    }
+
+    /*
+    MemoryStrategy flags for frame under the budget; foreground_box: bounding box of the foreground of frame.cvmat;
+    crop_rect: region processed with kMemoryCrop
+    */
+    int selectMemoryStrategies(const BinaryFrame &frame, const cv::Rect &foreground_box, bool enable_anisotropic_diffusion, int outputs, cv::Rect &crop_rect,
+                               int64_t &estimated_bytes) const
     {
-        /* compute the gradient */
-        cv::Mat Dx_mat, Dy_mat;
-        cv::Sobel(D_mat, Dx_mat, CV_32F, 1, 0);
-        cv::Sobel(D_mat, Dy_mat, CV_32F, 0, 1);
+        cv::Size frame_size = frame.cvmat.size();
+        estimated_bytes = estimateWorkingMemory(frame_size, frame_size, enable_anisotropic_diffusion, outputs, 0);
+        if (memory_budget_ <= 0 || estimated_bytes <= memory_budget_)
+            return 0;
+
+        crop_rect = frame.growBoundingBox(foreground_box, kMemoryCropPadding);
+        int crop = (crop_rect.size() != frame_size) ? kMemoryCrop : 0;
+        const int candidates[] = {crop, crop | kMemoryPingPongDiffusion, crop | kMemoryPingPongDiffusion | kMemoryBandedFlux};
+        int strategies = 0;
+        for (int candidate : candidates)
+        {
+            strategies = candidate;
+            estimated_bytes = estimateWorkingMemory(crop ? crop_rect.size() : frame_size, frame_size, enable_anisotropic_diffusion, outputs, strategies);
+            if (estimated_bytes <= memory_budget_)
+                break;
+        }
+        return strategies;
+    }
 
-        /* flux computation */
+    /* the images of result, computed on crop_rect, as images of frame_size (zero outside crop_rect) */
+    static void pasteImages(const cv::Rect &crop_rect, const cv::Size &frame_size, SkeletonResult &result)
+    {
+        cv::Mat *images[] = {&result.skeleton_image, &result.distance_transform_image, &result.flux_image, &result.arc_angle_image};
+        for (cv::Mat *image : images)
+        {
+            if (image->empty())
+                continue;
+            cv::Mat pasted = cv::Mat::zeros(frame_size, image->type());
+            cv::Mat pasted_roi = pasted(crop_rect);
+            image->copyTo(pasted_roi);
+            *image = pasted;
+        }
+    }
+
+    cv::Mat diffuse(const cv::Mat &D_mat, int strategies) const
+    {
+        if (strategies & kMemoryPingPongDiffusion)
+            return anisotropicDiffusionPingPong(D_mat, 0.05, 0.2, 50, num_threads_);
+        return anisotropicDiffusionOMP(D_mat, 0.05, 0.2, 50, num_threads_);
+    }
+
+
+    /* flux of the distance gradient (inside flux_mask if given); returns the end point threshold of the thinning */
+    float getFlux(const cv::Mat &D_mat, int image_width, int image_height, cv::Mat &F_mat, const cv::Mat &flux_mask = cv::Mat(), int strategies = 0) const
+    {
         F_mat = cv::Mat::zeros(cv::Size(image_width, image_height), CV_32F);
-        flux(Dx_mat, Dy_mat, F_mat);
+        if (strategies & kMemoryBandedFlux)
+        {
+            fluxBanded(D_mat, F_mat, kFluxBandRows, flux_mask);
+        }
+        else
+        {
+            /* compute the gradient */
+            cv::Mat Dx_mat, Dy_mat;
+            cv::Sobel(D_mat, Dx_mat, CV_32F, 1, 0);
+            cv::Sobel(D_mat, Dy_mat, CV_32F, 0, 1);
+
+            /* flux computation */
+            flux(Dx_mat, Dy_mat, F_mat, flux_mask);
+        }
 
-        /* homotopy preserved thinning */
         double F_max, F_min;
         cv::minMaxLoc(F_mat, &F_min, &F_max);
-        float flux_threshold = F_min / gamma_;
+        return F_min / gamma_;
+    }
 
+    void getSkeletonFromSlopyImage(const cv::Mat &D_mat, const cv::Mat &L_mat, int image_width, int image_height, cv::Mat &skeleton_mat, cv::Mat &F_mat,
+                                   const std::vector<cv::Point> &contour_points, const cv::Mat &end_point_mask = cv::Mat(), const cv::Mat &flux_mask = cv::Mat(),
+                                   int strategies = 0) const
+    {
+        float flux_threshold = getFlux(D_mat, image_width, image_height, F_mat, flux_mask, strategies);
+
+        /* homotopy preserved thinning */
         HomotopyPreservingThinning thinning = HomotopyPreservingThinning(flux_threshold);
         thinning.setImages(L_mat, D_mat, F_mat);
         thinning.setContourPoints(contour_points);
+        thinning.setEndPointMask(end_point_mask);
+        if (thinning_mode_ == kThinningParallel)
+            thinning.setBatchRemoval(thinning_flux_band_, num_threads_);
         thinning.compute();
 
         /* store results */
-        skeleton_mat = thinning.getSkeletonImage().clone();
+        skeleton_mat = thinning.getSkeletonImage();
+    }
+
+    /*
+    Corridor (CV_8U, 0/255) of the skeleton of the mask downsampled by coarse_to_fine_factor_, mapped back to full
+    resolution and dilated by coarse_to_fine_radius_ pixels, within the shape.
+    Returns false if the corridor does not have the components and holes of the full resolution shape
+    (e.g. a narrow part vanished when downsampling); the caller then thins the whole shape.
+    */
+    bool getCoarseCorridor(const BinaryFrame &frame, bool enable_anisotropic_diffusion, cv::Mat &corridor) const
+    {
+        int factor = coarse_to_fine_factor_;
+        cv::Size coarse_size((frame.cvmat.cols + factor - 1) / factor, (frame.cvmat.rows + factor - 1) / factor);
+        if (coarse_size.width < 3 || coarse_size.height < 3)
+            return false;
+
+        cv::Mat shape = frame.cvmat > (int(frame.min_value) + int(frame.max_value)) / 2;
+        cv::Mat coarse_mask;
+        cv::resize(shape, coarse_mask, coarse_size, 0, 0, cv::INTER_AREA);
+        coarse_mask = coarse_mask >= 128;
+
+        /* shares the workers of this instance instead of starting its own */
+        HamiltonJacobiSkeleton coarse(gamma_, epsilon_, 0, 0);
+        coarse.num_threads_ = num_threads_;
+        coarse.thread_pool_ = thread_pool_;
+        coarse.setDiffusionMode(diffusion_mode_);
+        coarse.setThinningMode(thinning_mode_, thinning_flux_band_);
+        SkeletonResult coarse_result = coarse.process(BinaryFrame(coarse_mask), enable_anisotropic_diffusion, kOutputSkeleton);
+
+        cv::resize(coarse_result.skeleton_image, corridor, shape.size(), 0, 0, cv::INTER_NEAREST);
+        int radius = (coarse_to_fine_radius_ > 0) ? coarse_to_fine_radius_ : factor;
+        cv::dilate(corridor, corridor, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(2 * radius + 1, 2 * radius + 1)));
+        corridor = (corridor > 0) & shape;
+
+        return countComponentsAndHoles(corridor) == countComponentsAndHoles(shape);
+    }
+
+    /* 8-connected foreground components and 4-connected background components not touching the image border */
+    static std::pair<int, int> countComponentsAndHoles(const cv::Mat &shape)
+    {
+        cv::Mat labels, background;
+        int num_components = cv::connectedComponents(shape, labels, 8, CV_32S) - 1;
+        cv::copyMakeBorder(shape == 0, background, 1, 1, 1, 1, cv::BORDER_CONSTANT, cv::Scalar(255));
+        int num_holes = cv::connectedComponents(background, labels, 4, CV_32S) - 2;
+        return std::make_pair(num_components, num_holes);
+    }
+
+    /*
+    The circles kept by the arc angle pruning, minus the pixels removed by the branch pruning if skeleton_mat is given
+    */
+    void collectSkeletonPoints(const InscribedCircles &circles, const cv::Mat &skeleton_mat, const cv::Mat &F_mat, const cv::Point &offset, SkeletonPoints &points) const
+    {
+        size_t num_points = circles.size() - std::accumulate(circles.is_sprious.begin(), circles.is_sprious.end(), size_t(0));
+        points.x.reserve(num_points);
+        points.y.reserve(num_points);
+        points.radius.reserve(num_points);
+        points.flux.reserve(num_points);
+        points.arc_angle.reserve(num_points);
+        for (size_t index = 0; index < circles.size(); index++)
+        {
+            if (circles.is_sprious[index])
+                continue;
+            int32_t x = circles.center_x[index];
+            int32_t y = circles.center_y[index];
+            if (!skeleton_mat.empty() && skeleton_mat.at<uchar>(y, x) == 0)
+                continue;
+            points.x.push_back(x + offset.x);
+            points.y.push_back(y + offset.y);
+            points.radius.push_back(circles.radius[index]);
+            points.flux.push_back(F_mat.empty() ? 0.f : F_mat.at<float>(y, x));
+            points.arc_angle.push_back(circles.arc_angle[index]);
+        }
     }
 
     cv::Mat distance_transform_image_;
     cv::Mat flux_image_;
+    cv::Mat arc_angle_image_;
     cv::Mat skeleton_image_;
+    SkeletonPoints skeleton_points_;
+    RunLengthMask skeleton_run_length_;
+    SkeletonDescriptors skeleton_descriptors_;
+    MemoryReport memory_report_;
+    PruningState pruning_state_;
 
-    float threshold_arc_angle_inscribed_circle_;
     float gamma_, epsilon_;
+    float threshold_arc_angle_inscribed_circle_;
+    float threshold_branch_length_, threshold_branch_salience_, threshold_branch_radius_ratio_;
+    int num_threads_;
+    std::shared_ptr<ThreadPool> thread_pool_;
+    DiffusionMode diffusion_mode_;
+    SkeletonEngine skeleton_engine_;
+    ThinningMode thinning_mode_;
+    float thinning_flux_band_;
+    int coarse_to_fine_factor_, coarse_to_fine_radius_;
+    int64_t memory_budget_;
+    bool memory_tracking_;
+    std::shared_ptr<ResultCache> result_cache_;
 };
 
 #endif
\ No newline at end of file
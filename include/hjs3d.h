@@ -0,0 +1,126 @@
+#ifndef PYHJS_INCLUDE_HJS3D_H_
+#define PYHJS_INCLUDE_HJS3D_H_
+
+#include <memory>
+
+#include "hjs.h"
+#include "skeleton3d.h"
+#include "thinning3d.h"
+
+/* outputs produced by HamiltonJacobiSkeleton3D::process(); empty when not requested */
+struct SkeletonResult3D
+{
+    std::shared_ptr<Volume<uint8_t>> skeleton;  // 1 on the skeleton
+    std::shared_ptr<Volume<float>> distance_transform;
+    std::shared_ptr<Volume<float>> flux;
+};
+
+/*
+Hamilton-Jacobi skeleton of a volume: exact 3D distance transform, 26-neighbour average outward flux and homotopy
+preserving thinning in flux order (see HomotopyPreservingThinning3D). There is no anisotropic diffusion nor pruning.
+As HamiltonJacobiSkeleton, process() only reads the parameters and separate instances can run concurrently.
+*/
+class HamiltonJacobiSkeleton3D
+{
+public:
+    /*
+    num_threads: thread budget of every parallel region (0: OpenCV's shared pool). The distance transform and the
+    flux run in parallel over slabs of z-planes, the thinning over sub-fields with kThinningParallel. With
+    num_threads > 1 they run on a pool of workers owned by the instance, as in HamiltonJacobiSkeleton.
+    */
+    HamiltonJacobiSkeleton3D(float gamma, int num_threads = 0)
+        : gamma_(gamma), num_threads_(num_threads), medial_structure_(kMedialSurface), thinning_mode_(kThinningSerial),
+          thinning_flux_band_(kDefaultThinningFluxBand)
+    {
+        setNumThreads(num_threads);
+    };
+
+    /*
+    mask_volume: nonzero on the shape. outputs: kOutputSkeleton, kOutputDistanceTransform and kOutputFlux flags.
+    Leave one background voxel around the shape: the voxels on the volume border are never thinned.
+    */
+    void compute(const Volume<uint8_t> &mask_volume, int outputs = kOutputSkeleton | kOutputDistanceTransform | kOutputFlux)
+    {
+        result_ = process(mask_volume, outputs);
+    }
+
+    SkeletonResult3D process(const Volume<uint8_t> &mask_volume, int outputs = kOutputSkeleton | kOutputDistanceTransform | kOutputFlux) const
+    {
+        ThreadPool::Scope pool_scope(thread_pool_.get());
+        std::shared_ptr<Volume<float>> D(new Volume<float>());
+        distanceTransform3D(mask_volume, *D, num_threads_);
+
+        std::shared_ptr<Volume<float>> F(new Volume<float>());
+        float F_min = flux3D(*D, mask_volume, *F, num_threads_);
+
+        SkeletonResult3D result;
+        if (outputs & kOutputSkeleton)
+        {
+            /* the distance transform is not needed by the thinning */
+            if (!(outputs & kOutputDistanceTransform))
+                D.reset();
+            HomotopyPreservingThinning3D thinning(F_min / gamma_, medial_structure_);
+            thinning.setVolumes(mask_volume, *F);
+            if (thinning_mode_ == kThinningParallel)
+                thinning.setBatchRemoval(thinning_flux_band_, num_threads_);
+            thinning.compute();
+            result.skeleton = std::make_shared<Volume<uint8_t>>(thinning.getSkeletonVolume());
+        }
+        if (outputs & kOutputDistanceTransform)
+            result.distance_transform = D;
+        if (outputs & kOutputFlux)
+            result.flux = F;
+        return result;
+    }
+
+    void setParameters(float gamma) { gamma_ = gamma; }
+
+    float getGamma() const { return gamma_; }
+
+    void setNumThreads(int num_threads)
+    {
+        num_threads_ = num_threads;
+        thread_pool_.reset(num_threads > 1 ? new ThreadPool(num_threads) : nullptr);
+    }
+
+    int getNumThreads() const { return num_threads_; }
+
+    void setMedialStructure(MedialStructure medial_structure) { medial_structure_ = medial_structure; }
+
+    MedialStructure getMedialStructure() const { return medial_structure_; }
+
+    /*
+    As HamiltonJacobiSkeleton::setThinningMode(). The flux is that of the gradient itself, not of a Sobel gradient,
+    so its values are about 8 times smaller than in 2D, and so is the default band.
+    */
+    void setThinningMode(ThinningMode thinning_mode, float flux_band = kDefaultThinningFluxBand)
+    {
+        thinning_mode_ = thinning_mode;
+        thinning_flux_band_ = flux_band;
+    }
+
+    ThinningMode getThinningMode() const { return thinning_mode_; }
+
+    float getThinningFluxBand() const { return thinning_flux_band_; }
+
+    /* the result volumes of the last compute(), shared (no copy); nullptr if not requested */
+    std::shared_ptr<const Volume<uint8_t>> getSkeletonVolume() const { return result_.skeleton; }
+
+    std::shared_ptr<const Volume<float>> getDistanceTransformVolume() const { return result_.distance_transform; }
+
+    std::shared_ptr<const Volume<float>> getFluxVolume() const { return result_.flux; }
+
+    static constexpr float kDefaultThinningFluxBand = 0.0125f;
+
+private:
+    SkeletonResult3D result_;
+
+    float gamma_;
+    int num_threads_;
+    std::shared_ptr<ThreadPool> thread_pool_;
+    MedialStructure medial_structure_;
+    ThinningMode thinning_mode_;
+    float thinning_flux_band_;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef PYHJS_INCLUDE_MEMORY_TRACKER_H_
+#define PYHJS_INCLUDE_MEMORY_TRACKER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* cv::Mat bytes of one stage of compute() */
+struct MemoryStage {
+    std::string name;
+    int64_t peak_bytes;  // largest amount held at once during the stage
+    int64_t live_bytes;  // held at the end of the stage
+};
+
+struct MemoryReport {
+    MemoryReport() : peak_bytes(0), estimated_bytes(0), budget_bytes(0), strategies(0){};
+
+    int64_t peak_bytes;       // measured, 0 unless memory tracking is enabled
+    int64_t estimated_bytes;  // estimate the strategies were chosen with
+    int64_t budget_bytes;     // 0: no budget
+    int strategies;           // MemoryStrategy flags applied
+    std::vector<MemoryStage> stages;
+};
+
+/*
+Counts the bytes of the cv::Mat buffers allocated while the tracker is current: on the thread that created it
+and on the parallelFor() workers started from that thread. A buffer is credited back when it is released,
+even after the tracker is gone; buffers allocated before the tracker existed are not counted.
+
+The first tracker installs a counting allocator as OpenCV's default allocator for the rest of the process.
+It allocates like the standard one and only counts while a tracker is current.
+Scratch buffers allocated inside OpenCV's own worker threads are not counted.
+*/
+class MemoryTracker {
+   public:
+    struct Counters {
+        Counters() : live(0), peak(0), stage_peak(0){};
+        std::atomic<int64_t> live, peak, stage_peak;
+    };
+
+    /* makes tracker (may be null) current on the calling thread until the scope ends */
+    class Scope {
+       public:
+        explicit Scope(MemoryTracker *tracker);
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+       private:
+        MemoryTracker *previous_;
+    };
+
+    MemoryTracker();
+    ~MemoryTracker();
+    MemoryTracker(const MemoryTracker &) = delete;
+    MemoryTracker &operator=(const MemoryTracker &) = delete;
+
+    /* closes the current stage, if any, and opens the next one */
+    void beginStage(const std::string &name);
+
+    /* closes the current stage; peak_bytes and stages of report are filled in */
+    void finish(MemoryReport &report);
+
+    int64_t getLiveBytes() const { return counters_->live; }
+
+    const std::shared_ptr<Counters> &getCounters() const { return counters_; }
+
+    static MemoryTracker *current();
+
+   private:
+    void closeStage();
+
+    std::shared_ptr<Counters> counters_;
+    std::vector<MemoryStage> stages_;
+    bool stage_open_;
+    Scope scope_;
+};
+
+#endif
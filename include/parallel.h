@@ -0,0 +1,61 @@
+#ifndef PYHJS_INCLUDE_PARALLEL_H_
+#define PYHJS_INCLUDE_PARALLEL_H_
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <thread>
+#include <vector>
+
+/*
+Persistent workers for parallelFor(): a pool of num_threads - 1 threads, the calling thread being the last one.
+Each run() is a job whose tasks are pulled by the caller and by up to max_helpers idle workers; the caller never
+waits for a task nobody has started, so several threads can run jobs at once and a task can run a nested job
+without deadlocking. Owned by a skeletonizer instance so that its budget is not shared with other instances.
+*/
+class ThreadPool {
+   public:
+    /* makes pool (may be null) the one parallelFor() uses on the calling thread until the scope ends */
+    class Scope {
+       public:
+        explicit Scope(ThreadPool *pool);
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+       private:
+        ThreadPool *previous_;
+    };
+
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /* threads a job can use, the caller included */
+    int size() const { return static_cast<int>(workers_.size()) + 1; }
+
+    /* task(0) ... task(num_tasks - 1) on the caller and at most max_helpers workers; rethrows the first exception */
+    void run(int32_t num_tasks, const std::function<void(int32_t)> &task, int max_helpers);
+
+    static ThreadPool *current();
+
+   private:
+    struct Job;
+
+    void workerLoop();
+    Job *findJob();
+    void work(Job *job);
+
+    std::vector<std::thread> workers_;
+    std::vector<Job *> jobs_;
+    std::mutex mutex_;
+    std::condition_variable job_posted_, helper_done_;
+    bool stopping_;
+};
+
+void parallelFor(const cv::Range &range, const std::function<void(const cv::Range &)> &body, int num_threads = 0, double nstripes = -1.);
+
+#endif
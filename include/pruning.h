@@ -1,183 +1,532 @@
 #ifndef PYHJS_INCLUDE_HOMOTOPY_PRUNING_H_
 #define PYHJS_INCLUDE_HOMOTOPY_PRUNING_H_
 
+#include <algorithm>
+#include <functional>
+#include <numeric>
 #include <opencv2/opencv.hpp>
+#include <queue>
+#include <utility>
+#include <vector>
 
+#include "parallel.h"
 
-class InscribedCircle {
+/*
+Inscribed circles centered on the skeleton pixels, held as a structure of arrays
+*/
+struct InscribedCircles {
+    std::vector<int32_t> center_x, center_y;
+    std::vector<float> radius;
+    std::vector<float> arc_angle;  // [rad], 0 if less than two touching points are found
+    std::vector<cv::Point> touching_point_a, touching_point_b;
+    std::vector<uint8_t> is_sprious;
+
+    void resize(const size_t& num_circles) {
+        center_x.resize(num_circles);
+        center_y.resize(num_circles);
+        radius.resize(num_circles);
+        arc_angle.assign(num_circles, 0);
+        touching_point_a.resize(num_circles);
+        touching_point_b.resize(num_circles);
+        is_sprious.assign(num_circles, 1);
+    }
+
+    size_t size() const { return center_x.size(); }
+
+    /* arc angle pruning: a circle is spurious unless it spans at least threshold_angle [deg] */
+    bool isSpurious(const size_t& index, const float& threshold_angle) const { return !(arc_angle[index] / M_PI * 180 >= threshold_angle); }
+
+    /* re-threshold every circle in one pass; the arc angles are kept */
+    void applyThreshold(const float& threshold_angle) {
+        for (size_t index = 0; index < size(); index++) is_sprious[index] = isSpurious(index, threshold_angle);
+    }
+};
+
+/*
+Scratch buffers of the touching point search, reused over the circles of a parallel stripe
+*/
+struct TouchingPointWorkspace {
+    std::vector<cv::Point> points;
+    std::vector<float> unit_x, unit_y;
+    std::vector<double> polar_angle;
+    std::vector<int32_t> order;
+};
+
+class PruningSkeleton {
    public:
-    InscribedCircle(const int32_t& center_x, const int32_t& center_y, const float& radius)
-        : m_center_x_(center_x), m_center_y_(center_y), m_is_sprious_(true) {
-        m_radius_ = std::max(static_cast<int32_t>(radius), 1);
-    };
+    PruningSkeleton(const float& threshold_angle_inscribed_arc, const int& num_threads = 0)
+        : m_threshold_angle_inscribed_arc_(threshold_angle_inscribed_arc), m_num_threads_(num_threads){};
 
     /*
-    Search 2-boundary points touching inscribed circles
+    feature_image: raster index of the nearest boundary (zero) pixel, see distanceTransformExact()
     */
-    void searchTouchingPoints(const cv::Mat& contour_mask, int32_t margin = 3) {
-        int32_t image_width = contour_mask.cols;
-        int32_t image_height = contour_mask.rows;
+    void setImages(const cv::Mat& skeleton_image, const cv::Mat& distance_transform_image, const cv::Mat& feature_image) {
+        m_skeleton_image_ = skeleton_image;
+        m_distance_transform_image_ = distance_transform_image;
+        m_feature_image_ = feature_image;
+    }
 
-        int32_t search_roi_start_x = std::max(m_center_x_ - m_radius_ - margin, 0);
-        int32_t search_roi_start_y = std::max(m_center_y_ - m_radius_ - margin, 0);
-        int32_t search_roi_end_x = std::min(m_center_x_ + m_radius_ + margin, image_width - 1);
-        int32_t search_roi_end_y = std::min(m_center_y_ + m_radius_ + margin, image_height - 1);
+    void setInscribedCircles() {
+        CV_Assert(m_skeleton_image_.type() == CV_8UC1);
+        CV_Assert(m_distance_transform_image_.type() == CV_32F);
+        CV_Assert(m_feature_image_.type() == CV_32S);
+        int32_t image_width = m_skeleton_image_.cols;
+        int32_t image_height = m_skeleton_image_.rows;
 
-        /// get touching point candidate
-        std::vector<cv::Point> touching_point_list;
-        for (int32_t y = search_roi_start_y; y < search_roi_end_y; y++) {
-            for (int32_t x = search_roi_start_x; x < search_roi_end_x; x++) {
-                if (contour_mask.at<float>(y, x) == 0) continue;
-                float dist_to_point = std::sqrt((x - m_center_x_) * (x - m_center_x_) + (y - m_center_y_) * (y - m_center_y_));
-                if (dist_to_point < m_radius_) continue;
-                float radial_diff = std::abs(dist_to_point - float(m_radius_));
-                if (radial_diff <= 1.414 * (1 + margin)) touching_point_list.push_back(cv::Point(x, y));
-            }
-        }
+        /// Count medial axis pixels per row, then set inscribed circles at the row offsets
+        std::vector<int32_t> row_offsets(image_height + 1, 0);
+        parallelFor(
+            cv::Range(1, std::max(image_height - 1, 1)),
+            [&](const cv::Range& range) {
+                for (int32_t y = range.start; y < range.end; y++) {
+                    const uchar* skeleton_row = m_skeleton_image_.ptr<uchar>(y);
+                    int32_t num_circles_row = 0;
+                    for (int32_t x = 1; x < image_width - 1; x++) num_circles_row += skeleton_row[x] != 0;
+                    row_offsets[y + 1] = num_circles_row;
+                }
+            },
+            m_num_threads_);
+        std::partial_sum(row_offsets.begin(), row_offsets.end(), row_offsets.begin());
+        m_inscribed_circles_.resize(row_offsets[image_height]);
 
-        if (touching_point_list.size() < 2) return;
+        parallelFor(
+            cv::Range(1, std::max(image_height - 1, 1)),
+            [&](const cv::Range& range) {
+                for (int32_t y = range.start; y < range.end; y++) {
+                    const uchar* skeleton_row = m_skeleton_image_.ptr<uchar>(y);
+                    const float* distance_row = m_distance_transform_image_.ptr<float>(y);
+                    int32_t index = row_offsets[y];
+                    for (int32_t x = 1; x < image_width - 1; x++) {
+                        if (skeleton_row[x] == 0) continue;
+                        m_inscribed_circles_.center_x[index] = x;
+                        m_inscribed_circles_.center_y[index] = y;
+                        m_inscribed_circles_.radius[index] = distance_row[x];
+                        index++;
+                    }
+                }
+            },
+            m_num_threads_);
 
-        float max_arc_angle_point_pair = -1.0;
-        std::pair<int32_t, int32_t> argmax_arc_angle_point_pair(-1, -1);
-        int32_t n_point_candidate = touching_point_list.size();
-
-        for (int32_t candidate_index = 0; candidate_index < n_point_candidate; candidate_index++) {
-            for (int32_t candidate_index_compare = 0; candidate_index_compare < n_point_candidate; candidate_index_compare++) {
-                if (candidate_index <= candidate_index_compare) continue;
-                cv::Point point_a = touching_point_list[candidate_index];
-                cv::Point point_b = touching_point_list[candidate_index_compare];
-
-                std::vector<float> vector_center_to_a{float(point_a.x - m_center_x_), float(point_a.y - m_center_y_)};
-                float vector_center_to_a_norm =
-                    std::sqrt(vector_center_to_a[0] * vector_center_to_a[0] + vector_center_to_a[1] * vector_center_to_a[1]);
-                vector_center_to_a[0] /= vector_center_to_a_norm;
-                vector_center_to_a[1] /= vector_center_to_a_norm;
-                std::vector<float> vector_center_to_b{float(point_b.x - m_center_x_), float(point_b.y - m_center_y_)};
-                float vector_center_to_b_norm =
-                    std::sqrt(vector_center_to_b[0] * vector_center_to_b[0] + vector_center_to_b[1] * vector_center_to_b[1]);
-                vector_center_to_b[0] /= vector_center_to_b_norm;
-                vector_center_to_b[1] /= vector_center_to_b_norm;
-
-                float arc_angle = std::abs(std::acos(vector_center_to_a[0] * vector_center_to_b[0] + vector_center_to_a[1] * vector_center_to_b[1]));
-
-                if (max_arc_angle_point_pair <= arc_angle) {
-                    argmax_arc_angle_point_pair = std::pair<int32_t, int32_t>{candidate_index, candidate_index_compare};
-                    max_arc_angle_point_pair = arc_angle;
+        /// Circles are independent; small stripes let the pool balance the load
+        int32_t num_circles = static_cast<int32_t>(m_inscribed_circles_.size());
+        const int32_t num_circles_per_stripe = 32;
+        parallelFor(
+            cv::Range(0, num_circles),
+            [&](const cv::Range& range) {
+                TouchingPointWorkspace workspace;
+                for (int32_t index = range.start; index < range.end; index++) {
+                    searchTouchingPoints(index, workspace);
+                    m_inscribed_circles_.is_sprious[index] = m_inscribed_circles_.isSpurious(index, m_threshold_angle_inscribed_arc_);
                 }
-            }
-        }
+            },
+            m_num_threads_, std::max(1.0, double(num_circles) / num_circles_per_stripe));
+    }
 
-        boundary_point_touch_inscribed_circle_a = touching_point_list[argmax_arc_angle_point_pair.first];
-        boundary_point_touch_inscribed_circle_b = touching_point_list[argmax_arc_angle_point_pair.second];
-        m_arc_angle_inscribed_circle_ = max_arc_angle_point_pair;
+    const InscribedCircles& getInscribedCircles() const { return m_inscribed_circles_; }
 
-        /*
-        std::cout << max_arc_angle_point_pair << " " << m_is_sprious_ << ", (" << m_center_x_ << ", " << m_center_y_ << "), "
-                  << "(" << boundary_point_touch_inscribed_circle_a.x << ", " << boundary_point_touch_inscribed_circle_a.y << "), "
-                  << "(" << boundary_point_touch_inscribed_circle_b.x << ", " << boundary_point_touch_inscribed_circle_b.y << "), " << std::endl;
-        */
-    }
+    /* hands the circles over, e.g. to re-threshold them later without the images */
+    InscribedCircles releaseInscribedCircles() { return std::move(m_inscribed_circles_); }
 
-    void centers(int32_t& center_x, int32_t& center_y) const {
-        center_x = m_center_x_;
-        center_y = m_center_y_;
+    /* circles kept by the arc angle pruning as a skeleton image (CV_8UC1, 1 on the skeleton) */
+    static cv::Mat getPrunedSkeleton(const InscribedCircles& circles, const cv::Size& image_size) {
+        cv::Mat skeleton_image_pruned = cv::Mat::zeros(image_size, CV_8UC1);
+        for (size_t index = 0; index < circles.size(); index++) {
+            if (circles.is_sprious[index]) continue;
+            skeleton_image_pruned.at<uchar>(circles.center_y[index], circles.center_x[index]) = 1;
+        }
+        return skeleton_image_pruned;
     }
 
-    void set_spriousness(const bool& spriousness) 
-    {
-        m_is_sprious_ = spriousness;
+    /* arc angle [rad] of the circles at the skeleton pixels before pruning (CV_32F, 0 elsewhere) */
+    static cv::Mat getArcAngleImage(const InscribedCircles& circles, const cv::Size& image_size) {
+        cv::Mat arc_angle_image = cv::Mat::zeros(image_size, CV_32F);
+        for (size_t index = 0; index < circles.size(); index++)
+            arc_angle_image.at<float>(circles.center_y[index], circles.center_x[index]) = circles.arc_angle[index];
+        return arc_angle_image;
     }
 
-    bool is_sprious() const { return m_is_sprious_; }
-
     /*
-    float bending_potential_ratio() const {
-        float m_center_x_f = static_cast<float>(m_center_x_);
-        float m_center_y_f = static_cast<float>(m_center_y_);
-        float bax_f = float(boundary_point_touch_inscribed_circle_a.x);
-        float bay_f = float(boundary_point_touch_inscribed_circle_a.y);
-        float bbx_f = float(boundary_point_touch_inscribed_circle_b.x);
-        float bby_f = float(boundary_point_touch_inscribed_circle_b.y);
-        float diff_center2a = std::sqrt((bax_f - m_center_x_f) * (bax_f - m_center_x_f) + (bay_f - m_center_x_f) * (bay_f - m_center_x_f));
-        float diff_center2b = std::sqrt((bbx_f - m_center_x_f) * (bbx_f - m_center_x_f) + (bby_f - m_center_x_f) * (bby_f - m_center_x_f));
-        float diff_a2b = std::sqrt((bax_f - bbx_f) * (bax_f - bbx_f) + (bay_f - bby_f) * (bay_f - bby_f));
-
-        float lab = m_arc_angle_inscribed_circle_ * std::max(diff_center2a, diff_center2a);
-        float hg = 0.5 * std::sqrt(lab * lab - diff_a2b * diff_a2b);
-        float hp = diff_center2a * diff_center2b * std::abs(std::sin(m_arc_angle_inscribed_circle_)) / diff_a2b;
-        // float hp = std::max(diff_center2a, diff_center2b) * std::cos(m_arc_angle_inscribed_circle_ / 2);
-
-        float potential = std::abs(std::tan(m_arc_angle_inscribed_circle_ / 2)) * std::sqrt(std::max(lab * lab / (diff_a2b * diff_a2b) - 1.0, 0.0));
-        return potential;
-    }
+    Find the pair of points spanning the largest angle seen from the center [rad].
+    The points are sorted by polar angle and, for each of them, the partners around the antipodal
+    direction are found with a two-pointer sweep. Partners are visited outwards from the antipode only
+    while they reach the current maximum, so that O(n) pairs are evaluated instead of all n^2 pairs.
+    The angle and tie-breaking (last pair in (index_a > index_b) lexicographic order) are those of the
+    exhaustive search.
     */
+    static float searchMaximalArcPair(const int32_t& center_x, const int32_t& center_y, TouchingPointWorkspace& workspace, int32_t& index_a,
+                                      int32_t& index_b) {
+        const std::vector<cv::Point>& points = workspace.points;
+        int32_t n_point = static_cast<int32_t>(points.size());
+        std::vector<float>& unit_x = workspace.unit_x;
+        std::vector<float>& unit_y = workspace.unit_y;
+        std::vector<double>& polar_angle = workspace.polar_angle;
+        std::vector<int32_t>& order = workspace.order;
+        unit_x.resize(n_point);
+        unit_y.resize(n_point);
+        polar_angle.resize(n_point);
+        order.resize(n_point);
+        for (int32_t k = 0; k < n_point; k++) {
+            float vx = float(points[k].x - center_x);
+            float vy = float(points[k].y - center_y);
+            float norm = std::sqrt(vx * vx + vy * vy);
+            unit_x[k] = vx / norm;
+            unit_y[k] = vy / norm;
+            polar_angle[k] = std::atan2(double(vy), double(vx));
+            order[k] = k;
+        }
+        std::sort(order.begin(), order.end(), [&](const int32_t& a, const int32_t& b) { return polar_angle[a] < polar_angle[b]; });
+
+        /// polar angle of the k-th sorted point, unrolled over two turns
+        auto unrolled_angle = [&](const int32_t& k) { return polar_angle[order[k % n_point]] + (k < n_point ? 0 : 2 * M_PI); };
+
+        /// exact test on the integer offsets, unit vectors of collinear points may differ in the last bit
+        auto same_direction = [&](const int32_t& k, const int32_t& m) {
+            const cv::Point& p = points[order[k % n_point]];
+            const cv::Point& q = points[order[m % n_point]];
+            int32_t px = p.x - center_x, py = p.y - center_y, qx = q.x - center_x, qy = q.y - center_y;
+            return px * qy - py * qx == 0 && px * qx + py * qy > 0;
+        };
+
+        float max_arc_angle = -1.0;
+        index_a = -1;
+        index_b = -1;
+        /// returns true if the pair reaches the current maximum
+        auto evaluate = [&](const int32_t& i, const int32_t& k) {
+            int32_t a = std::max(order[i], order[k % n_point]), b = std::min(order[i], order[k % n_point]);
+            float arc_angle = std::abs(std::acos(unit_x[a] * unit_x[b] + unit_y[a] * unit_y[b]));
+            if (!(max_arc_angle <= arc_angle)) return false;
+            if (max_arc_angle < arc_angle || std::make_pair(a, b) > std::make_pair(index_a, index_b)) {
+                max_arc_angle = arc_angle;
+                index_a = a;
+                index_b = b;
+            }
+            return true;
+        };
 
+        int32_t j = 0;
+        for (int32_t i = 0; i < n_point; i++) {
+            /// j: last point at most half a turn ahead of i
+            j = std::max(j, i);
+            while (j + 1 < i + n_point && unrolled_angle(j + 1) - unrolled_angle(i) <= M_PI) j++;
+            for (int32_t k = j; k > i; k--) {
+                if (!evaluate(i, k) && !(k - 1 > i && same_direction(k, k - 1))) break;
+            }
+            for (int32_t k = j + 1; k < i + n_point; k++) {
+                if (!evaluate(i, k) && !(k + 1 < i + n_point && same_direction(k, k + 1))) break;
+            }
+        }
+        return max_arc_angle;
+    }
+
+   private:
     /*
-    the unit of return value is degree
+    Search 2-boundary points touching the inscribed circle.
+    The candidates are the nearest boundary points of the center and of its 8 neighbors, read from the feature transform.
     */
-    float arc_angle_inscribed_points() const { return m_arc_angle_inscribed_circle_ / M_PI * 180; }
+    void searchTouchingPoints(const int32_t& index, TouchingPointWorkspace& workspace) {
+        int32_t image_width = m_feature_image_.cols;
+        int32_t center_x = m_inscribed_circles_.center_x[index];
+        int32_t center_y = m_inscribed_circles_.center_y[index];
+
+        /// get touching point candidate
+        std::vector<cv::Point>& touching_point_list = workspace.points;
+        touching_point_list.clear();
+        for (int32_t ky = -1; ky <= 1; ky++) {
+            for (int32_t kx = -1; kx <= 1; kx++) {
+                int32_t feature_index = m_feature_image_.at<int32_t>(center_y + ky, center_x + kx);
+                if (feature_index < 0) continue;
+                cv::Point touching_point(feature_index % image_width, feature_index / image_width);
+                if (touching_point.x == center_x && touching_point.y == center_y) continue;
+                if (std::find(touching_point_list.begin(), touching_point_list.end(), touching_point) == touching_point_list.end())
+                    touching_point_list.push_back(touching_point);
+            }
+        }
+
+        if (touching_point_list.size() < 2) return;
+
+        int32_t argmax_index_a, argmax_index_b;
+        m_inscribed_circles_.arc_angle[index] = searchMaximalArcPair(center_x, center_y, workspace, argmax_index_a, argmax_index_b);
+        m_inscribed_circles_.touching_point_a[index] = touching_point_list[argmax_index_a];
+        m_inscribed_circles_.touching_point_b[index] = touching_point_list[argmax_index_b];
+    }
+
+    cv::Mat m_skeleton_image_;
+    cv::Mat m_distance_transform_image_;
+    cv::Mat m_feature_image_;
+
+    InscribedCircles m_inscribed_circles_;
+    float m_threshold_angle_inscribed_arc_;
+    int m_num_threads_;
+};
+
+/*
+Union-find over skeleton pixel indices (path halving + union by size)
+*/
+class DisjointSet {
+   public:
+    DisjointSet(const int32_t& num_elements) : m_parent_(num_elements), m_size_(num_elements, 1) {
+        std::iota(m_parent_.begin(), m_parent_.end(), 0);
+    }
+
+    int32_t find(int32_t index) {
+        while (m_parent_[index] != index) {
+            m_parent_[index] = m_parent_[m_parent_[index]];
+            index = m_parent_[index];
+        }
+        return index;
+    }
+
+    /// returns the root of the merged set
+    int32_t unite(int32_t index_a, int32_t index_b) {
+        int32_t root_a = find(index_a);
+        int32_t root_b = find(index_b);
+        if (root_a == root_b) return root_a;
+        if (m_size_[root_a] < m_size_[root_b]) std::swap(root_a, root_b);
+        m_parent_[root_b] = root_a;
+        m_size_[root_a] += m_size_[root_b];
+        return root_a;
+    }
 
    private:
-    int32_t m_center_x_, m_center_y_;
-    int32_t m_radius_;
-    float m_arc_angle_inscribed_circle_;
-    cv::Point boundary_point_touch_inscribed_circle_a;
-    cv::Point boundary_point_touch_inscribed_circle_b;
-    bool m_is_sprious_;
+    std::vector<int32_t> m_parent_;
+    std::vector<int32_t> m_size_;
 };
 
-class PruningSkeleton {
+/*
+Remove terminal skeleton branches (spurs) by length, flux salience or radius ratio.
+The skeleton is decomposed into branches and junction clusters with a single union-find pass,
+then terminal branches are peeled shortest-first. When a junction is left with two branches,
+they are merged into one so that the peeling can proceed iteratively.
+*/
+class BranchPruning {
    public:
-    PruningSkeleton(const float& threshold_angle_inscribed_arc) : m_threshold_angle_inscribed_arc_(threshold_angle_inscribed_arc){};
+    BranchPruning(const float& threshold_branch_length, const float& threshold_branch_salience, const float& threshold_branch_radius_ratio)
+        : m_threshold_branch_length_(threshold_branch_length),
+          m_threshold_branch_salience_(threshold_branch_salience),
+          m_threshold_branch_radius_ratio_(threshold_branch_radius_ratio){};
 
-    void setImages(const cv::Mat& skeleton_image, const cv::Mat& distance_transform_image, const cv::Mat& contour_mask) {
-        m_skeleton_image_ = skeleton_image.clone();
-        m_distance_transform_image_ = distance_transform_image.clone();
-        m_contour_mask_ = contour_mask.clone();
+    void setImages(const cv::Mat& skeleton_image, const cv::Mat& distance_transform_image, const cv::Mat& flux_image) {
+        m_skeleton_image_ = skeleton_image;
+        m_distance_transform_image_ = distance_transform_image;
+        m_flux_image_ = flux_image;
     }
 
-    void setInscribedCircles() {
-        CV_Assert(m_skeleton_image_.type() == CV_32F);
+    void compute() {
+        CV_Assert(m_skeleton_image_.type() == CV_8UC1);
         CV_Assert(m_distance_transform_image_.type() == CV_32F);
+        CV_Assert(m_flux_image_.type() == CV_32F);
+        decomposeBranches();
+
+        int32_t num_points = static_cast<int32_t>(m_points_.size());
+        for (int32_t index = 0; index < num_points; index++) {
+            if (m_disjoint_set_.find(index) != index) continue;
+            if (m_is_junction_[index]) {
+                if (countLiveBranches(index) <= 2) m_junction_queue_.push_back(index);
+            } else {
+                pushIfTerminal(index);
+            }
+        }
+
+        while (!m_junction_queue_.empty() || !m_terminal_queue_.empty()) {
+            if (!m_junction_queue_.empty()) {
+                int32_t junction = m_junction_queue_.back();
+                m_junction_queue_.pop_back();
+                collapseJunction(junction);
+                continue;
+            }
+
+            int32_t branch = m_terminal_queue_.top().second;
+            float branch_length = m_terminal_queue_.top().first;
+            m_terminal_queue_.pop();
+            if (m_disjoint_set_.find(branch) != branch || m_is_removed_[branch] || m_length_[branch] != branch_length) continue;
+
+            int32_t junction = terminalJunction(branch);
+            if (junction < 0) continue;
+
+            bool is_spurious = m_length_[branch] < m_threshold_branch_length_ || m_salience_[branch] < m_threshold_branch_salience_ ||
+                               m_length_[branch] < m_threshold_branch_radius_ratio_ * m_radius_[junction];
+            if (!is_spurious) continue;
+
+            m_is_removed_[branch] = true;
+            if (countLiveBranches(junction) <= 2) m_junction_queue_.push_back(junction);
+        }
+    }
+
+    cv::Mat getPrunedSkeleton() {
+        cv::Mat skeleton_image_pruned = cv::Mat::zeros(cv::Size(m_skeleton_image_.cols, m_skeleton_image_.rows), CV_8UC1);
+        for (size_t index = 0; index < m_points_.size(); index++) {
+            if (m_is_removed_[m_disjoint_set_.find(index)]) continue;
+            skeleton_image_pruned.at<uchar>(m_points_[index].y, m_points_[index].x) = 1;
+        }
+        return skeleton_image_pruned;
+    }
+
+   private:
+    typedef std::pair<float, int32_t> BranchEntry;
+
+    void decomposeBranches() {
         int32_t image_width = m_skeleton_image_.cols;
         int32_t image_height = m_skeleton_image_.rows;
 
-        /// Set inscribed circles on medial axis
+        /// index skeleton pixels in raster order
+        m_points_.clear();
+        m_index_image_ = cv::Mat(cv::Size(image_width, image_height), CV_32S, cv::Scalar(-1));
         for (int32_t y = 1; y < image_height - 1; y++) {
             for (int32_t x = 1; x < image_width - 1; x++) {
-                if (m_skeleton_image_.at<float>(y, x) > 0)
-                    m_inscribed_circles_.push_back(InscribedCircle(x, y, m_distance_transform_image_.at<float>(y, x)));
+                if (m_skeleton_image_.at<uchar>(y, x) == 0) continue;
+                m_index_image_.at<int32_t>(y, x) = static_cast<int32_t>(m_points_.size());
+                m_points_.push_back(cv::Point(x, y));
             }
         }
 
-        for (auto it_inscribed_circle = m_inscribed_circles_.begin(); it_inscribed_circle != m_inscribed_circles_.end(); ++it_inscribed_circle) {
-            it_inscribed_circle->searchTouchingPoints(m_contour_mask_);
-            if(it_inscribed_circle->arc_angle_inscribed_points() >= m_threshold_angle_inscribed_arc_)
-                it_inscribed_circle->set_spriousness(false);
+        int32_t num_points = static_cast<int32_t>(m_points_.size());
+        m_disjoint_set_ = DisjointSet(num_points);
+        m_is_junction_.assign(num_points, false);
+        m_is_removed_.assign(num_points, false);
+        m_has_end_point_.assign(num_points, false);
+        m_length_.assign(num_points, 0);
+        m_salience_.assign(num_points, 0);
+        m_radius_.assign(num_points, 0);
+        m_adjacency_.assign(num_points, std::vector<int32_t>());
+
+        std::vector<int32_t> degree(num_points, 0);
+        for (int32_t index = 0; index < num_points; index++) {
+            forEachNeighbor(index, [&](int32_t) { degree[index]++; });
+            m_is_junction_[index] = degree[index] > 2;
+        }
+
+        /// one raster pass: connect each pixel to its already visited neighbors of the same kind
+        for (int32_t index = 0; index < num_points; index++) {
+            const cv::Point& point = m_points_[index];
+            const int32_t kx_list[4] = {-1, -1, 0, 1};
+            const int32_t ky_list[4] = {0, -1, -1, -1};
+            for (int32_t k = 0; k < 4; k++) {
+                int32_t neighbor = m_index_image_.at<int32_t>(point.y + ky_list[k], point.x + kx_list[k]);
+                if (neighbor >= 0 && m_is_junction_[neighbor] == m_is_junction_[index]) m_disjoint_set_.unite(index, neighbor);
+            }
+        }
+
+        /// accumulate per-component statistics on the roots
+        for (int32_t index = 0; index < num_points; index++) {
+            int32_t root = m_disjoint_set_.find(index);
+            const cv::Point& point = m_points_[index];
+            m_length_[root] += 1;
+            m_salience_[root] += std::abs(m_flux_image_.at<float>(point.y, point.x));
+            m_radius_[root] = std::max(m_radius_[root], m_distance_transform_image_.at<float>(point.y, point.x));
+            if (m_is_junction_[index]) continue;
+            if (degree[index] <= 1) m_has_end_point_[root] = true;
+            forEachNeighbor(index, [&](int32_t neighbor) {
+                if (!m_is_junction_[neighbor]) return;
+                int32_t junction = m_disjoint_set_.find(neighbor);
+                addUnique(m_adjacency_[root], junction);
+                addUnique(m_adjacency_[junction], root);
+            });
         }
     }
 
-    cv::Mat getPrunedSkeleton() {
-        cv::Mat skeleton_image_pruned = cv::Mat::zeros(cv::Size(m_skeleton_image_.cols, m_skeleton_image_.rows), CV_32F);
-        for (auto it_inscribed_circle = m_inscribed_circles_.begin(); it_inscribed_circle != m_inscribed_circles_.end(); ++it_inscribed_circle) {
-            int32_t center_x, center_y;
-            it_inscribed_circle->centers(center_x, center_y);
-            if (it_inscribed_circle->is_sprious()) {
-                skeleton_image_pruned.at<float>(center_y, center_x) = 0;
-            } else {
-                skeleton_image_pruned.at<float>(center_y, center_x) = 1.0;
+    template <typename Function>
+    void forEachNeighbor(const int32_t& index, Function function) {
+        const cv::Point& point = m_points_[index];
+        for (int32_t ky = -1; ky <= 1; ky++) {
+            for (int32_t kx = -1; kx <= 1; kx++) {
+                if (kx == 0 && ky == 0) continue;
+                int32_t neighbor = m_index_image_.at<int32_t>(point.y + ky, point.x + kx);
+                if (neighbor >= 0) function(neighbor);
             }
         }
-        return skeleton_image_pruned;
     }
 
-   private:
+    static void addUnique(std::vector<int32_t>& list, const int32_t& value) {
+        if (std::find(list.begin(), list.end(), value) == list.end()) list.push_back(value);
+    }
+
+    /// current roots of the branches (junctions) adjacent to a junction (branch), stale entries resolved
+    std::vector<int32_t> liveNeighbors(const int32_t& root) {
+        std::vector<int32_t> neighbors;
+        for (int32_t neighbor : m_adjacency_[root]) {
+            int32_t neighbor_root = m_disjoint_set_.find(neighbor);
+            if (neighbor_root == root || m_is_removed_[neighbor_root]) continue;
+            if (m_is_junction_[root] == m_is_junction_[neighbor_root]) continue;
+            addUnique(neighbors, neighbor_root);
+        }
+        return neighbors;
+    }
+
+    /// number of branch ends meeting at a junction (a loop closing on the junction counts twice)
+    int32_t countLiveBranches(const int32_t& junction) {
+        int32_t num_branch_ends = 0;
+        for (int32_t branch : liveNeighbors(junction)) {
+            bool is_loop = !m_has_end_point_[branch] && liveNeighbors(branch).size() == 1;
+            num_branch_ends += is_loop ? 2 : 1;
+        }
+        return num_branch_ends;
+    }
+
+    /// junction root of a terminal branch, or -1 if the branch is not terminal
+    int32_t terminalJunction(const int32_t& branch) {
+        if (!m_has_end_point_[branch]) return -1;
+        std::vector<int32_t> junctions = liveNeighbors(branch);
+        if (junctions.size() != 1) return -1;
+        return junctions[0];
+    }
+
+    void pushIfTerminal(const int32_t& branch) {
+        if (terminalJunction(branch) >= 0) m_terminal_queue_.push(BranchEntry(m_length_[branch], branch));
+    }
+
+    /// merge a junction with at most two remaining branches into a single branch
+    void collapseJunction(const int32_t& junction) {
+        if (m_disjoint_set_.find(junction) != junction || !m_is_junction_[junction]) return;
+        if (countLiveBranches(junction) > 2) return;
+        std::vector<int32_t> branches = liveNeighbors(junction);
+
+        int32_t root = junction;
+        std::vector<int32_t> adjacency;
+        bool has_end_point = false;
+        float length = m_length_[junction], salience = m_salience_[junction], radius = m_radius_[junction];
+        for (int32_t branch : branches) {
+            for (int32_t neighbor : liveNeighbors(branch)) {
+                if (neighbor != junction) addUnique(adjacency, neighbor);
+            }
+            has_end_point = has_end_point || m_has_end_point_[branch];
+            length += m_length_[branch];
+            salience += m_salience_[branch];
+            radius = std::max(radius, m_radius_[branch]);
+            root = m_disjoint_set_.unite(root, branch);
+        }
+
+        m_is_junction_[root] = false;
+        m_has_end_point_[root] = has_end_point || branches.empty();
+        m_length_[root] = length;
+        m_salience_[root] = salience;
+        m_radius_[root] = radius;
+        m_adjacency_[root] = adjacency;
+
+        /// the merged branch may now reach a neighboring junction twice
+        for (int32_t neighbor : adjacency) {
+            addUnique(m_adjacency_[neighbor], root);
+            if (countLiveBranches(neighbor) <= 2) m_junction_queue_.push_back(neighbor);
+        }
+        pushIfTerminal(root);
+    }
+
+    float m_threshold_branch_length_;
+    float m_threshold_branch_salience_;
+    float m_threshold_branch_radius_ratio_;
+
     cv::Mat m_skeleton_image_;
     cv::Mat m_distance_transform_image_;
-    cv::Mat m_contour_mask_;
+    cv::Mat m_flux_image_;
+    cv::Mat m_index_image_;
 
-    std::vector<InscribedCircle> m_inscribed_circles_;
-    float m_threshold_angle_inscribed_arc_;
+    std::vector<cv::Point> m_points_;
+    DisjointSet m_disjoint_set_ = DisjointSet(0);
+    std::vector<bool> m_is_junction_, m_is_removed_, m_has_end_point_;
+    std::vector<float> m_length_, m_salience_, m_radius_;
+    std::vector<std::vector<int32_t>> m_adjacency_;
+
+    std::vector<int32_t> m_junction_queue_;
+    std::priority_queue<BranchEntry, std::vector<BranchEntry>, std::greater<BranchEntry>> m_terminal_queue_;
 };
 
 #endif
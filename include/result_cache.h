@@ -0,0 +1,91 @@
+#ifndef PYHJS_INCLUDE_RESULT_CACHE_H_
+#define PYHJS_INCLUDE_RESULT_CACHE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "frame.h"
+
+struct SkeletonResult;
+
+/* bump whenever a change of the pipeline changes its results, so that older entries are not served */
+static const uint32_t kResultCacheVersion = 3;
+
+/* 128-bit content hash of a frame and the parameters it is processed with */
+struct CacheKey {
+    uint64_t hash[2];
+
+    std::string toHex() const;
+};
+
+/*
+Streaming 128-bit hash (two 64-bit multiply-rotate lanes over 8 byte words): about one multiplication per byte
+and lane, so hashing a mask costs a small fraction of its skeletonization. Not cryptographic.
+*/
+class CacheKeyHasher {
+   public:
+    CacheKeyHasher();
+
+    void update(const void *data, size_t size);
+
+    /* rows of a 2D image, so a region of a larger image hashes like its continuous copy */
+    void updateImage(const cv::Mat &image);
+
+    CacheKey digest() const;
+
+   private:
+    void mix(uint64_t word);
+
+    uint64_t lanes_[2];
+    uint64_t length_;
+    unsigned char tail_[8];
+    size_t tail_size_;
+};
+
+/*
+Persistent cache of skeletonization results in a directory, one file per entry named after its key.
+The skeleton is stored as its run-length encoding; distance transform, flux, arc angle images, the skeleton
+points and the descriptors as raw arrays. A hit maps the entry and copies it out, so it costs about a memcpy of the requested outputs.
+
+Entries are written to a temporary file, synced and renamed into place, so readers never see a partial entry, even
+after a crash; an entry is never modified afterwards. Several threads and processes can share a directory. When the entries exceed max_bytes,
+the least recently used ones (by modification time, refreshed on every hit) are removed down to 90% of max_bytes,
+by one process at a time.
+*/
+class ResultCache {
+   public:
+    /* directory is created if missing; max_bytes: total size of the entries kept, 0: unbounded */
+    explicit ResultCache(const std::string &directory, int64_t max_bytes = 0);
+    ~ResultCache();
+    ResultCache(const ResultCache &) = delete;
+    ResultCache &operator=(const ResultCache &) = delete;
+
+    /* fills result with the outputs of the entry of key; false (and result untouched) on a miss */
+    bool load(const CacheKey &key, int outputs, const BinaryFrame &frame, SkeletonResult &result);
+
+    /* stores the requested outputs of result; failures (full disk, permissions) only skip the entry */
+    void store(const CacheKey &key, int outputs, const BinaryFrame &frame, const SkeletonResult &result);
+
+    const std::string &getDirectory() const { return directory_; }
+
+    int64_t getMaxBytes() const { return max_bytes_; }
+
+    int64_t getNumHits() const { return num_hits_; }
+
+    int64_t getNumMisses() const { return num_misses_; }
+
+   private:
+    std::string entryPath(const CacheKey &key) const;
+
+    /* rescans the directory and removes the least recently used entries */
+    void evict();
+
+    std::string directory_;
+    int64_t max_bytes_;
+    std::atomic<int64_t> total_bytes_;  // of this process' last scan plus its own stores since
+    std::atomic<int64_t> num_hits_, num_misses_;
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef PYHJS_INCLUDE_RLE_H_
+#define PYHJS_INCLUDE_RLE_H_
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+/*
+Binary mask in COCO run-length encoding: counts alternate background and foreground run lengths,
+starting with background, over the pixels in column-major order.
+*/
+struct RunLengthMask {
+    int32_t height, width;
+    std::vector<uint32_t> counts;
+
+    RunLengthMask() : height(0), width(0) {}
+    RunLengthMask(const int32_t& height, const int32_t& width, const std::vector<uint32_t>& counts) : height(height), width(width), counts(counts) {}
+};
+
+void decodeRunLengthString(const std::string &counts_string, std::vector<uint32_t> &counts);
+std::string encodeRunLengthString(const std::vector<uint32_t> &counts);
+
+cv::Rect runLengthBoundingBox(const RunLengthMask &mask);
+void decodeRunLength(const RunLengthMask &mask, const cv::Rect &roi, cv::Mat &mask_image);
+void encodeRunLength(const std::vector<int32_t> &x, const std::vector<int32_t> &y, const int32_t &height, const int32_t &width, RunLengthMask &mask);
+
+#endif
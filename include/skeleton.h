@@ -4,7 +4,16 @@
 #include <cmath>
 #include <opencv2/opencv.hpp>
 
-void flux(const cv::Mat &Dx, const cv::Mat &Dy, cv::Mat &F);
+/* outputs of extractBoundary() */
+struct MaskBoundary {
+    std::vector<cv::Point> points;  // boundary pixels in raster order
+    cv::Mat mask;                   // CV_8U, 1 on the boundary pixels; empty unless requested
+    cv::Rect bounding_box;          // of the foreground; empty if there is none
+};
+
+void flux(const cv::Mat &Dx, const cv::Mat &Dy, cv::Mat &F, const cv::Mat &mask = cv::Mat());
+void fluxBanded(const cv::Mat &D, cv::Mat &F, int band_rows, const cv::Mat &mask = cv::Mat());
+void extractBoundary(const cv::Mat &mask_image, MaskBoundary &boundary, int threshold = 0, int num_threads = 0, bool build_mask = false);
 std::vector<cv::Point> getContourPoints(const cv::Mat &mask_image);
 cv::Mat getContourMask(const cv::Mat &mask_image);
 
@@ -0,0 +1,33 @@
+#ifndef PYHJS_INCLUDE_SKELETON3D_H_
+#define PYHJS_INCLUDE_SKELETON3D_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+Dense volume of depth x height x width voxels in (z, y, x) raster order, as a C-contiguous (D, H, W) numpy array.
+*/
+template <typename T>
+struct Volume {
+    int32_t depth, height, width;
+    std::vector<T> data;
+
+    Volume() : depth(0), height(0), width(0) {}
+    Volume(int32_t depth_input, int32_t height_input, int32_t width_input, const T &value = T())
+        : depth(depth_input), height(height_input), width(width_input), data(size_t(depth_input) * height_input * width_input, value) {}
+
+    bool empty() const { return data.empty(); }
+    int64_t size() const { return int64_t(data.size()); }
+    int64_t index(int32_t z, int32_t y, int32_t x) const { return (int64_t(z) * height + y) * width + x; }
+
+    T &at(int32_t z, int32_t y, int32_t x) { return data[index(z, y, x)]; }
+    const T &at(int32_t z, int32_t y, int32_t x) const { return data[index(z, y, x)]; }
+    T *plane(int32_t z) { return data.data() + int64_t(z) * height * width; }
+    const T *plane(int32_t z) const { return data.data() + int64_t(z) * height * width; }
+};
+
+void distanceTransform3D(const Volume<uint8_t> &mask_volume, Volume<float> &distance_volume, int num_threads = 0);
+float flux3D(const Volume<float> &D, const Volume<uint8_t> &mask_volume, Volume<float> &F, int num_threads = 0);
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef PYHJS_INCLUDE_SKELETON_EXECUTOR_H_
+#define PYHJS_INCLUDE_SKELETON_EXECUTOR_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "frame.h"
+#include "hjs.h"
+
+/*
+Runs HamiltonJacobiSkeleton::process() on background worker threads.
+submit() blocks while max_pending frames are queued, running or waiting for delivery, which bounds the memory
+held by the executor. The callback of each frame receives its result, or the exception raised while computing it.
+With ordered = true callbacks are delivered in submission order; a finished frame waits for its predecessors.
+*/
+class SkeletonExecutor
+{
+public:
+    typedef std::function<void(SkeletonResult &, std::exception_ptr)> Callback;
+
+    /*
+    num_workers: number of frames computed concurrently (<= 0: hardware concurrency)
+    max_pending: bound of submitted but undelivered frames (<= 0: twice the number of workers)
+    */
+    SkeletonExecutor(int num_workers = 0, int max_pending = 0, bool ordered = false)
+        : ordered_(ordered), stopping_(false), delivering_(false), num_pending_(0), next_sequence_(0), next_delivery_(0)
+    {
+        if (num_workers <= 0)
+            num_workers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        max_pending_ = (max_pending > 0) ? max_pending : 2 * num_workers;
+        workers_.reserve(num_workers);
+        for (int k = 0; k < num_workers; k++)
+            workers_.emplace_back(&SkeletonExecutor::workerLoop, this);
+    }
+
+    /* finishes every submitted frame before returning */
+    ~SkeletonExecutor() { shutdown(); }
+
+    SkeletonExecutor(const SkeletonExecutor &) = delete;
+    SkeletonExecutor &operator=(const SkeletonExecutor &) = delete;
+
+    /*
+    skeletonizer is shared with the worker, so its parameters are the ones at submission time
+    if the caller hands over a snapshot.
+    */
+    void submit(const std::shared_ptr<const HamiltonJacobiSkeleton> &skeletonizer, const BinaryFrame &frame,
+                bool enable_anisotropic_diffusion, int outputs, const Callback &callback)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (stopping_)
+            throw std::runtime_error("SkeletonExecutor: submit() after shutdown()");
+        slot_available_.wait(lock, [this]
+                             { return num_pending_ < max_pending_ || stopping_; });
+        if (stopping_)
+            throw std::runtime_error("SkeletonExecutor: submit() after shutdown()");
+
+        std::shared_ptr<Job> job = std::make_shared<Job>(skeletonizer, frame);
+        job->sequence = next_sequence_++;
+        job->enable_anisotropic_diffusion = enable_anisotropic_diffusion;
+        job->outputs = outputs;
+        job->callback = callback;
+        num_pending_++;
+        queue_.push_back(job);
+        job_available_.notify_one();
+    }
+
+    /* blocks until every submitted frame has been delivered */
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        all_delivered_.wait(lock, [this]
+                            { return num_pending_ == 0; });
+    }
+
+    /* delivers the remaining frames, then stops the workers; later submit() calls throw */
+    void shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        job_available_.notify_all();
+        slot_available_.notify_all();
+        for (std::thread &worker : workers_)
+            if (worker.joinable())
+                worker.join();
+    }
+
+    int getNumWorkers() const { return static_cast<int>(workers_.size()); }
+
+    int getMaxPending() const { return max_pending_; }
+
+    bool isOrdered() const { return ordered_; }
+
+private:
+    struct Job
+    {
+        Job(const std::shared_ptr<const HamiltonJacobiSkeleton> &skeletonizer, const BinaryFrame &frame)
+            : skeletonizer(skeletonizer), frame(frame) {}
+
+        std::shared_ptr<const HamiltonJacobiSkeleton> skeletonizer;
+        BinaryFrame frame;
+        bool enable_anisotropic_diffusion;
+        int outputs;
+        Callback callback;
+        uint64_t sequence;
+        SkeletonResult result;
+        std::exception_ptr error;
+    };
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                job_available_.wait(lock, [this]
+                                    { return !queue_.empty() || stopping_; });
+                if (queue_.empty())
+                    return;
+                job = queue_.front();
+                queue_.pop_front();
+            }
+
+            try
+            {
+                job->result = job->skeletonizer->process(job->frame, job->enable_anisotropic_diffusion, job->outputs);
+            }
+            catch (...)
+            {
+                job->error = std::current_exception();
+            }
+            complete(std::move(job));
+        }
+    }
+
+    /*
+    Hands finished jobs to their callbacks outside the lock.
+    In ordered mode a single thread delivers at a time, draining every job whose predecessors are done.
+    */
+    void complete(std::shared_ptr<Job> job)
+    {
+        if (!ordered_)
+        {
+            deliver(std::move(job));
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        finished_[job->sequence] = std::move(job);
+        if (delivering_)
+            return;
+        delivering_ = true;
+        while (!finished_.empty() && finished_.begin()->first == next_delivery_)
+        {
+            std::shared_ptr<Job> next = std::move(finished_.begin()->second);
+            finished_.erase(finished_.begin());
+            next_delivery_++;
+            lock.unlock();
+            deliver(std::move(next));
+            lock.lock();
+        }
+        delivering_ = false;
+    }
+
+    void deliver(std::shared_ptr<Job> job)
+    {
+        if (job->callback)
+        {
+            try
+            {
+                job->callback(job->result, job->error);
+            }
+            catch (...)
+            {
+                /* a failing callback must not take the worker down */
+            }
+        }
+
+        /* release the frame, result and callback before the slot is reused */
+        job.reset();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        num_pending_--;
+        slot_available_.notify_one();
+        if (num_pending_ == 0)
+            all_delivered_.notify_all();
+    }
+
+    bool ordered_;
+    bool stopping_;
+    bool delivering_;
+    int max_pending_;
+    int num_pending_;
+    uint64_t next_sequence_;
+    uint64_t next_delivery_;
+
+    std::deque<std::shared_ptr<Job>> queue_;
+    std::map<uint64_t, std::shared_ptr<Job>> finished_;
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable job_available_;
+    std::condition_variable slot_available_;
+    std::condition_variable all_delivered_;
+};
+
+#endif
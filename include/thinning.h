@@ -1,15 +1,23 @@
 #ifndef PYHJS_INCLUDE_HOMOTOPY_THINNING_H_
 #define PYHJS_INCLUDE_HOMOTOPY_THINNING_H_
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <map>
 #include <opencv2/opencv.hpp>
+#include <queue>
+#include <vector>
+
+#include "parallel.h"
 
 enum struct PointStatus;
 typedef std::pair<int32_t, int32_t> PointPosition;
 
-enum struct PointStatus { kSearching, kRemoved, kSkeletonCandidate };
+/* {dx, dy} of the 8 neighbours, clockwise from the top left */
+static const int32_t kNeighborOffsets[8][2] = {{-1, -1}, {0, -1}, {1, -1}, {1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}};
+
+enum struct PointStatus { kSearching, kRemoved, kSkeletonCandidate, kBatched /* popped into the current batch */ };
 
 struct SkeletonPoint {
     int32_t x, y;
@@ -28,12 +36,16 @@ struct FluxPoint {
 
 class HomotopyPreservingThinning {
    public:
-    HomotopyPreservingThinning(){};
-    HomotopyPreservingThinning(float flux_threshold) : m_flux_threshold_(flux_threshold){};
+    HomotopyPreservingThinning() : m_batch_flux_band_(-1), m_num_threads_(0){};
+    HomotopyPreservingThinning(float flux_threshold) : m_flux_threshold_(flux_threshold), m_batch_flux_band_(-1), m_num_threads_(0){};
+    /*
+    skeleton_mat: CV_8U, zero on the shape; distance_mat, flux_mat: CV_32F. The images are only read, so they are not copied.
+    */
     void setImages(const cv::Mat &skeleton_mat, const cv::Mat &distance_mat, const cv::Mat &flux_mat) {
-        m_skeleton_mat_ = skeleton_mat.clone();
-        m_distance_mat_ = distance_mat.clone();
-        m_flux_mat_ = flux_mat.clone();
+        CV_Assert(skeleton_mat.type() == CV_8UC1 && distance_mat.type() == CV_32F && flux_mat.type() == CV_32F);
+        m_skeleton_mat_ = skeleton_mat;
+        m_distance_mat_ = distance_mat;
+        m_flux_mat_ = flux_mat;
         m_image_width_ = m_skeleton_mat_.cols;
         m_image_height_ = m_skeleton_mat_.rows;
     };
@@ -43,16 +55,39 @@ class HomotopyPreservingThinning {
         std::copy(contour_points.begin(), contour_points.end(), std::back_inserter(m_contour_points_));
     };
 
+    /*
+    end_point_mask (CV_8U, optional): end points are kept only where the mask is nonzero,
+    so that branches outside the mask are eroded back to their junctions
+    */
+    void setEndPointMask(const cv::Mat &end_point_mask) {
+        CV_Assert(end_point_mask.empty() || end_point_mask.type() == CV_8UC1);
+        m_end_point_mask_ = end_point_mask;
+    };
+
+    /*
+    Remove the candidates in batches instead of one at a time: every queued point whose flux is within flux_band of
+    the largest one is popped at once. The batch is split into the four sub-fields (x % 2, y % 2), whose points are
+    not 8-neighbours of each other, so the points of a sub-field are tested and removed in parallel with the same
+    result as one after another. Only simple points are removed, so the topology is preserved and the end point
+    rule applies as in the serial order; the skeleton can differ from the serial one where the flux order within a
+    band matters. The result depends neither on num_threads nor on the order of the heap. flux_band < 0 restores the
+    serial removal.
+    */
+    void setBatchRemoval(float flux_band, int num_threads = 0) {
+        m_batch_flux_band_ = flux_band;
+        m_num_threads_ = num_threads;
+    };
+
     void compute() {
         std::priority_queue<FluxPoint> priority_queue_flux_points;
-        m_mat_position2status_ = cv::Mat::zeros(cv::Size(m_image_width_, m_image_height_), CV_16SC1);
+        m_mat_position2status_ = cv::Mat::zeros(cv::Size(m_image_width_, m_image_height_), CV_8UC1);
         for (int32_t y = 0; y < m_image_height_; y++) {
             for (int32_t x = 0; x < m_image_width_; x++) {
                 // TODO: change skeleton condition
-                if (m_skeleton_mat_.at<float>(y, x) == 0) {
-                    m_mat_position2status_.at<short>(y, x) = static_cast<short>(PointStatus::kSkeletonCandidate);
+                if (m_skeleton_mat_.at<uchar>(y, x) == 0) {
+                    m_mat_position2status_.at<uchar>(y, x) = static_cast<uchar>(PointStatus::kSkeletonCandidate);
                 } else {
-                    m_mat_position2status_.at<short>(y, x) = static_cast<short>(PointStatus::kRemoved);
+                    m_mat_position2status_.at<uchar>(y, x) = static_cast<uchar>(PointStatus::kRemoved);
                 }
             }
         }
@@ -63,155 +98,223 @@ class HomotopyPreservingThinning {
             int32_t cp_y = m_contour_points_[k].y;
             if (is_image_boundary(cp_x, cp_y)) continue;
             if (is_simple(cp_x, cp_y)) {
-                m_mat_position2status_.at<short>(cp_y, cp_x) = static_cast<short>(PointStatus::kSkeletonCandidate);
+                m_mat_position2status_.at<uchar>(cp_y, cp_x) = static_cast<uchar>(PointStatus::kSkeletonCandidate);
                 priority_queue_flux_points.push(FluxPoint(cp_x, cp_y, m_flux_mat_.at<float>(cp_y, cp_x)));
             }
         }
 
         // Iterative thinning
-        while (!priority_queue_flux_points.empty()) {
-            FluxPoint flux_point = priority_queue_flux_points.top().clone();
-            priority_queue_flux_points.pop();
-
-            m_mat_position2status_.at<short>(flux_point.y, flux_point.x) = static_cast<short>(PointStatus::kSkeletonCandidate);
-            if (!is_simple(flux_point.x, flux_point.y)) continue;
-
-            if (!is_end_point(flux_point.x, flux_point.y) || flux_point.flux > m_flux_threshold_) {
-                m_mat_position2status_.at<short>(flux_point.y, flux_point.x) = static_cast<short>(PointStatus::kRemoved);
-                for (int32_t ky = -1; ky <= 1; ky++) {
-                    for (int32_t kx = -1; kx <= 1; kx++) {
-                        if (m_mat_position2status_.at<short>(flux_point.y + ky, flux_point.x + kx) ==
-                            static_cast<short>(PointStatus::kSkeletonCandidate)) {
-                            if (is_image_boundary(flux_point.x + kx, flux_point.y + ky)) continue;
-                            if (is_simple(flux_point.x + kx, flux_point.y + ky)) {
-                                m_mat_position2status_.at<short>(flux_point.y + ky, flux_point.x + kx) = static_cast<short>(PointStatus::kSearching);
-                                priority_queue_flux_points.push(
-                                    FluxPoint(flux_point.x + kx, flux_point.y + ky, m_flux_mat_.at<float>(flux_point.y + ky, flux_point.x + kx)));
-                            }
-                        }
-                    }
-                }
-            } else {
-                m_mat_position2status_.at<short>(flux_point.y, flux_point.x) = static_cast<short>(PointStatus::kSkeletonCandidate);
+        if (m_batch_flux_band_ >= 0) {
+            thin_in_batches(priority_queue_flux_points);
+        } else {
+            while (!priority_queue_flux_points.empty()) {
+                FluxPoint flux_point = priority_queue_flux_points.top().clone();
+                priority_queue_flux_points.pop();
+
+                // a contour point can be queued twice (as a seed and as a neighbour); do not bring it back once
+                // removed, which used to leave isolated pixels on the skeleton
+                if (m_mat_position2status_.at<uchar>(flux_point.y, flux_point.x) == static_cast<uchar>(PointStatus::kRemoved)) continue;
+
+                if (test_and_remove(flux_point)) push_simple_neighbors(flux_point, priority_queue_flux_points);
             }
         }
 
         m_skeleton_point_list_.clear();
         for (int32_t y = 0; y < m_image_height_; y++) {
             for (int32_t x = 0; x < m_image_width_; x++) {
-                if (m_mat_position2status_.at<short>(y, x) == static_cast<short>(PointStatus::kSkeletonCandidate))
+                if (m_mat_position2status_.at<uchar>(y, x) == static_cast<uchar>(PointStatus::kSkeletonCandidate))
                     m_skeleton_point_list_.push_back(SkeletonPoint(x, y, m_distance_mat_.at<float>(y, x)));
             }
         }
     };
 
     cv::Mat getSkeletonImage() {
-        cv::Mat skeleton_image = cv::Mat::zeros(cv::Size(m_image_width_, m_image_height_), CV_32F);
+        cv::Mat skeleton_image = cv::Mat::zeros(cv::Size(m_image_width_, m_image_height_), CV_8UC1);
         for (SkeletonPoint skeleton_point : m_skeleton_point_list_) {
             if (skeleton_point.x > 0 && skeleton_point.y > 0 && skeleton_point.x < m_image_width_ - 1 && m_image_height_ - 1)
-                skeleton_image.at<float>(skeleton_point.y, skeleton_point.x) = 1.0;
+                skeleton_image.at<uchar>(skeleton_point.y, skeleton_point.x) = 1;
         }
         return skeleton_image;
     }
 
    private:
-    int32_t neighbor_indices_to_hash(int32_t kx, int32_t ky) {
-        int32_t local_index = (ky + 1) * 3 + (kx + 1);
-        switch (local_index) {
-            case 0:  // {kx = -1, ky = -1}
-                return 0;
-            case 1:  // {kx = 0, ky = -1}
-                return 1;
-            case 2:  // {kx = 1, ky = -1}
-                return 2;
-            case 5:  // {kx = 1, ky = 0}
-                return 3;
-            case 8:  // {kx = 1, ky = 1}
-                return 4;
-            case 7:  // {kx = 0, ky = 1}
-                return 5;
-            case 6:  // {kx = -1, ky = 1}
-                return 6;
-            case 3:  // {kx = -1, ky = 0}
-                return 7;
-            default:
-                std::cerr << "Invarid neighbor indices is received" << std::endl;
-                exit(EXIT_FAILURE);
+    /* simple point and end point tests for each 8-neighbourhood, indexed by neighbor_code() */
+    struct NeighborTable {
+        bool simple[256];
+        bool end_point[256];
+    };
+
+    static const int32_t kMinParallelBatch = 512;  // smaller sub-field batches are tested on the calling thread
+
+    /*
+    Remove a popped point if it is simple and not an end point to keep; returns true if it was removed.
+    Only the 8-neighbourhood of the point is read.
+    */
+    bool test_and_remove(const FluxPoint &flux_point) {
+        uchar &status = m_mat_position2status_.at<uchar>(flux_point.y, flux_point.x);
+        status = static_cast<uchar>(PointStatus::kSkeletonCandidate);
+        if (!is_simple(flux_point.x, flux_point.y)) return false;
+
+        if (!is_end_point(flux_point.x, flux_point.y) || flux_point.flux > m_flux_threshold_ ||
+            (!m_end_point_mask_.empty() && m_end_point_mask_.at<uchar>(flux_point.y, flux_point.x) == 0)) {
+            status = static_cast<uchar>(PointStatus::kRemoved);
+            return true;
         }
-        return -1;
+        return false;
     }
 
-    bool is_simple(const int32_t &p_x, const int32_t &p_y) {
-        if (is_image_boundary(p_x, p_y)) return true;
-
-        std::set<int32_t> neighbor_vertice_list;
+    void push_simple_neighbors(const FluxPoint &flux_point, std::priority_queue<FluxPoint> &priority_queue_flux_points) {
         for (int32_t ky = -1; ky <= 1; ky++) {
             for (int32_t kx = -1; kx <= 1; kx++) {
-                if (kx == 0 && ky == 0) continue;
-                if (m_mat_position2status_.at<short>(p_y + ky, p_x + kx) != static_cast<short>(PointStatus::kRemoved))
-                    neighbor_vertice_list.insert(neighbor_indices_to_hash(kx, ky));
+                if (m_mat_position2status_.at<uchar>(flux_point.y + ky, flux_point.x + kx) == static_cast<uchar>(PointStatus::kSkeletonCandidate)) {
+                    if (is_image_boundary(flux_point.x + kx, flux_point.y + ky)) continue;
+                    if (is_simple(flux_point.x + kx, flux_point.y + ky)) {
+                        m_mat_position2status_.at<uchar>(flux_point.y + ky, flux_point.x + kx) = static_cast<uchar>(PointStatus::kSearching);
+                        priority_queue_flux_points.push(FluxPoint(flux_point.x + kx, flux_point.y + ky, m_flux_mat_.at<float>(flux_point.y + ky, flux_point.x + kx)));
+                    }
+                }
             }
         }
+    }
 
-        int32_t num_vertices = 0;
-        int32_t num_edges = 0;
-        for (int32_t neighbor_hash : neighbor_vertice_list) {
-            int32_t prev_vertex = (neighbor_hash - 1 >= 0) ? (neighbor_hash - 1) : (neighbor_hash + 7);
-            int32_t post_vertex = (neighbor_hash + 1 <= 7) ? (neighbor_hash + 1) : (neighbor_hash - 7);
-            if ((neighbor_vertice_list.find(post_vertex) != neighbor_vertice_list.end()) ||
-                (neighbor_hash == 1 && (neighbor_vertice_list.find(3) != neighbor_vertice_list.end())) ||
-                (neighbor_hash == 3 && (neighbor_vertice_list.find(5) != neighbor_vertice_list.end())) ||
-                (neighbor_hash == 5 && (neighbor_vertice_list.find(7) != neighbor_vertice_list.end())) ||
-                (neighbor_hash == 7 && (neighbor_vertice_list.find(1) != neighbor_vertice_list.end()))) {
-                num_edges += 1;
-                num_vertices += 1;
-            } else {
-                num_vertices += 1;
+    /* bit k set if neighbour k (kNeighborOffsets) would be queued by push_simple_neighbors() */
+    uchar simple_neighbor_code(const int32_t &p_x, const int32_t &p_y) {
+        uchar code = 0;
+        for (int32_t neighbor_hash = 0; neighbor_hash < 8; neighbor_hash++) {
+            int32_t x = p_x + kNeighborOffsets[neighbor_hash][0];
+            int32_t y = p_y + kNeighborOffsets[neighbor_hash][1];
+            if (m_mat_position2status_.at<uchar>(y, x) != static_cast<uchar>(PointStatus::kSkeletonCandidate)) continue;
+            if (is_image_boundary(x, y)) continue;
+            if (is_simple(x, y)) code |= 1 << neighbor_hash;
+        }
+        return code;
+    }
+
+    /* see setBatchRemoval() */
+    void thin_in_batches(std::priority_queue<FluxPoint> &priority_queue_flux_points) {
+        std::vector<FluxPoint> subfields[4];
+        std::vector<uchar> neighbors_to_push;
+        while (!priority_queue_flux_points.empty()) {
+            float flux_floor = priority_queue_flux_points.top().flux - m_batch_flux_band_;
+            while (!priority_queue_flux_points.empty() && priority_queue_flux_points.top().flux >= flux_floor) {
+                FluxPoint flux_point = priority_queue_flux_points.top();
+                priority_queue_flux_points.pop();
+                // removed, or queued twice and already in the batch
+                uchar &status = m_mat_position2status_.at<uchar>(flux_point.y, flux_point.x);
+                if (status == static_cast<uchar>(PointStatus::kRemoved) || status == static_cast<uchar>(PointStatus::kBatched)) continue;
+                status = static_cast<uchar>(PointStatus::kBatched);
+                subfields[(flux_point.y & 1) * 2 + (flux_point.x & 1)].push_back(flux_point);
             }
 
-            if (neighbor_hash == 0 || neighbor_hash == 2 || neighbor_hash == 4 || neighbor_hash == 6) {
-                if ((neighbor_vertice_list.find(prev_vertex) != neighbor_vertice_list.end()) &&
-                    (neighbor_vertice_list.find(post_vertex) != neighbor_vertice_list.end())) {
-                    num_edges -= 1;
-                    num_vertices -= 1;
+            for (std::vector<FluxPoint> &batch : subfields) {
+                /*
+                Each test reads the 8-neighbourhood of its point and writes the point only: no other point of the
+                sub-field. The neighbours to queue are then looked up once all removals are done; marking them as
+                searching does not change any simple point test, so the queue does not depend on the order either.
+                */
+                neighbors_to_push.assign(batch.size(), 0);
+                auto remove_points = [&](const cv::Range &range) {
+                    for (int32_t index = range.start; index < range.end; index++) test_and_remove(batch[index]);
+                };
+                auto find_neighbors = [&](const cv::Range &range) {
+                    for (int32_t index = range.start; index < range.end; index++) {
+                        if (m_mat_position2status_.at<uchar>(batch[index].y, batch[index].x) == static_cast<uchar>(PointStatus::kRemoved))
+                            neighbors_to_push[index] = simple_neighbor_code(batch[index].x, batch[index].y);
+                    }
+                };
+                cv::Range range(0, static_cast<int32_t>(batch.size()));
+                if (range.end >= kMinParallelBatch) {
+                    parallelFor(range, remove_points, m_num_threads_);
+                    parallelFor(range, find_neighbors, m_num_threads_);
+                } else {
+                    remove_points(range);
+                    find_neighbors(range);
+                }
+
+                for (size_t index = 0; index < batch.size(); index++) {
+                    for (int32_t neighbor_hash = 0; neighbor_hash < 8; neighbor_hash++) {
+                        if (!(neighbors_to_push[index] >> neighbor_hash & 1)) continue;
+                        int32_t x = batch[index].x + kNeighborOffsets[neighbor_hash][0];
+                        int32_t y = batch[index].y + kNeighborOffsets[neighbor_hash][1];
+                        uchar &status = m_mat_position2status_.at<uchar>(y, x);
+                        if (status != static_cast<uchar>(PointStatus::kSkeletonCandidate)) continue;  // queued by another point
+                        status = static_cast<uchar>(PointStatus::kSearching);
+                        priority_queue_flux_points.push(FluxPoint(x, y, m_flux_mat_.at<float>(y, x)));
+                    }
                 }
+                batch.clear();
             }
         }
+    }
 
-        // Is local graph a tree?
-        return (num_vertices - num_edges == 1);
+    /* bit k set if neighbour k (kNeighborOffsets) is not removed */
+    int32_t neighbor_code(const int32_t &p_x, const int32_t &p_y) const {
+        const uchar removed = static_cast<uchar>(PointStatus::kRemoved);
+        const uchar *above = m_mat_position2status_.ptr<uchar>(p_y - 1) + p_x;
+        const uchar *center = m_mat_position2status_.ptr<uchar>(p_y) + p_x;
+        const uchar *below = m_mat_position2status_.ptr<uchar>(p_y + 1) + p_x;
+        return (above[-1] != removed) | (above[0] != removed) << 1 | (above[1] != removed) << 2 | (center[1] != removed) << 3 |
+               (below[1] != removed) << 4 | (below[0] != removed) << 5 | (below[-1] != removed) << 6 | (center[-1] != removed) << 7;
     }
 
-    bool is_end_point(const int32_t &p_x, const int32_t &p_y) {
-        std::vector<int32_t> neighbor_vertice_list;
-        for (int32_t ky = -1; ky <= 1; ky++) {
-            for (int32_t kx = -1; kx <= 1; kx++) {
-                if (kx == 0 && ky == 0) continue;
-                if (m_mat_position2status_.at<short>(p_y + ky, p_x + kx) != static_cast<short>(PointStatus::kRemoved))
-                    neighbor_vertice_list.push_back(neighbor_indices_to_hash(kx, ky));
-            }
-        }
-        if (neighbor_vertice_list.size() > 2) return false;
+    static const NeighborTable &neighbor_table() {
+        static const NeighborTable table = build_neighbor_table();
+        return table;
+    }
 
-        // In the case of isolated point
-        if (neighbor_vertice_list.size() == 1) return true;
+    static NeighborTable build_neighbor_table() {
+        NeighborTable table;
+        for (int32_t code = 0; code < 256; code++) {
+            auto has = [code](int32_t neighbor_hash) { return (code >> neighbor_hash & 1) != 0; };
 
-        if ((abs(neighbor_vertice_list[0] - neighbor_vertice_list[1]) == 1) || (neighbor_vertice_list[0] == 7 && neighbor_vertice_list[1] == 0) ||
-            (neighbor_vertice_list[0] == 0 && neighbor_vertice_list[1] == 7)) {
-            return true;
+            /* the neighbours form a tree iff the point is simple; edge and corner neighbours are the vertices */
+            int32_t num_vertices = 0;
+            int32_t num_edges = 0;
+            for (int32_t neighbor_hash = 0; neighbor_hash < 8; neighbor_hash++) {
+                if (!has(neighbor_hash)) continue;
+                int32_t prev_vertex = (neighbor_hash + 7) % 8;
+                int32_t post_vertex = (neighbor_hash + 1) % 8;
+                num_vertices += 1;
+                if (has(post_vertex) || (neighbor_hash % 2 == 1 && has((neighbor_hash + 2) % 8))) num_edges += 1;
+                if (neighbor_hash % 2 == 0 && has(prev_vertex) && has(post_vertex)) {
+                    num_edges -= 1;
+                    num_vertices -= 1;
+                }
+            }
+            table.simple[code] = (num_vertices - num_edges == 1);
+
+            /* one neighbour, or two adjacent ones */
+            int32_t num_neighbors = 0;
+            bool adjacent_pair = false;
+            for (int32_t neighbor_hash = 0; neighbor_hash < 8; neighbor_hash++) {
+                if (!has(neighbor_hash)) continue;
+                num_neighbors += 1;
+                if (has((neighbor_hash + 1) % 8)) adjacent_pair = true;
+            }
+            table.end_point[code] = num_neighbors == 1 || (num_neighbors == 2 && adjacent_pair);
         }
-        return false;
+        return table;
     }
 
+    bool is_simple(const int32_t &p_x, const int32_t &p_y) {
+        if (is_image_boundary(p_x, p_y)) return true;
+        return neighbor_table().simple[neighbor_code(p_x, p_y)];
+    }
+
+    bool is_end_point(const int32_t &p_x, const int32_t &p_y) { return neighbor_table().end_point[neighbor_code(p_x, p_y)]; }
+
     bool is_image_boundary(const int32_t &p_x, const int32_t &p_y) {
         return p_x <= 0 || p_x >= m_image_width_ - 1 || p_y <= 0 || p_y >= m_image_height_ - 1;
     }
 
     float m_flux_threshold_;
+    float m_batch_flux_band_;
+    int32_t m_num_threads_;
     int32_t m_image_width_, m_image_height_;
 
     cv::Mat m_skeleton_mat_, m_distance_mat_, m_flux_mat_;
     cv::Mat m_label_mat_;
+    cv::Mat m_end_point_mask_;
     std::vector<cv::Point2i> m_contour_points_;
     std::vector<SkeletonPoint> m_skeleton_point_list_;
     cv::Mat m_mat_position2status_;
@@ -0,0 +1,344 @@
+#ifndef PYHJS_INCLUDE_HOMOTOPY_THINNING3D_H_
+#define PYHJS_INCLUDE_HOMOTOPY_THINNING3D_H_
+
+#include <atomic>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <queue>
+#include <vector>
+
+#include "parallel.h"
+#include "skeleton3d.h"
+
+/* end points the 3D thinning keeps where the flux is below the threshold */
+enum MedialStructure {
+    kMedialSurface = 0,  // ends of curves and rims of sheets: the medial surface
+    kMedialCurve = 1     // ends of curves only: sheets thin down to curves, the centerlines
+};
+
+enum struct VoxelStatus : uint8_t { kSearching, kRemoved, kSkeletonCandidate, kBatched /* popped into the current batch */, kFixed /* on the volume border */ };
+
+/* voxels of equal flux are popped in queue order, so plateaus of the flux erode layer by layer from the boundary */
+struct FluxVoxel {
+    int64_t index;  // Volume::index()
+    float flux;
+    uint32_t order;  // number of voxels queued before
+    FluxVoxel(const int64_t &index_input, const float &flux_input, const uint32_t &order_input) : index(index_input), flux(flux_input), order(order_input){};
+    friend bool operator<(const FluxVoxel &v1, const FluxVoxel &v2) { return v1.flux < v2.flux || (v1.flux == v2.flux && v1.order > v2.order); };
+};
+
+/*
+HomotopyPreservingThinning of a volume: the shape voxels are removed in flux order while they are simple for
+(26, 6) connectivity, so the skeleton keeps the components, tunnels and cavities of the shape. Voxels on the volume
+border are never removed and not part of the skeleton, like the image border in 2D.
+
+A voxel is simple iff its foreground 26-neighbours form one 26-connected component and its background 18-neighbours
+one 6-connected component 6-adjacent to it (Bertrand & Malandain's topological numbers). The test is looked up in a
+table of all 2^26 neighbourhoods, 2 bits each (16 MB), shared by the process and filled as neighbourhoods are met:
+a shape only shows a small fraction of them, so nearly every test is one load.
+*/
+class HomotopyPreservingThinning3D {
+   public:
+    HomotopyPreservingThinning3D(float flux_threshold, MedialStructure medial_structure = kMedialSurface)
+        : m_flux_threshold_(flux_threshold), m_medial_structure_(medial_structure), m_batch_flux_band_(-1), m_num_threads_(0),
+          m_mask_volume_(nullptr), m_flux_volume_(nullptr){};
+
+    /*
+    mask_volume: nonzero on the shape; flux_volume: flux3D() of its distance transform.
+    The volumes are only read, so they are not copied; they must outlive compute().
+    */
+    void setVolumes(const Volume<uint8_t> &mask_volume, const Volume<float> &flux_volume) {
+        CV_Assert(mask_volume.depth == flux_volume.depth && mask_volume.height == flux_volume.height && mask_volume.width == flux_volume.width);
+        m_mask_volume_ = &mask_volume;
+        m_flux_volume_ = &flux_volume;
+        int64_t offset_y = mask_volume.width, offset_z = int64_t(mask_volume.height) * mask_volume.width;
+        for (int32_t neighbor_hash = 0; neighbor_hash < 26; neighbor_hash++) {
+            const int32_t *position = topology().position[neighbor_hash];
+            m_neighbor_offsets_[neighbor_hash] = position[2] * offset_z + position[1] * offset_y + position[0];
+        }
+    };
+
+    /*
+    Batch removal as HomotopyPreservingThinning::setBatchRemoval(), with the eight sub-fields (x % 2, y % 2, z % 2)
+    whose voxels are not 26-neighbours of each other. flux_band < 0 restores the serial removal.
+    */
+    void setBatchRemoval(float flux_band, int num_threads = 0) {
+        m_batch_flux_band_ = flux_band;
+        m_num_threads_ = num_threads;
+    };
+
+    void compute() {
+        CV_Assert(m_mask_volume_ && m_flux_volume_);
+        const Volume<uint8_t> &mask_volume = *m_mask_volume_;
+        int32_t depth = mask_volume.depth, height = mask_volume.height, width = mask_volume.width;
+        m_status_volume_ = Volume<uint8_t>(depth, height, width, static_cast<uint8_t>(VoxelStatus::kRemoved));
+
+        /* shape voxels inside the border are candidates; the ones with a background 6-neighbour seed the thinning */
+        std::vector<std::vector<int64_t>> plane_seeds(depth);
+        parallelFor(cv::Range(0, depth), [&](const cv::Range &range) {
+            for (int32_t z = range.start; z < range.end; z++) {
+                for (int32_t y = 0; y < height; y++) {
+                    for (int32_t x = 0; x < width; x++) {
+                        int64_t index = mask_volume.index(z, y, x);
+                        if (mask_volume.data[index] == 0) continue;
+                        if (z == 0 || y == 0 || x == 0 || z == depth - 1 || y == height - 1 || x == width - 1) {
+                            m_status_volume_.data[index] = static_cast<uint8_t>(VoxelStatus::kFixed);
+                            continue;
+                        }
+                        m_status_volume_.data[index] = static_cast<uint8_t>(VoxelStatus::kSkeletonCandidate);
+                        for (int32_t neighbor_hash : {4, 10, 12, 13, 15, 21}) {
+                            if (mask_volume.data[index + m_neighbor_offsets_[neighbor_hash]] == 0) {
+                                plane_seeds[z].push_back(index);
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+        }, m_num_threads_);
+
+        std::priority_queue<FluxVoxel> priority_queue_flux_voxels;
+        m_num_queued_ = 0;
+        for (std::vector<int64_t> &seeds : plane_seeds) {
+            for (int64_t index : seeds) {
+                m_status_volume_.data[index] = static_cast<uint8_t>(VoxelStatus::kSearching);
+                priority_queue_flux_voxels.push(FluxVoxel(index, m_flux_volume_->data[index], m_num_queued_++));
+            }
+            std::vector<int64_t>().swap(seeds);
+        }
+
+        // Iterative thinning
+        if (m_batch_flux_band_ >= 0) {
+            thin_in_batches(priority_queue_flux_voxels);
+        } else {
+            while (!priority_queue_flux_voxels.empty()) {
+                FluxVoxel flux_voxel = priority_queue_flux_voxels.top();
+                priority_queue_flux_voxels.pop();
+                if (test_and_remove(flux_voxel)) push_neighbors(flux_voxel.index, priority_queue_flux_voxels);
+            }
+        }
+    };
+
+    /* 1 on the skeleton, 0 elsewhere */
+    Volume<uint8_t> getSkeletonVolume() const {
+        Volume<uint8_t> skeleton_volume(m_status_volume_.depth, m_status_volume_.height, m_status_volume_.width, 0);
+        const uint8_t candidate = static_cast<uint8_t>(VoxelStatus::kSkeletonCandidate);
+        for (int64_t index = 0; index < m_status_volume_.size(); index++) skeleton_volume.data[index] = m_status_volume_.data[index] == candidate;
+        return skeleton_volume;
+    }
+
+   private:
+    /* the 26 neighbours: {dx, dy, dz} by neighbor hash, and the neighbours adjacent to each other as bit masks */
+    struct Topology {
+        int32_t position[26][3];
+        uint32_t adjacent26[26];  // 26-adjacent neighbours
+        uint32_t adjacent6[26];   // 6-adjacent neighbours within the 18-neighbourhood
+        uint32_t n6, n18;
+        uint32_t planes[3][8];    // neighbours in the xy, xz and yz planes, in cyclic order as kNeighborOffsets
+    };
+
+    static const int32_t kMinParallelBatch = 512;  // smaller sub-field batches are tested on the calling thread
+
+    /*
+    Remove a popped voxel if it is simple and not an end point to keep; returns true if it was removed.
+    Only the 26-neighbourhood of the voxel is read.
+    */
+    bool test_and_remove(const FluxVoxel &flux_voxel) {
+        uint8_t &status = m_status_volume_.data[flux_voxel.index];
+        status = static_cast<uint8_t>(VoxelStatus::kSkeletonCandidate);
+        uint32_t code = neighbor_code(flux_voxel.index);
+        if (!is_simple(code)) return false;
+
+        if (flux_voxel.flux > m_flux_threshold_ || !is_end_point(code)) {
+            status = static_cast<uint8_t>(VoxelStatus::kRemoved);
+            return true;
+        }
+        return false;
+    }
+
+    /*
+    Queue the candidate neighbours of a removed voxel. Unlike the 2D thinning, they are queued without testing
+    whether they are simple: a 26-neighbourhood costs as much to gather as to test, and a voxel that is not simple
+    yet returns to the candidates when popped, to be queued again by its next removed neighbour.
+    */
+    void push_neighbors(const int64_t &index, std::priority_queue<FluxVoxel> &priority_queue_flux_voxels) {
+        for (int32_t neighbor_hash = 0; neighbor_hash < 26; neighbor_hash++) {
+            int64_t neighbor = index + m_neighbor_offsets_[neighbor_hash];
+            uint8_t &status = m_status_volume_.data[neighbor];
+            if (status != static_cast<uint8_t>(VoxelStatus::kSkeletonCandidate)) continue;
+            status = static_cast<uint8_t>(VoxelStatus::kSearching);
+            priority_queue_flux_voxels.push(FluxVoxel(neighbor, m_flux_volume_->data[neighbor], m_num_queued_++));
+        }
+    }
+
+    /* see setBatchRemoval() */
+    void thin_in_batches(std::priority_queue<FluxVoxel> &priority_queue_flux_voxels) {
+        int64_t width = m_status_volume_.width, plane_size = int64_t(m_status_volume_.height) * width;
+        std::vector<FluxVoxel> subfields[8];
+        while (!priority_queue_flux_voxels.empty()) {
+            float flux_floor = priority_queue_flux_voxels.top().flux - m_batch_flux_band_;
+            while (!priority_queue_flux_voxels.empty() && priority_queue_flux_voxels.top().flux >= flux_floor) {
+                FluxVoxel flux_voxel = priority_queue_flux_voxels.top();
+                priority_queue_flux_voxels.pop();
+                m_status_volume_.data[flux_voxel.index] = static_cast<uint8_t>(VoxelStatus::kBatched);
+                int64_t z = flux_voxel.index / plane_size, y = flux_voxel.index % plane_size / width, x = flux_voxel.index % width;
+                subfields[(z & 1) * 4 + (y & 1) * 2 + (x & 1)].push_back(flux_voxel);
+            }
+
+            for (std::vector<FluxVoxel> &batch : subfields) {
+                /* each test reads the 26-neighbourhood of its voxel and writes the voxel only: no other voxel of the sub-field */
+                auto remove_voxels = [&](const cv::Range &range) {
+                    for (int32_t index = range.start; index < range.end; index++) test_and_remove(batch[index]);
+                };
+                cv::Range range(0, static_cast<int32_t>(batch.size()));
+                if (range.end >= kMinParallelBatch)
+                    parallelFor(range, remove_voxels, m_num_threads_);
+                else
+                    remove_voxels(range);
+
+                for (const FluxVoxel &flux_voxel : batch) {
+                    if (m_status_volume_.data[flux_voxel.index] == static_cast<uint8_t>(VoxelStatus::kRemoved))
+                        push_neighbors(flux_voxel.index, priority_queue_flux_voxels);
+                }
+                batch.clear();
+            }
+        }
+    }
+
+    /* bit k set if neighbour k (Topology::position) is not removed */
+    uint32_t neighbor_code(const int64_t &index) const {
+        const uint8_t removed = static_cast<uint8_t>(VoxelStatus::kRemoved);
+        const uint8_t *center = m_status_volume_.data.data() + index;
+        uint32_t code = 0;
+        for (int32_t neighbor_hash = 0; neighbor_hash < 26; neighbor_hash++) code |= uint32_t(center[m_neighbor_offsets_[neighbor_hash]] != removed) << neighbor_hash;
+        return code;
+    }
+
+    /* one neighbour, or two adjacent ones; with kMedialSurface also in any of the three planes through the voxel */
+    bool is_end_point(uint32_t code) const {
+        const Topology &neighbors = topology();
+        int32_t num_neighbors = __builtin_popcount(code);
+        if (num_neighbors == 1) return true;
+        if (num_neighbors == 2 && (neighbors.adjacent26[__builtin_ctz(code)] & code)) return true;
+        if (m_medial_structure_ == kMedialCurve) return false;
+
+        for (const uint32_t *plane : neighbors.planes) {
+            int32_t num_plane_neighbors = 0;
+            bool adjacent_pair = false;
+            for (int32_t k = 0; k < 8; k++) {
+                if (!(code & plane[k])) continue;
+                num_plane_neighbors += 1;
+                if (code & plane[(k + 1) % 8]) adjacent_pair = true;
+            }
+            if (num_plane_neighbors == 1 || (num_plane_neighbors == 2 && adjacent_pair)) return true;
+        }
+        return false;
+    }
+
+    static bool is_simple(uint32_t code) {
+        std::atomic<uint32_t> &word = simple_table()[code >> 4];
+        uint32_t shift = (code & 15) * 2;
+        uint32_t entry = word.load(std::memory_order_relaxed) >> shift & 3;
+        if (entry & 1) return entry >> 1;
+        bool simple = compute_simple(code);
+        word.fetch_or((1u | uint32_t(simple) << 1) << shift, std::memory_order_relaxed);
+        return simple;
+    }
+
+    /* bits 2k and 2k + 1 of the table: neighbourhood k is known, and simple */
+    static std::atomic<uint32_t> *simple_table() {
+        static std::unique_ptr<std::atomic<uint32_t>[]> table(new std::atomic<uint32_t>[(1 << 26) / 16]());
+        return table.get();
+    }
+
+    static bool compute_simple(uint32_t code) {
+        const Topology &neighbors = topology();
+        if (count_components(code, code, neighbors.adjacent26) != 1) return false;
+        return count_components(~code & neighbors.n18, neighbors.n6, neighbors.adjacent6) == 1;
+    }
+
+    /* connected components of the neighbours in set (adjacent: adjacency masks) that contain one of seeds */
+    static int32_t count_components(uint32_t set, uint32_t seeds, const uint32_t *adjacent) {
+        int32_t num_components = 0;
+        while (set & seeds) {
+            uint32_t component = (set & seeds) & (~(set & seeds) + 1);
+            uint32_t frontier = component;
+            while (frontier) {
+                int32_t neighbor_hash = __builtin_ctz(frontier);
+                frontier &= frontier - 1;
+                uint32_t grown = adjacent[neighbor_hash] & set & ~component;
+                component |= grown;
+                frontier |= grown;
+            }
+            set &= ~component;
+            num_components += 1;
+        }
+        return num_components;
+    }
+
+    static const Topology &topology() {
+        static const Topology topology = build_topology();
+        return topology;
+    }
+
+    static Topology build_topology() {
+        Topology topology;
+        int32_t neighbor_hash = 0;
+        for (int32_t dz = -1; dz <= 1; dz++) {
+            for (int32_t dy = -1; dy <= 1; dy++) {
+                for (int32_t dx = -1; dx <= 1; dx++) {
+                    if (dx == 0 && dy == 0 && dz == 0) continue;
+                    topology.position[neighbor_hash][0] = dx;
+                    topology.position[neighbor_hash][1] = dy;
+                    topology.position[neighbor_hash][2] = dz;
+                    neighbor_hash++;
+                }
+            }
+        }
+        auto hash_of = [](int32_t dx, int32_t dy, int32_t dz) {
+            int32_t raster = (dz + 1) * 9 + (dy + 1) * 3 + (dx + 1);
+            return raster < 13 ? raster : raster - 1;
+        };
+
+        topology.n6 = topology.n18 = 0;
+        for (int32_t a = 0; a < 26; a++) {
+            const int32_t *p = topology.position[a];
+            int32_t manhattan = std::abs(p[0]) + std::abs(p[1]) + std::abs(p[2]);
+            if (manhattan == 1) topology.n6 |= 1u << a;
+            if (manhattan <= 2) topology.n18 |= 1u << a;
+        }
+        for (int32_t a = 0; a < 26; a++) {
+            topology.adjacent26[a] = topology.adjacent6[a] = 0;
+            for (int32_t b = 0; b < 26; b++) {
+                if (a == b) continue;
+                const int32_t *p = topology.position[a], *q = topology.position[b];
+                int32_t dx = std::abs(p[0] - q[0]), dy = std::abs(p[1] - q[1]), dz = std::abs(p[2] - q[2]);
+                if (std::max(dx, std::max(dy, dz)) == 1) topology.adjacent26[a] |= 1u << b;
+                if (dx + dy + dz == 1 && (topology.n18 >> a & 1) && (topology.n18 >> b & 1)) topology.adjacent6[a] |= 1u << b;
+            }
+        }
+
+        /* {u, v} of the 8 neighbours of a plane, clockwise from the top left */
+        const int32_t cycle[8][2] = {{-1, -1}, {0, -1}, {1, -1}, {1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}};
+        for (int32_t k = 0; k < 8; k++) {
+            int32_t u = cycle[k][0], v = cycle[k][1];
+            topology.planes[0][k] = 1u << hash_of(u, v, 0);
+            topology.planes[1][k] = 1u << hash_of(u, 0, v);
+            topology.planes[2][k] = 1u << hash_of(0, u, v);
+        }
+        return topology;
+    }
+
+    float m_flux_threshold_;
+    MedialStructure m_medial_structure_;
+    float m_batch_flux_band_;
+    int32_t m_num_threads_;
+
+    const Volume<uint8_t> *m_mask_volume_;
+    const Volume<float> *m_flux_volume_;
+    int64_t m_neighbor_offsets_[26];
+    uint32_t m_num_queued_;
+    Volume<uint8_t> m_status_volume_;
+};
+
+#endif
@@ -24,29 +24,30 @@ void opFirstDerivative(const cv::Mat &image, int x, int y, int width, int height
     }
 }
 
-void firstDerivativeOmp(const cv::Mat &image, cv::Mat &image_dx, cv::Mat &image_dy)
+void firstDerivativeOmp(const cv::Mat &image, cv::Mat &image_dx, cv::Mat &image_dy, int num_threads)
 {
     int width = image.cols;
     int height = image.rows;
 
     image_dx = cv::Mat::zeros(image.size(), CV_32FC1);
     image_dy = cv::Mat::zeros(image.size(), CV_32FC1);
-    cv::parallel_for_(cv::Range(0, width * height), [&](const cv::Range &range)
-                      {
-                          for (int r = range.start; r < range.end; r++)
-                          {
-                              int y = r / width;
-                              int x = r % width;
-                              float dx, dy;
-                              /*
-                            if (image.at<float>(y, x) == 0)
-                                continue;
-                            */
-                              opFirstDerivative(image, x, y, width, height, dx, dy);
-                              image_dx.at<float>(y, x) = dx;
-                              image_dy.at<float>(y, x) = dy;
-                          }
-                      });
+    parallelFor(cv::Range(0, width * height), [&](const cv::Range &range)
+                {
+                    for (int r = range.start; r < range.end; r++)
+                    {
+                        int y = r / width;
+                        int x = r % width;
+                        float dx, dy;
+                        /*
+                      if (image.at<float>(y, x) == 0)
+                          continue;
+                      */
+                        opFirstDerivative(image, x, y, width, height, dx, dy);
+                        image_dx.at<float>(y, x) = dx;
+                        image_dy.at<float>(y, x) = dy;
+                    }
+                },
+                num_threads);
 }
 
 void opSecondDerivative(const cv::Mat &image, int x, int y, int width, int height, float &dxx, float &dxy, float &dyy)
@@ -82,7 +83,7 @@ void opSecondDerivative(const cv::Mat &image, int x, int y, int width, int heigh
     }
 }
 
-void secondDerivativeOmp(const cv::Mat &image, cv::Mat &image_dxx, cv::Mat &image_dxy, cv::Mat &image_dyy)
+void secondDerivativeOmp(const cv::Mat &image, cv::Mat &image_dxx, cv::Mat &image_dxy, cv::Mat &image_dyy, int num_threads)
 {
     int width = image.cols;
     int height = image.rows;
@@ -90,112 +91,116 @@ void secondDerivativeOmp(const cv::Mat &image, cv::Mat &image_dxx, cv::Mat &imag
     image_dxx = cv::Mat::zeros(image.size(), CV_32FC1);
     image_dxy = cv::Mat::zeros(image.size(), CV_32FC1);
     image_dyy = cv::Mat::zeros(image.size(), CV_32FC1);
-    cv::parallel_for_(cv::Range(0, width * height), [&](const cv::Range &range)
-                      {
-                          for (int r = range.start; r < range.end; r++)
-                          {
-                              int y = r / width;
-                              int x = r % width;
-                              float dxx, dxy, dyy;
-                              /*
-                              if (image.at<float>(y, x) == 0)
-                                  continue;
-                            */
-                              opSecondDerivative(image, x, y, width, height, dxx, dxy, dyy);
-                              image_dxx.at<float>(y, x) = dxx;
-                              image_dxy.at<float>(y, x) = dxy;
-                              image_dyy.at<float>(y, x) = dyy;
-                          }
-                      });
+    parallelFor(cv::Range(0, width * height), [&](const cv::Range &range)
+                {
+                    for (int r = range.start; r < range.end; r++)
+                    {
+                        int y = r / width;
+                        int x = r % width;
+                        float dxx, dxy, dyy;
+                        /*
+                        if (image.at<float>(y, x) == 0)
+                            continue;
+                      */
+                        opSecondDerivative(image, x, y, width, height, dxx, dxy, dyy);
+                        image_dxx.at<float>(y, x) = dxx;
+                        image_dxy.at<float>(y, x) = dxy;
+                        image_dyy.at<float>(y, x) = dyy;
+                    }
+                },
+                num_threads);
 }
 
-cv::Mat derivative_d2I_d2xi(const cv::Mat &image, const cv::Mat &image_x, const cv::Mat &image_y, const cv::Mat &image_xx, const cv::Mat &image_xy, const cv::Mat &image_yy, float epsilon)
+cv::Mat derivative_d2I_d2xi(const cv::Mat &image, const cv::Mat &image_x, const cv::Mat &image_y, const cv::Mat &image_xx, const cv::Mat &image_xy, const cv::Mat &image_yy, float epsilon, int num_threads)
 {
     cv::Mat image_dxixi = cv::Mat::zeros(image_x.size(), CV_32FC1);
     int width = image_x.cols;
     int height = image_x.rows;
-    cv::parallel_for_(cv::Range(0, width * height), [&](const cv::Range &range)
-                      {
-                          for (int r = range.start; r < range.end; r++)
-                          {
-                              int y = r / width;
-                              int x = r % width;
-                              /*
-                              if (image.at<float>(y, x) == 0)
-                                  continue;
-                                */
-
-                              float Ix = image_x.at<float>(y, x);
-                              float Iy = image_y.at<float>(y, x);
-                              float Ixx = image_xx.at<float>(y, x);
-                              float Ixy = image_xy.at<float>(y, x);
-                              float Iyy = image_yy.at<float>(y, x);
-
-                              float Ix_pow_2 = Ix * Ix;
-                              float Iy_pow_2 = Iy * Iy;
-
-                              float denominator = Ix_pow_2 + Iy_pow_2 + epsilon;
-                              float numerator = Ixx * Iy_pow_2 - 2 * Ix * Iy * Ixy + Iyy * Ix_pow_2;
-
-                              image_dxixi.at<float>(y, x) = numerator / denominator;
-                          }
-                      });
+    parallelFor(cv::Range(0, width * height), [&](const cv::Range &range)
+                {
+                    for (int r = range.start; r < range.end; r++)
+                    {
+                        int y = r / width;
+                        int x = r % width;
+                        /*
+                        if (image.at<float>(y, x) == 0)
+                            continue;
+                          */
+
+                        float Ix = image_x.at<float>(y, x);
+                        float Iy = image_y.at<float>(y, x);
+                        float Ixx = image_xx.at<float>(y, x);
+                        float Ixy = image_xy.at<float>(y, x);
+                        float Iyy = image_yy.at<float>(y, x);
+
+                        float Ix_pow_2 = Ix * Ix;
+                        float Iy_pow_2 = Iy * Iy;
+
+                        float denominator = Ix_pow_2 + Iy_pow_2 + epsilon;
+                        float numerator = Ixx * Iy_pow_2 - 2 * Ix * Iy * Ixy + Iyy * Ix_pow_2;
+
+                        image_dxixi.at<float>(y, x) = numerator / denominator;
+                    }
+                },
+                num_threads);
     return image_dxixi;
 }
 
-cv::Mat derivative_d2I_d2eta(const cv::Mat &image, const cv::Mat &image_x, const cv::Mat &image_y, const cv::Mat &image_xx, const cv::Mat &image_xy, const cv::Mat &image_yy, float epsilon)
+cv::Mat derivative_d2I_d2eta(const cv::Mat &image, const cv::Mat &image_x, const cv::Mat &image_y, const cv::Mat &image_xx, const cv::Mat &image_xy, const cv::Mat &image_yy, float epsilon, int num_threads)
 {
     cv::Mat image_detaeta = cv::Mat::zeros(image_x.size(), CV_32FC1);
     int width = image_x.cols;
     int height = image_x.rows;
 
-    cv::parallel_for_(cv::Range(0, width * height), [&](const cv::Range &range)
-                      {
-                          for (int r = range.start; r < range.end; r++)
-                          {
-                              int y = r / width;
-                              int x = r % width;
-                              /*
-                              if (image.at<float>(y, x) == 0)
-                                  continue;
-                                */
-                              float Ix = image_x.at<float>(y, x);
-                              float Iy = image_y.at<float>(y, x);
-                              float Ixx = image_xx.at<float>(y, x);
-                              float Ixy = image_xy.at<float>(y, x);
-                              float Iyy = image_yy.at<float>(y, x);
-
-                              float Ix_pow_2 = Ix * Ix;
-                              float Iy_pow_2 = Iy * Iy;
-
-                              float denominator = Ix_pow_2 + Iy_pow_2 + epsilon;
-                              float numerator = (Ixx * Iy_pow_2 + 2 * Ix * Iy * Ixy + Iyy * Ix_pow_2);
-
-                              image_detaeta.at<float>(y, x) = numerator / denominator;
-                          }
-                      });
+    parallelFor(cv::Range(0, width * height), [&](const cv::Range &range)
+                {
+                    for (int r = range.start; r < range.end; r++)
+                    {
+                        int y = r / width;
+                        int x = r % width;
+                        /*
+                        if (image.at<float>(y, x) == 0)
+                            continue;
+                          */
+                        float Ix = image_x.at<float>(y, x);
+                        float Iy = image_y.at<float>(y, x);
+                        float Ixx = image_xx.at<float>(y, x);
+                        float Ixy = image_xy.at<float>(y, x);
+                        float Iyy = image_yy.at<float>(y, x);
+
+                        float Ix_pow_2 = Ix * Ix;
+                        float Iy_pow_2 = Iy * Iy;
+
+                        float denominator = Ix_pow_2 + Iy_pow_2 + epsilon;
+                        float numerator = (Ixx * Iy_pow_2 + 2 * Ix * Iy * Ixy + Iyy * Ix_pow_2);
+
+                        image_detaeta.at<float>(y, x) = numerator / denominator;
+                    }
+                },
+                num_threads);
 
     return image_detaeta;
 }
 
-cv::Mat update(cv::Mat &image_ad, const cv::Mat &image_d2xi, const cv::Mat &image_d2eta, float delta_t, float c)
+cv::Mat update(cv::Mat &image_ad, const cv::Mat &image_d2xi, const cv::Mat &image_d2eta, float delta_t, float c, int num_threads)
 {
     int width = image_ad.cols;
     int height = image_ad.rows;
     cv::Mat image_ad_new = cv::Mat::zeros(cv::Size(width, height), CV_32FC1);
 
-    cv::parallel_for_(cv::Range(0, width * height), [&](const cv::Range &range)
-                      {
-                          for (int r = range.start; r < range.end; r++)
-                          {
-                              int y = r / width;
-                              int x = r % width;
-                              if (image_ad.at<float>(y, x) == 0)
-                                  continue;
+    parallelFor(cv::Range(0, width * height), [&](const cv::Range &range)
+                {
+                    for (int r = range.start; r < range.end; r++)
+                    {
+                        int y = r / width;
+                        int x = r % width;
+                        if (image_ad.at<float>(y, x) == 0)
+                            continue;
 
-                              image_ad_new.at<float>(y, x) = image_ad.at<float>(y, x) + delta_t * (image_d2xi.at<float>(y, x) + c * image_d2eta.at<float>(y, x));
-                          }
-                      });
+                        image_ad_new.at<float>(y, x) = image_ad.at<float>(y, x) + delta_t * (image_d2xi.at<float>(y, x) + c * image_d2eta.at<float>(y, x));
+                    }
+                },
+                num_threads);
 
     return image_ad_new;
 }
@@ -240,7 +245,7 @@ float maxDiff(const cv::Mat &mat1, const cv::Mat &mat2)
     return max_diff;
 }
 
-cv::Mat anisotropicDiffusionOMP(const cv::Mat &input_image, const float &delta_t, const float &c, const int &n_iter)
+cv::Mat anisotropicDiffusionOMP(const cv::Mat &input_image, const float &delta_t, const float &c, const int &n_iter, int num_threads)
 {
     /* initialize image_ad */
     cv::Mat image_ad;
@@ -248,17 +253,62 @@ cv::Mat anisotropicDiffusionOMP(const cv::Mat &input_image, const float &delta_t
     for (int i = 0; i < n_iter; i++)
     {
         cv::Mat image_dx, image_dy, image_dxx, image_dxy, image_dyy, image_d2xi, image_d2eta;
-        firstDerivativeOmp(image_ad, image_dx, image_dy);
-        secondDerivativeOmp(image_ad, image_dxx, image_dxy, image_dyy);
-        image_d2xi = derivative_d2I_d2xi(image_ad, image_dx, image_dy, image_dxx, image_dxy, image_dyy);
-        image_d2eta = derivative_d2I_d2eta(image_ad, image_dx, image_dy, image_dxx, image_dxy, image_dyy);
-        cv::Mat image_ad_updated = update(image_ad, image_d2xi, image_d2eta, delta_t, c);
+        firstDerivativeOmp(image_ad, image_dx, image_dy, num_threads);
+        secondDerivativeOmp(image_ad, image_dxx, image_dxy, image_dyy, num_threads);
+        image_d2xi = derivative_d2I_d2xi(image_ad, image_dx, image_dy, image_dxx, image_dxy, image_dyy, 10e-8, num_threads);
+        image_d2eta = derivative_d2I_d2eta(image_ad, image_dx, image_dy, image_dxx, image_dxy, image_dyy, 10e-8, num_threads);
+        cv::Mat image_ad_updated = update(image_ad, image_d2xi, image_d2eta, delta_t, c, num_threads);
         image_ad_updated.copyTo(image_ad);
     }
     return image_ad;
 }
 
-std::vector<cv::Mat> gradient(const cv::Mat &input_image)
+/*
+Same iterations as anisotropicDiffusionOMP, with the derivatives evaluated per pixel instead of stored as images:
+two buffers swapped between iterations instead of eight temporaries.
+*/
+cv::Mat anisotropicDiffusionPingPong(const cv::Mat &input_image, const float &delta_t, const float &c, const int &n_iter, int num_threads)
+{
+    const float epsilon = 10e-8;
+    int width = input_image.cols;
+    int height = input_image.rows;
+
+    cv::Mat image_ad, image_ad_new = cv::Mat::zeros(input_image.size(), CV_32FC1);
+    input_image.copyTo(image_ad);
+    for (int i = 0; i < n_iter; i++)
+    {
+        parallelFor(cv::Range(0, width * height), [&](const cv::Range &range)
+                    {
+                        for (int r = range.start; r < range.end; r++)
+                        {
+                            int y = r / width;
+                            int x = r % width;
+                            if (image_ad.at<float>(y, x) == 0)
+                            {
+                                image_ad_new.at<float>(y, x) = 0;
+                                continue;
+                            }
+
+                            float Ix, Iy, Ixx, Ixy, Iyy;
+                            opFirstDerivative(image_ad, x, y, width, height, Ix, Iy);
+                            opSecondDerivative(image_ad, x, y, width, height, Ixx, Ixy, Iyy);
+
+                            float Ix_pow_2 = Ix * Ix;
+                            float Iy_pow_2 = Iy * Iy;
+                            float denominator = Ix_pow_2 + Iy_pow_2 + epsilon;
+                            float d2xi = (Ixx * Iy_pow_2 - 2 * Ix * Iy * Ixy + Iyy * Ix_pow_2) / denominator;
+                            float d2eta = (Ixx * Iy_pow_2 + 2 * Ix * Iy * Ixy + Iyy * Ix_pow_2) / denominator;
+
+                            image_ad_new.at<float>(y, x) = image_ad.at<float>(y, x) + delta_t * (d2xi + c * d2eta);
+                        }
+                    },
+                    num_threads);
+        cv::swap(image_ad, image_ad_new);
+    }
+    return image_ad;
+}
+
+std::vector<cv::Mat> gradient(const cv::Mat &input_image, int num_threads)
 {
     std::vector<cv::Mat> mat_list;
     cv::Mat image_ad = cv::Mat::zeros(input_image.size(), CV_32FC1);
@@ -268,13 +318,13 @@ std::vector<cv::Mat> gradient(const cv::Mat &input_image)
     input_image.copyTo(image_ad);
 
     cv::Mat image_dx, image_dy;
-    firstDerivativeOmp(image_ad, image_dx, image_dy);
+    firstDerivativeOmp(image_ad, image_dx, image_dy, num_threads);
     mat_list.push_back(image_dx);
     mat_list.push_back(image_dy);
     return mat_list;
 }
 
-std::vector<cv::Mat> gradientSecond(const cv::Mat &input_image)
+std::vector<cv::Mat> gradientSecond(const cv::Mat &input_image, int num_threads)
 {
     std::vector<cv::Mat> mat_list;
     cv::Mat image_ad = cv::Mat::zeros(input_image.size(), CV_32FC1);
@@ -282,7 +332,7 @@ std::vector<cv::Mat> gradientSecond(const cv::Mat &input_image)
     /* initialize image_ad */
     input_image.copyTo(image_ad);
     cv::Mat image_dxx, image_dxy, image_dyy;
-    secondDerivativeOmp(image_ad, image_dxx, image_dxy, image_dyy);
+    secondDerivativeOmp(image_ad, image_dxx, image_dxy, image_dyy, num_threads);
     mat_list.push_back(image_dxx);
     mat_list.push_back(image_dxy);
     mat_list.push_back(image_dyy);
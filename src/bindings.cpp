@@ -1,27 +1,513 @@
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
 #include <string>
 #include "pybind11/pybind11.h"
+#include "pybind11/numpy.h"
 #include "ndarray_converter.h"
 #include "hjs.h"
+#include "hjs3d.h"
 #include "frame.h"
+#include "result_cache.h"
+#include "skeleton_executor.h"
 
 namespace py = pybind11;
 
+/*
+Hold a Python object from C++ code that may drop it on a thread without the GIL.
+*/
+static std::shared_ptr<py::object> keepAlive(const py::object &object)
+{
+    return std::shared_ptr<py::object>(
+        new py::object(object),
+        [](py::object *object)
+        {
+            py::gil_scoped_acquire gil;
+            delete object;
+        });
+}
+
+/*
+Wrap a 2D uint8/bool array into a BinaryFrame without copying.
+The array is kept alive by the frame; it is copied only if its rows are not unit-strided.
+Other dtypes go through the cv::Mat converter.
+*/
+static BinaryFrame makeBinaryFrame(const py::array &binary_image)
+{
+    py::dtype dtype = binary_image.dtype();
+    bool is_byte_mask = dtype.itemsize() == 1 && (dtype.kind() == 'u' || dtype.kind() == 'b');
+    if (!is_byte_mask || binary_image.ndim() != 2)
+        return BinaryFrame(binary_image.cast<cv::Mat>());
+
+    py::array buffer = binary_image;
+    if (binary_image.strides(1) != 1 || binary_image.strides(0) < binary_image.shape(1))
+        buffer = py::array_t<uint8_t, py::array::c_style | py::array::forcecast>::ensure(binary_image);
+
+    cv::Mat binary_mat(
+        static_cast<int>(buffer.shape(0)), static_cast<int>(buffer.shape(1)), CV_8UC1,
+        const_cast<void *>(buffer.data()), static_cast<size_t>(buffer.strides(0)));
+    return BinaryFrame(binary_mat, keepAlive(buffer));
+}
+
+/*
+Polygons as (N, 2) arrays of (x, y) vertices; frame_size: (height, width) of the frame to rasterize into
+*/
+static BinaryFrame makePolygonFrame(const py::list &polygons, const std::pair<int, int> &frame_size, float scale, int padding)
+{
+    std::vector<std::vector<cv::Point2f>> rings;
+    for (const py::handle &polygon : polygons)
+    {
+        py::array_t<float, py::array::c_style | py::array::forcecast> vertices = py::array_t<float, py::array::c_style | py::array::forcecast>::ensure(polygon);
+        if (!vertices || vertices.ndim() != 2 || vertices.shape(1) != 2)
+            throw std::invalid_argument("each polygon must be an (N, 2) array of (x, y) vertices");
+        const float *data = vertices.data();
+        rings.emplace_back();
+        for (py::ssize_t k = 0; k < vertices.shape(0); k++)
+            rings.back().push_back(cv::Point2f(data[2 * k], data[2 * k + 1]));
+    }
+    return BinaryFrame(rings, cv::Size(frame_size.second, frame_size.first), scale, padding);
+}
+
+/*
+COCO RLE dict {"size": [height, width], "counts": list of run lengths or compressed str/bytes}
+*/
+static RunLengthMask toRunLengthMask(const py::dict &rle)
+{
+    if (!rle.contains("size") || !rle.contains("counts"))
+        throw std::invalid_argument("RLE dict needs 'size' and 'counts'");
+    std::vector<int32_t> size = rle["size"].cast<std::vector<int32_t>>();
+    if (size.size() != 2)
+        throw std::invalid_argument("RLE 'size' must be [height, width]");
+
+    RunLengthMask mask;
+    mask.height = size[0];
+    mask.width = size[1];
+    py::object counts = rle["counts"];
+    if (py::isinstance<py::bytes>(counts) || py::isinstance<py::str>(counts))
+        decodeRunLengthString(counts.cast<std::string>(), mask.counts);
+    else
+        mask.counts = counts.cast<std::vector<uint32_t>>();
+    return mask;
+}
+
+/* compressed COCO RLE dict, as returned by pycocotools.mask.encode() */
+static py::object toRunLengthDict(const RunLengthMask &mask)
+{
+    if (mask.height == 0)
+        return py::none();
+    py::dict rle;
+    rle["size"] = py::make_tuple(mask.height, mask.width);
+    rle["counts"] = py::bytes(encodeRunLengthString(mask.counts));
+    return rle;
+}
+
+/*
+Expose a result image as a read-only NumPy array sharing its buffer.
+The capsule holds a reference to the cv::Mat, so the array stays valid after the next compute().
+*/
+static py::object toSharedArray(const cv::Mat &mat)
+{
+    if (mat.empty())
+        return py::none();
+
+    py::dtype dtype;
+    switch (mat.depth())
+    {
+    case CV_8U:
+        dtype = py::dtype::of<uint8_t>();
+        break;
+    case CV_32S:
+        dtype = py::dtype::of<int32_t>();
+        break;
+    case CV_32F:
+        dtype = py::dtype::of<float>();
+        break;
+    default:
+        throw std::runtime_error("unsupported result image depth");
+    }
+
+    cv::Mat *reference = new cv::Mat(mat);
+    py::capsule base(reference, [](void *reference)
+                     { delete static_cast<cv::Mat *>(reference); });
+    py::array array(
+        dtype,
+        {static_cast<py::ssize_t>(mat.rows), static_cast<py::ssize_t>(mat.cols)},
+        {static_cast<py::ssize_t>(mat.step[0]), static_cast<py::ssize_t>(mat.elemSize())},
+        mat.data, base);
+    array.attr("setflags")(py::arg("write") = false);
+    return array;
+}
+
+/* copy of a (D, H, W) array as a volume; nonzero voxels are the shape */
+static Volume<uint8_t> toMaskVolume(const py::array &mask_volume)
+{
+    if (mask_volume.ndim() != 3)
+        throw std::invalid_argument("mask_volume must be a (D, H, W) array");
+    py::array_t<uint8_t, py::array::c_style | py::array::forcecast> buffer = py::array_t<uint8_t, py::array::c_style | py::array::forcecast>::ensure(mask_volume);
+    Volume<uint8_t> volume(static_cast<int32_t>(buffer.shape(0)), static_cast<int32_t>(buffer.shape(1)), static_cast<int32_t>(buffer.shape(2)));
+    std::copy(buffer.data(), buffer.data() + volume.size(), volume.data.begin());
+    return volume;
+}
+
+/* a result volume as a read-only (D, H, W) array sharing its buffer, like toSharedArray() */
+template <typename T>
+static py::object toSharedVolume(const std::shared_ptr<const Volume<T>> &volume)
+{
+    if (!volume)
+        return py::none();
+    auto *reference = new std::shared_ptr<const Volume<T>>(volume);
+    py::capsule base(reference, [](void *reference)
+                     { delete static_cast<std::shared_ptr<const Volume<T>> *>(reference); });
+    py::array_t<T> array(
+        {static_cast<py::ssize_t>(volume->depth), static_cast<py::ssize_t>(volume->height), static_cast<py::ssize_t>(volume->width)},
+        volume->data.data(), base);
+    array.attr("setflags")(py::arg("write") = false);
+    return array;
+}
+
+/* copy of a point attribute; the point lists are small next to the images */
+template <typename T>
+static py::array_t<T> toArray(const std::vector<T> &values)
+{
+    return py::array_t<T>(static_cast<py::ssize_t>(values.size()), values.data());
+}
+
+/* skeleton points as a dict of parallel 1D arrays */
+static py::dict toPointDict(const SkeletonPoints &points)
+{
+    py::dict point_dict;
+    point_dict["x"] = toArray(points.x);
+    point_dict["y"] = toArray(points.y);
+    point_dict["radius"] = toArray(points.radius);
+    point_dict["flux"] = toArray(points.flux);
+    point_dict["arc_angle"] = toArray(points.arc_angle);
+    return point_dict;
+}
+
+/*
+{"num_points", "num_end_points", "num_junctions", "total_length", "branch_length", "branch_offsets", "width_profile",
+"radius_histogram"}; np.split(width_profile, branch_offsets[1:-1]) gives the profile of each branch
+*/
+static py::dict toDescriptorDict(const SkeletonDescriptors &descriptors)
+{
+    py::dict descriptor_dict;
+    descriptor_dict["num_points"] = descriptors.num_points;
+    descriptor_dict["num_end_points"] = descriptors.num_end_points;
+    descriptor_dict["num_junctions"] = descriptors.num_junctions;
+    descriptor_dict["total_length"] = descriptors.total_length;
+    descriptor_dict["branch_length"] = toArray(descriptors.branch_length);
+    descriptor_dict["branch_offsets"] = toArray(descriptors.branch_offsets);
+    descriptor_dict["width_profile"] = toArray(descriptors.width_profile);
+    descriptor_dict["radius_histogram"] = toArray(descriptors.radius_histogram);
+    return descriptor_dict;
+}
+
+/* {"peak_bytes", "estimated_bytes", "budget_bytes", "strategies", "stages": [{"name", "peak_bytes", "live_bytes"}]} */
+static py::dict toMemoryDict(const MemoryReport &report)
+{
+    py::list stages;
+    for (const MemoryStage &stage : report.stages)
+    {
+        py::dict stage_dict;
+        stage_dict["name"] = stage.name;
+        stage_dict["peak_bytes"] = stage.peak_bytes;
+        stage_dict["live_bytes"] = stage.live_bytes;
+        stages.append(stage_dict);
+    }
+
+    py::dict memory_dict;
+    memory_dict["peak_bytes"] = report.peak_bytes;
+    memory_dict["estimated_bytes"] = report.estimated_bytes;
+    memory_dict["budget_bytes"] = report.budget_bytes;
+    memory_dict["strategies"] = report.strategies;
+    memory_dict["stages"] = stages;
+    return memory_dict;
+}
+
+/* joining the workers may wait for callbacks that need the GIL */
+struct ExecutorDeleter
+{
+    void operator()(SkeletonExecutor *executor) const
+    {
+        py::gil_scoped_release release;
+        delete executor;
+    }
+};
+
+/*
+Queue a frame on the executor and return a concurrent.futures.Future resolved with a SkeletonResult.
+The parameters of skeletonizer are copied, so later set_parameters() calls do not affect queued frames.
+Cancelling the future drops the result; the frame is still computed.
+*/
+static py::object submitFrame(
+    SkeletonExecutor &executor, const HamiltonJacobiSkeleton &skeletonizer, const BinaryFrame &frame,
+    bool enable_anisotropic_diffusion, int outputs, const py::object &callback)
+{
+    py::object future = py::module::import("concurrent.futures").attr("Future")();
+    if (!callback.is_none())
+        future.attr("add_done_callback")(callback);
+
+    std::shared_ptr<py::object> target = keepAlive(future);
+    SkeletonExecutor::Callback on_done = [target](SkeletonResult &result, std::exception_ptr error)
+    {
+        py::gil_scoped_acquire gil;
+        try
+        {
+            if (!target->attr("set_running_or_notify_cancel")().cast<bool>())
+                return;
+            if (!error)
+            {
+                target->attr("set_result")(py::cast(std::move(result)));
+                return;
+            }
+
+            std::string message = "unknown error";
+            try
+            {
+                std::rethrow_exception(error);
+            }
+            catch (const std::exception &e)
+            {
+                message = e.what();
+            }
+            catch (...)
+            {
+            }
+            target->attr("set_exception")(py::module::import("builtins").attr("RuntimeError")(message));
+        }
+        catch (py::error_already_set &e)
+        {
+            e.restore();
+            PyErr_WriteUnraisable(target->ptr());
+        }
+    };
+
+    std::shared_ptr<const HamiltonJacobiSkeleton> snapshot = std::make_shared<HamiltonJacobiSkeleton>(skeletonizer);
+    {
+        /* submit() blocks while the queue is full */
+        py::gil_scoped_release release;
+        executor.submit(snapshot, frame, enable_anisotropic_diffusion, outputs, on_done);
+    }
+    return future;
+}
+
 PYBIND11_MODULE(pyhjs, m)
 {
     NDArrayConverter::init_numpy();
+    py::enum_<SkeletonOutput>(m, "Output", py::arithmetic())
+        .value("SKELETON", kOutputSkeleton)
+        .value("DISTANCE_TRANSFORM", kOutputDistanceTransform)
+        .value("FLUX", kOutputFlux)
+        .value("POINTS", kOutputPoints)
+        .value("RLE", kOutputRunLength)
+        .value("ARC_ANGLE", kOutputArcAngle)
+        .value("ALL", kOutputAll)
+        .value("DESCRIPTORS", kOutputDescriptors)
+        .value("REPRUNE", kOutputReprune);
+    py::enum_<DiffusionMode>(m, "DiffusionMode")
+        .value("TWO_PASS", kDiffusionTwoPass)
+        .value("SINGLE_PASS", kDiffusionSinglePass);
+    py::enum_<SkeletonEngine>(m, "SkeletonEngine")
+        .value("HAMILTON_JACOBI", kEngineHamiltonJacobi)
+        .value("GUO_HALL", kEngineGuoHall);
+    py::enum_<ThinningMode>(m, "ThinningMode")
+        .value("SERIAL", kThinningSerial)
+        .value("PARALLEL", kThinningParallel);
+    py::enum_<MedialStructure>(m, "MedialStructure")
+        .value("SURFACE", kMedialSurface)
+        .value("CURVE", kMedialCurve);
+    py::enum_<MemoryStrategy>(m, "MemoryStrategy", py::arithmetic())
+        .value("CROP", kMemoryCrop)
+        .value("PING_PONG_DIFFUSION", kMemoryPingPongDiffusion)
+        .value("BANDED_FLUX", kMemoryBandedFlux);
     py::class_<BinaryFrame>(m, "BinaryFrame")
         .def(
-            py::init<const cv::Mat &>(),
-            py::arg("binary_image"));
-    py::class_<HamiltonJacobiSkeleton>(m, "PyHJS")
+            py::init([](const py::dict &rle, int padding)
+                     { return BinaryFrame(toRunLengthMask(rle), padding); }),
+            py::arg("rle"),
+            py::arg("padding") = 4)
+        .def(
+            py::init(&makeBinaryFrame),
+            py::arg("binary_image"))
+        .def(
+            py::init(&makePolygonFrame),
+            py::arg("polygons"),    /// outer rings and holes, even-odd filled
+            py::arg("frame_size"),  /// (height, width)
+            py::arg("scale") = 1.0f,
+            py::arg("padding") = 4)
+        .def_property_readonly("roi", [](const BinaryFrame &frame)
+                               { return py::make_tuple(frame.roi.x, frame.roi.y, frame.roi.width, frame.roi.height); })
+        .def_property_readonly("frame_size", [](const BinaryFrame &frame)
+                               { return py::make_tuple(frame.frame_height, frame.frame_width); });
+    py::class_<ResultCache, std::shared_ptr<ResultCache>>(m, "ResultCache")
         .def(
-            py::init<float, float, float>(),
+            py::init<const std::string &, int64_t>(),
+            py::arg("directory"),
+            py::arg("max_bytes") = 0)  /// 0: unbounded
+        .def_property_readonly("directory", &ResultCache::getDirectory)
+        .def_property_readonly("max_bytes", &ResultCache::getMaxBytes)
+        .def_property_readonly("num_hits", &ResultCache::getNumHits)
+        .def_property_readonly("num_misses", &ResultCache::getNumMisses);
+    py::class_<SkeletonResult>(m, "SkeletonResult")
+        .def_property_readonly("skeleton_image", [](const SkeletonResult &result)
+                               { return toSharedArray(result.skeleton_image); })
+        .def_property_readonly("distance_transform_image", [](const SkeletonResult &result)
+                               { return toSharedArray(result.distance_transform_image); })
+        .def_property_readonly("flux_image", [](const SkeletonResult &result)
+                               { return toSharedArray(result.flux_image); })
+        .def_property_readonly("arc_angle_image", [](const SkeletonResult &result)
+                               { return toSharedArray(result.arc_angle_image); })
+        .def_property_readonly("points", [](const SkeletonResult &result)
+                               { return toPointDict(result.points); })
+        .def_property_readonly("skeleton_rle", [](const SkeletonResult &result)
+                               { return toRunLengthDict(result.skeleton_run_length); })
+        .def_property_readonly("descriptors", [](const SkeletonResult &result)
+                               { return toDescriptorDict(result.descriptors); })
+        .def_property_readonly("memory", [](const SkeletonResult &result)
+                               { return toMemoryDict(result.memory); });
+    py::class_<SkeletonExecutor, std::unique_ptr<SkeletonExecutor, ExecutorDeleter>>(m, "Executor")
+        .def(
+            py::init<int, int, bool>(),
+            py::arg("num_workers") = 0,  /// 0: hardware concurrency
+            py::arg("max_pending") = 0,  /// 0: twice the number of workers
+            py::arg("ordered") = false)  /// deliver results in submission order
+        .def(
+            "submit",
+            &submitFrame,
+            py::arg("skeletonizer"),
+            py::arg("frame"),
+            py::arg("enable_anisotropic_diffusion") = true,
+            py::arg("outputs") = static_cast<int>(kOutputAll),
+            py::arg("callback") = py::none())
+        .def("wait", &SkeletonExecutor::wait, py::call_guard<py::gil_scoped_release>())
+        .def("shutdown", &SkeletonExecutor::shutdown, py::call_guard<py::gil_scoped_release>())
+        .def("__enter__", [](py::object self)
+             { return self; })
+        .def("__exit__", [](SkeletonExecutor &executor, py::args)
+             {
+                 py::gil_scoped_release release;
+                 executor.shutdown();
+             })
+        .def_property_readonly("num_workers", &SkeletonExecutor::getNumWorkers)
+        .def_property_readonly("max_pending", &SkeletonExecutor::getMaxPending)
+        .def_property_readonly("ordered", &SkeletonExecutor::isOrdered);
+    py::class_<HamiltonJacobiSkeleton>(m, "PyHJS", py::dynamic_attr())
+        .def(
+            py::init<float, float, float, int>(),
             py::arg("gamma") = 2.5,
             py::arg("epsilon") = 1.0,
-            py::arg("threshold_arc_angle_inscribed_circle") = 0)  /// default is desabled
-        .def("compute", &HamiltonJacobiSkeleton::compute, py::arg("frame"), py::arg("enable_anisotropic_diffusion")=true)
+            py::arg("threshold_arc_angle_inscribed_circle") = 0,  /// default is desabled
+            py::arg("num_threads") = 0)                           /// 0: OpenCV's shared thread pool
+        .def(
+            "compute",
+            &HamiltonJacobiSkeleton::compute,
+            py::arg("frame"),
+            py::arg("enable_anisotropic_diffusion") = true,
+            py::arg("outputs") = static_cast<int>(kOutputAll),
+            py::call_guard<py::gil_scoped_release>())
+        .def("set_num_threads", &HamiltonJacobiSkeleton::setNumThreads, py::arg("num_threads"))
+        .def("get_num_threads", &HamiltonJacobiSkeleton::getNumThreads)
+        .def("set_diffusion_mode", &HamiltonJacobiSkeleton::setDiffusionMode, py::arg("diffusion_mode"))
+        .def("get_diffusion_mode", &HamiltonJacobiSkeleton::getDiffusionMode)
+        .def("set_skeleton_engine", &HamiltonJacobiSkeleton::setSkeletonEngine, py::arg("skeleton_engine"))
+        .def("get_skeleton_engine", &HamiltonJacobiSkeleton::getSkeletonEngine)
+        .def("set_thinning_mode", &HamiltonJacobiSkeleton::setThinningMode, py::arg("thinning_mode"), py::arg("flux_band") = 0.1f)
+        .def("get_thinning_mode", &HamiltonJacobiSkeleton::getThinningMode)
+        .def("get_thinning_flux_band", &HamiltonJacobiSkeleton::getThinningFluxBand)
+        .def("set_coarse_to_fine", &HamiltonJacobiSkeleton::setCoarseToFine, py::arg("factor"), py::arg("radius") = 0)
+        .def("get_coarse_to_fine_factor", &HamiltonJacobiSkeleton::getCoarseToFineFactor)
+        .def("get_coarse_to_fine_radius", &HamiltonJacobiSkeleton::getCoarseToFineRadius)
+        .def("set_memory_budget", &HamiltonJacobiSkeleton::setMemoryBudget, py::arg("budget_bytes"))  /// 0: no budget
+        .def("get_memory_budget", &HamiltonJacobiSkeleton::getMemoryBudget)
+        .def("set_memory_tracking", &HamiltonJacobiSkeleton::setMemoryTracking, py::arg("enable"))
+        .def("get_memory_tracking", &HamiltonJacobiSkeleton::getMemoryTracking)
+        .def("set_result_cache", &HamiltonJacobiSkeleton::setResultCache, py::arg("cache").none(true))  /// None: no cache
+        .def("get_result_cache", &HamiltonJacobiSkeleton::getResultCache)
+        .def(
+            "estimate_memory",
+            &HamiltonJacobiSkeleton::estimateMemory,
+            py::arg("frame"),
+            py::arg("enable_anisotropic_diffusion") = true,
+            py::arg("outputs") = static_cast<int>(kOutputAll),
+            py::arg("strategies") = 0)
         .def("set_parameters", &HamiltonJacobiSkeleton::setParameters)
-        .def("get_skeleton_image", &HamiltonJacobiSkeleton::getSkeletonImage)
-        .def("get_distance_transform_image", &HamiltonJacobiSkeleton::getDistanceTransformImage)
-        .def("get_flux_image", &HamiltonJacobiSkeleton::getFluxImage);
+        .def(
+            "reprune",
+            &HamiltonJacobiSkeleton::reprune,
+            py::arg("threshold_arc_angle_inscribed_circle"),
+            py::call_guard<py::gil_scoped_release>())
+        .def(
+            "set_branch_pruning_parameters",
+            &HamiltonJacobiSkeleton::setBranchPruningParameters,
+            py::arg("threshold_branch_length"),
+            py::arg("threshold_branch_salience") = 0,
+            py::arg("threshold_branch_radius_ratio") = 0)
+        .def(
+            "submit",
+            [](py::object self, const BinaryFrame &frame, bool enable_anisotropic_diffusion, int outputs, const py::object &callback)
+            {
+                /* the default executor is created on first use and kept as the "executor" attribute */
+                py::object executor = py::getattr(self, "executor", py::none());
+                if (executor.is_none())
+                {
+                    executor = py::module::import("pyhjs").attr("Executor")();
+                    py::setattr(self, "executor", executor);
+                }
+                return submitFrame(
+                    executor.cast<SkeletonExecutor &>(), self.cast<const HamiltonJacobiSkeleton &>(), frame,
+                    enable_anisotropic_diffusion, outputs, callback);
+            },
+            py::arg("frame"),
+            py::arg("enable_anisotropic_diffusion") = true,
+            py::arg("outputs") = static_cast<int>(kOutputAll),
+            py::arg("callback") = py::none())
+        .def("get_skeleton_image", [](const HamiltonJacobiSkeleton &hjs)
+             { return toSharedArray(hjs.getSkeletonImage()); })
+        .def("get_distance_transform_image", [](const HamiltonJacobiSkeleton &hjs)
+             { return toSharedArray(hjs.getDistanceTransformImage()); })
+        .def("get_flux_image", [](const HamiltonJacobiSkeleton &hjs)
+             { return toSharedArray(hjs.getFluxImage()); })
+        .def("get_arc_angle_image", [](const HamiltonJacobiSkeleton &hjs)
+             { return toSharedArray(hjs.getArcAngleImage()); })
+        .def("get_skeleton_points", [](const HamiltonJacobiSkeleton &hjs)
+             { return toPointDict(hjs.getSkeletonPoints()); })
+        .def("get_skeleton_rle", [](const HamiltonJacobiSkeleton &hjs)
+             { return toRunLengthDict(hjs.getSkeletonRunLength()); })
+        .def("get_skeleton_descriptors", [](const HamiltonJacobiSkeleton &hjs)
+             { return toDescriptorDict(hjs.getSkeletonDescriptors()); })
+        .def("get_memory_report", [](const HamiltonJacobiSkeleton &hjs)
+             { return toMemoryDict(hjs.getMemoryReport()); });
+    py::class_<HamiltonJacobiSkeleton3D>(m, "PyHJS3D")
+        .def(
+            py::init<float, int>(),
+            py::arg("gamma") = 2.5,
+            py::arg("num_threads") = 0)  /// 0: OpenCV's shared thread pool
+        .def(
+            "compute",
+            [](HamiltonJacobiSkeleton3D &hjs, const py::array &mask_volume, int outputs)
+            {
+                Volume<uint8_t> volume = toMaskVolume(mask_volume);
+                py::gil_scoped_release release;
+                hjs.compute(volume, outputs);
+            },
+            py::arg("mask_volume"),  /// (D, H, W), nonzero on the shape
+            py::arg("outputs") = static_cast<int>(kOutputSkeleton | kOutputDistanceTransform | kOutputFlux))
+        .def("set_parameters", &HamiltonJacobiSkeleton3D::setParameters, py::arg("gamma"))
+        .def("set_num_threads", &HamiltonJacobiSkeleton3D::setNumThreads, py::arg("num_threads"))
+        .def("get_num_threads", &HamiltonJacobiSkeleton3D::getNumThreads)
+        .def("set_medial_structure", &HamiltonJacobiSkeleton3D::setMedialStructure, py::arg("medial_structure"))
+        .def("get_medial_structure", &HamiltonJacobiSkeleton3D::getMedialStructure)
+        .def(
+            "set_thinning_mode",
+            &HamiltonJacobiSkeleton3D::setThinningMode,
+            py::arg("thinning_mode"),
+            py::arg("flux_band") = 0.0125f)
+        .def("get_thinning_mode", &HamiltonJacobiSkeleton3D::getThinningMode)
+        .def("get_thinning_flux_band", &HamiltonJacobiSkeleton3D::getThinningFluxBand)
+        .def("get_skeleton_image", [](const HamiltonJacobiSkeleton3D &hjs)
+             { return toSharedVolume(hjs.getSkeletonVolume()); })
+        .def("get_distance_transform_image", [](const HamiltonJacobiSkeleton3D &hjs)
+             { return toSharedVolume(hjs.getDistanceTransformVolume()); })
+        .def("get_flux_image", [](const HamiltonJacobiSkeleton3D &hjs)
+             { return toSharedVolume(hjs.getFluxVolume()); });
 }
@@ -0,0 +1,143 @@
+#include "descriptors.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+/*
+Descriptors of the circles kept by the pruning (minus the pixels removed by the branch pruning if skeleton_image is
+given, as collectSkeletonPoints()), in one pass over the skeleton pixels: their radius comes with the circles, so
+neither the skeleton nor the distance transform is scanned densely. Neighbours are found in an index image of the
+bounding box of the pixels, padded by one so that no lookup needs a bounds check.
+*/
+void describeSkeleton(const InscribedCircles &circles, const cv::Mat &skeleton_image, SkeletonDescriptors &descriptors) {
+    descriptors = SkeletonDescriptors();
+
+    /// skeleton pixels in raster order (the order of the circles)
+    std::vector<cv::Point> points;
+    std::vector<float> radius;
+    int32_t x_min = std::numeric_limits<int32_t>::max(), x_max = -1, y_min = std::numeric_limits<int32_t>::max(), y_max = -1;
+    for (size_t index = 0; index < circles.size(); index++) {
+        if (circles.is_sprious[index]) continue;
+        int32_t x = circles.center_x[index];
+        int32_t y = circles.center_y[index];
+        if (!skeleton_image.empty() && skeleton_image.at<uchar>(y, x) == 0) continue;
+        points.push_back(cv::Point(x, y));
+        radius.push_back(circles.radius[index]);
+        x_min = std::min(x_min, x);
+        x_max = std::max(x_max, x);
+        y_min = std::min(y_min, y);
+        y_max = std::max(y_max, y);
+    }
+    int32_t num_points = static_cast<int32_t>(points.size());
+    descriptors.num_points = num_points;
+    descriptors.branch_offsets.push_back(0);
+    if (num_points == 0) return;
+
+    cv::Mat index_image(y_max - y_min + 3, x_max - x_min + 3, CV_32S, cv::Scalar(-1));
+    cv::Point origin(x_min - 1, y_min - 1);
+    for (int32_t index = 0; index < num_points; index++) index_image.at<int32_t>(points[index] - origin) = index;
+    auto pixel = [&](const int32_t &index, const int32_t &kx, const int32_t &ky) {
+        return index_image.at<int32_t>(points[index].y - origin.y + ky, points[index].x - origin.x + kx);
+    };
+    /// index of the neighbour at (kx, ky), or -1 if there is none or the step cuts the corner of two axial steps
+    auto neighbor = [&](const int32_t &index, const int32_t &kx, const int32_t &ky) {
+        if (kx == 0 && ky == 0) return int32_t(-1);
+        if (kx != 0 && ky != 0 && (pixel(index, kx, 0) >= 0 || pixel(index, 0, ky) >= 0)) return int32_t(-1);
+        return pixel(index, kx, ky);
+    };
+
+    std::vector<uint8_t> is_junction(num_points);
+    for (int32_t index = 0; index < num_points; index++) {
+        int32_t degree = 0;
+        for (int32_t ky = -1; ky <= 1; ky++)
+            for (int32_t kx = -1; kx <= 1; kx++) degree += neighbor(index, kx, ky) >= 0;
+        is_junction[index] = degree > 2;
+        descriptors.num_end_points += degree <= 1;
+    }
+
+    /// branches and junction clusters: connect each pixel to its already visited neighbours of the same kind
+    DisjointSet disjoint_set(num_points);
+    const int32_t kx_list[4] = {-1, -1, 0, 1};
+    const int32_t ky_list[4] = {0, -1, -1, -1};
+    for (int32_t index = 0; index < num_points; index++) {
+        for (int32_t k = 0; k < 4; k++) {
+            int32_t other = neighbor(index, kx_list[k], ky_list[k]);
+            if (other >= 0 && is_junction[other] == is_junction[index]) disjoint_set.unite(index, other);
+        }
+    }
+
+    /// branches numbered in the raster order of their first pixel
+    std::vector<int32_t> branch_of_root(num_points, -1);
+    for (int32_t index = 0; index < num_points; index++) {
+        int32_t root = disjoint_set.find(index);
+        if (is_junction[index]) {
+            descriptors.num_junctions += root == index;
+        } else if (branch_of_root[root] < 0) {
+            branch_of_root[root] = static_cast<int32_t>(descriptors.branch_length.size());
+            descriptors.branch_length.push_back(0);
+        }
+    }
+    int32_t num_branches = static_cast<int32_t>(descriptors.branch_length.size());
+
+    /// each step once, from a pixel to its following neighbours; a step counts for the branch of its non-junction end
+    const float kDiagonalStep = std::sqrt(2.f);
+    double total_length = 0;
+    for (int32_t index = 0; index < num_points; index++) {
+        for (int32_t k = 0; k < 4; k++) {
+            int32_t kx = -kx_list[k], ky = -ky_list[k];
+            int32_t other = neighbor(index, kx, ky);
+            if (other < 0) continue;
+            float step = (kx != 0 && ky != 0) ? kDiagonalStep : 1.f;
+            total_length += step;
+            int32_t owner = !is_junction[index] ? index : (!is_junction[other] ? other : -1);
+            if (owner >= 0) descriptors.branch_length[branch_of_root[disjoint_set.find(owner)]] += step;
+        }
+    }
+    descriptors.total_length = static_cast<float>(total_length);
+
+    /*
+    Width profiles: a branch has at most two neighbours per pixel within it, so a walk from one of its ends
+    (its first pixel in raster order if it is a loop) visits all its pixels in order along the axis.
+    */
+    std::vector<int32_t> first_pixel(num_branches, -1), first_end(num_branches, -1);
+    for (int32_t index = 0; index < num_points; index++) {
+        if (is_junction[index]) continue;
+        int32_t branch = branch_of_root[disjoint_set.find(index)];
+        int32_t branch_degree = 0;
+        for (int32_t ky = -1; ky <= 1; ky++) {
+            for (int32_t kx = -1; kx <= 1; kx++) {
+                int32_t other = neighbor(index, kx, ky);
+                branch_degree += other >= 0 && !is_junction[other];
+            }
+        }
+        if (first_pixel[branch] < 0) first_pixel[branch] = index;
+        if (first_end[branch] < 0 && branch_degree <= 1) first_end[branch] = index;
+    }
+
+    descriptors.width_profile.reserve(num_points);
+    descriptors.branch_offsets.reserve(num_branches + 1);
+    std::vector<uint8_t> is_visited(num_points, 0);
+    for (int32_t branch = 0; branch < num_branches; branch++) {
+        int32_t index = (first_end[branch] >= 0) ? first_end[branch] : first_pixel[branch];
+        while (index >= 0) {
+            is_visited[index] = 1;
+            descriptors.width_profile.push_back(2 * radius[index]);
+            int32_t next = -1;
+            for (int32_t ky = -1; ky <= 1 && next < 0; ky++) {
+                for (int32_t kx = -1; kx <= 1 && next < 0; kx++) {
+                    int32_t other = neighbor(index, kx, ky);
+                    if (other >= 0 && !is_junction[other] && !is_visited[other]) next = other;
+                }
+            }
+            index = next;
+        }
+        descriptors.branch_offsets.push_back(static_cast<int32_t>(descriptors.width_profile.size()));
+    }
+
+    float radius_max = *std::max_element(radius.begin(), radius.end());
+    descriptors.radius_histogram.assign(static_cast<size_t>(std::max(radius_max, 0.f)) + 1, 0);
+    for (float point_radius : radius) descriptors.radius_histogram[static_cast<size_t>(std::max(point_radius, 0.f))]++;
+}
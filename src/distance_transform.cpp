@@ -0,0 +1,88 @@
+#include "distance_transform.h"
+
+#include "parallel.h"
+
+#include <cmath>
+#include <limits>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+/*
+Exact Euclidean distance transform with feature transform (Felzenszwalb & Huttenlocher, separable).
+distance_image (CV_32F) holds the distance of each pixel to the nearest zero pixel of mask_image and
+feature_image (CV_32S) the raster index (y * width + x) of that zero pixel, or -1 if the mask has no zero pixel.
+Columns are processed in parallel, then rows, on at most num_threads threads (see parallelFor()).
+*/
+void distanceTransformExact(const cv::Mat &mask_image, cv::Mat &distance_image, cv::Mat &feature_image, int num_threads) {
+    CV_Assert(mask_image.type() == CV_8UC1);
+    int32_t width = mask_image.cols;
+    int32_t height = mask_image.rows;
+    const int32_t kNoFeature = -1;
+
+    /* vertical pass: distance to and row of the nearest zero pixel in the same column */
+    cv::Mat column_distance(cv::Size(width, height), CV_32S);
+    cv::Mat column_feature(cv::Size(width, height), CV_32S);
+    parallelFor(cv::Range(0, width), [&](const cv::Range &range) {
+        for (int32_t x = range.start; x < range.end; x++) {
+            int32_t last_zero = kNoFeature;
+            for (int32_t y = 0; y < height; y++) {
+                if (mask_image.at<uchar>(y, x) == 0) last_zero = y;
+                column_feature.at<int32_t>(y, x) = last_zero;
+            }
+            last_zero = kNoFeature;
+            for (int32_t y = height - 1; y >= 0; y--) {
+                if (mask_image.at<uchar>(y, x) == 0) last_zero = y;
+                int32_t feature_y = column_feature.at<int32_t>(y, x);
+                if (last_zero != kNoFeature && (feature_y == kNoFeature || last_zero - y < y - feature_y)) feature_y = last_zero;
+                column_feature.at<int32_t>(y, x) = feature_y;
+                column_distance.at<int32_t>(y, x) = (feature_y == kNoFeature) ? kNoFeature : std::abs(y - feature_y);
+            }
+        }
+    }, num_threads);
+
+    /* horizontal pass: lower envelope of the parabolas (x - q)^2 + column_distance(q)^2 */
+    distance_image.create(cv::Size(width, height), CV_32F);
+    feature_image.create(cv::Size(width, height), CV_32S);
+    float no_feature_distance = std::sqrt(float(width) * width + float(height) * height);
+    parallelFor(cv::Range(0, height), [&](const cv::Range &range) {
+        std::vector<int32_t> sites(width);
+        std::vector<double> boundaries(width + 1);
+        for (int32_t y = range.start; y < range.end; y++) {
+            const int32_t *g = column_distance.ptr<int32_t>(y);
+            auto f = [&](const int32_t &q) { return double(q) * q + double(g[q]) * g[q]; };
+
+            int32_t k = -1;
+            for (int32_t q = 0; q < width; q++) {
+                if (g[q] == kNoFeature) continue;
+                double s = -std::numeric_limits<double>::infinity();
+                while (k >= 0) {
+                    s = (f(q) - f(sites[k])) / (2.0 * (q - sites[k]));
+                    if (s > boundaries[k]) break;
+                    k--;
+                }
+                k++;
+                sites[k] = q;
+                boundaries[k] = (k == 0) ? -std::numeric_limits<double>::infinity() : s;
+                boundaries[k + 1] = std::numeric_limits<double>::infinity();
+            }
+
+            float *distance_row = distance_image.ptr<float>(y);
+            int32_t *feature_row = feature_image.ptr<int32_t>(y);
+            if (k < 0) {
+                for (int32_t x = 0; x < width; x++) {
+                    distance_row[x] = no_feature_distance;
+                    feature_row[x] = kNoFeature;
+                }
+                continue;
+            }
+            int32_t j = 0;
+            for (int32_t x = 0; x < width; x++) {
+                while (boundaries[j + 1] < x) j++;
+                int32_t q = sites[j];
+                int64_t dx = x - q, dy = g[q];  // dx * dx + dy * dy overflows int32 beyond 46340 pixels
+                distance_row[x] = std::sqrt(float(dx * dx + dy * dy));
+                feature_row[x] = column_feature.at<int32_t>(y, q) * width + q;
+            }
+        }
+    }, num_threads);
+}
@@ -0,0 +1,123 @@
+#include "guo_hall.h"
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace {
+
+/*
+Guo-Hall deletion rule of each sub-iteration for every 8-neighbourhood; bit k of the index is neighbour k
+clockwise from the top left (NW, N, NE, E, SE, S, SW, W), i.e. p9, p2, p3, ..., p8 in the notation of the paper
+*/
+struct GuoHallTable {
+    bool remove[2][256];
+
+    GuoHallTable() {
+        for (int32_t code = 0; code < 256; code++) {
+            auto p = [code](int32_t k) { return (code >> k) & 1; };
+            int32_t p9 = p(0), p2 = p(1), p3 = p(2), p4 = p(3), p5 = p(4), p6 = p(5), p7 = p(6), p8 = p(7);
+            int32_t connectivity = ((1 - p2) & (p3 | p4)) + ((1 - p4) & (p5 | p6)) + ((1 - p6) & (p7 | p8)) + ((1 - p8) & (p9 | p2));
+            int32_t n1 = (p9 | p2) + (p3 | p4) + (p5 | p6) + (p7 | p8);
+            int32_t n2 = (p2 | p3) + (p4 | p5) + (p6 | p7) + (p8 | p9);
+            int32_t num_neighbors = std::min(n1, n2);
+            bool candidate = connectivity == 1 && num_neighbors >= 2 && num_neighbors <= 3;
+            remove[0][code] = candidate && ((p6 | p7 | (1 - p9)) & p8) == 0;
+            remove[1][code] = candidate && ((p2 | p3 | (1 - p5)) & p4) == 0;
+        }
+    }
+};
+
+const int32_t kBitsPerWord = 64;
+
+}  // namespace
+
+/*
+Guo-Hall parallel thinning (Guo & Hall 1989, algorithm A2) of the pixels of mask_image above threshold into a
+one pixel wide, 8-connected skeleton with the topology of the shape. skeleton_image: CV_8U, 1 on the skeleton.
+Rows are packed 64 pixels to a word: the neighbours of 64 pixels are shifted words, which rule out empty and
+interior pixels a word at a time; the neighbourhood of each remaining border pixel is looked up in a table. Each sub-iteration marks the deletions of all rows in
+parallel, then applies them; rows whose neighbourhood did not change since the last sub-iteration of the same
+kind are skipped. The result does not depend on num_threads.
+*/
+void guoHallThinning(const cv::Mat &mask_image, cv::Mat &skeleton_image, int threshold, int num_threads) {
+    CV_Assert(mask_image.type() == CV_8UC1);
+    static const GuoHallTable table;
+    int32_t width = mask_image.cols;
+    int32_t height = mask_image.rows;
+
+    /* one zero word left and right of every row and one zero row above and below the image */
+    int32_t num_words = (width + kBitsPerWord - 1) / kBitsPerWord;
+    int32_t stride = num_words + 2;
+    std::vector<uint64_t> pixels(size_t(stride) * (height + 2), 0), deletions(pixels.size(), 0);
+    auto row = [&](std::vector<uint64_t> &words, int32_t y) { return words.data() + size_t(stride) * (y + 1) + 1; };
+    for (int32_t y = 0; y < height; y++) {
+        const uchar *mask_row = mask_image.ptr<uchar>(y);
+        uint64_t *words = row(pixels, y);
+        for (int32_t x = 0; x < width; x++) {
+            if (mask_row[x] > threshold) words[x / kBitsPerWord] |= uint64_t(1) << (x % kBitsPerWord);
+        }
+    }
+
+    /* changed[t % 2][y]: row y lost pixels in sub-iteration t */
+    std::vector<uchar> changed[2] = {std::vector<uchar>(height, 1), std::vector<uchar>(height, 1)};
+    for (int32_t iteration = 0;; iteration++) {
+        int32_t sub_iteration = iteration % 2;
+        const std::vector<uchar> &last = changed[1 - sub_iteration];
+        const std::vector<uchar> &before_last = changed[sub_iteration];
+        std::vector<uchar> current(height, 0);
+
+        parallelFor(cv::Range(0, height), [&](const cv::Range &range) {
+            for (int32_t y = range.start; y < range.end; y++) {
+                bool active = iteration < 2;
+                for (int32_t ky = std::max(0, y - 1); ky <= std::min(height - 1, y + 1) && !active; ky++) active = last[ky] || before_last[ky];
+                if (!active) continue;
+
+                const uint64_t *above = row(pixels, y - 1), *center = row(pixels, y), *below = row(pixels, y + 1);
+                uint64_t *marked = row(deletions, y);
+                for (int32_t j = 0; j < num_words; j++) {
+                    marked[j] = 0;
+                    if (!center[j]) continue;
+
+                    /* bit i of each word: the neighbour of pixel i of the center word */
+                    const uint64_t neighbors[8] = {
+                        (above[j] << 1) | (above[j - 1] >> 63), above[j], (above[j] >> 1) | (above[j + 1] << 63),
+                        (center[j] >> 1) | (center[j + 1] << 63), (below[j] >> 1) | (below[j + 1] << 63), below[j],
+                        (below[j] << 1) | (below[j - 1] >> 63), (center[j] << 1) | (center[j - 1] >> 63)};
+                    /* pixels with all eight neighbours are never deleted: only the border pixels are looked up */
+                    uint64_t interior = neighbors[0] & neighbors[1] & neighbors[2] & neighbors[3] & neighbors[4] & neighbors[5] & neighbors[6] & neighbors[7];
+                    uint64_t remaining = center[j] & ~interior;
+                    while (remaining) {
+                        int32_t bit = __builtin_ctzll(remaining);
+                        remaining &= remaining - 1;
+                        int32_t code = 0;
+                        for (int32_t k = 0; k < 8; k++) code |= int32_t((neighbors[k] >> bit) & 1) << k;
+                        if (table.remove[sub_iteration][code]) marked[j] |= uint64_t(1) << bit;
+                    }
+                    if (marked[j]) current[y] = 1;
+                }
+            }
+        }, num_threads);
+
+        bool any_change = false;
+        for (int32_t y = 0; y < height; y++) {
+            if (!current[y]) continue;
+            any_change = true;
+            uint64_t *words = row(pixels, y);
+            const uint64_t *marked = row(deletions, y);
+            for (int32_t j = 0; j < num_words; j++) words[j] &= ~marked[j];
+        }
+        changed[sub_iteration] = current;
+        if (!any_change && std::find(last.begin(), last.end(), 1) == last.end()) break;
+    }
+
+    skeleton_image = cv::Mat::zeros(mask_image.size(), CV_8UC1);
+    for (int32_t y = 0; y < height; y++) {
+        uchar *skeleton_row = skeleton_image.ptr<uchar>(y);
+        const uint64_t *words = row(pixels, y);
+        for (int32_t x = 0; x < width; x++) skeleton_row[x] = (words[x / kBitsPerWord] >> (x % kBitsPerWord)) & 1;
+    }
+}
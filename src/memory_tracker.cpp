@@ -0,0 +1,121 @@
+#include "memory_tracker.h"
+
+#include <mutex>
+#include <opencv2/opencv.hpp>
+
+#if CV_MAJOR_VERSION >= 4
+typedef cv::AccessFlag MatAccessFlag;
+#else
+typedef int MatAccessFlag;
+#endif
+
+namespace {
+
+thread_local MemoryTracker *current_tracker = nullptr;
+
+void updateMaximum(std::atomic<int64_t> &maximum, int64_t value) {
+    int64_t previous = maximum.load();
+    while (previous < value && !maximum.compare_exchange_weak(previous, value)) {
+    }
+}
+
+/*
+cv::Mat::getStdAllocator() with accounting: a buffer allocated while a tracker is current keeps a reference to
+the counters of that tracker in UMatData::userdata and is credited back to them on release.
+*/
+class TrackingMatAllocator : public cv::MatAllocator {
+   public:
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data0, size_t *step, MatAccessFlag,
+                           cv::UMatUsageFlags) const override {
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; i--) {
+            if (step) {
+                if (data0 && step[i] != CV_AUTOSTEP) {
+                    CV_Assert(total <= step[i]);
+                    total = step[i];
+                } else {
+                    step[i] = total;
+                }
+            }
+            total *= sizes[i];
+        }
+
+        uchar *data = data0 ? static_cast<uchar *>(data0) : static_cast<uchar *>(cv::fastMalloc(total));
+        cv::UMatData *u = new cv::UMatData(this);
+        u->data = u->origdata = data;
+        u->size = total;
+        if (data0) {
+            u->flags |= cv::UMatData::USER_ALLOCATED;
+        } else if (current_tracker) {
+            std::shared_ptr<MemoryTracker::Counters> *counters =
+                new std::shared_ptr<MemoryTracker::Counters>(current_tracker->getCounters());
+            int64_t live = ((*counters)->live += static_cast<int64_t>(total));
+            updateMaximum((*counters)->peak, live);
+            updateMaximum((*counters)->stage_peak, live);
+            u->userdata = counters;
+        }
+        return u;
+    }
+
+    bool allocate(cv::UMatData *u, MatAccessFlag, cv::UMatUsageFlags) const override { return u != nullptr; }
+
+    void deallocate(cv::UMatData *u) const override {
+        if (!u) return;
+        CV_Assert(u->urefcount == 0 && u->refcount == 0);
+        if (u->userdata) {
+            std::shared_ptr<MemoryTracker::Counters> *counters = static_cast<std::shared_ptr<MemoryTracker::Counters> *>(u->userdata);
+            (*counters)->live -= static_cast<int64_t>(u->size);
+            delete counters;
+            u->userdata = nullptr;
+        }
+        if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+            cv::fastFree(u->origdata);
+            u->origdata = 0;
+        }
+        delete u;
+    }
+};
+
+void installTrackingAllocator() {
+    static std::once_flag installed;
+    std::call_once(installed, [] {
+        static TrackingMatAllocator allocator;
+        cv::Mat::setDefaultAllocator(&allocator);
+    });
+}
+
+}  // namespace
+
+MemoryTracker::Scope::Scope(MemoryTracker *tracker) : previous_(current_tracker) { current_tracker = tracker; }
+
+MemoryTracker::Scope::~Scope() { current_tracker = previous_; }
+
+MemoryTracker::MemoryTracker() : counters_(std::make_shared<Counters>()), stage_open_(false), scope_((installTrackingAllocator(), this)) {}
+
+MemoryTracker::~MemoryTracker() {}
+
+MemoryTracker *MemoryTracker::current() { return current_tracker; }
+
+void MemoryTracker::beginStage(const std::string &name) {
+    closeStage();
+    MemoryStage stage;
+    stage.name = name;
+    stage.peak_bytes = 0;
+    stage.live_bytes = 0;
+    stages_.push_back(stage);
+    counters_->stage_peak = counters_->live.load();
+    stage_open_ = true;
+}
+
+void MemoryTracker::finish(MemoryReport &report) {
+    closeStage();
+    report.peak_bytes = counters_->peak;
+    report.stages = stages_;
+}
+
+void MemoryTracker::closeStage() {
+    if (!stage_open_) return;
+    stages_.back().peak_bytes = counters_->stage_peak;
+    stages_.back().live_bytes = counters_->live;
+    stage_open_ = false;
+}
@@ -0,0 +1,171 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "memory_tracker.h"
+
+namespace {
+
+thread_local ThreadPool *current_pool = nullptr;
+
+}  // namespace
+
+struct ThreadPool::Job {
+    const std::function<void(int32_t)> *task;
+    int32_t num_tasks;
+    std::atomic<int32_t> next_task;
+    int num_helpers, max_helpers;  // guarded by mutex_
+    std::exception_ptr exception;  // guarded by mutex_
+    MemoryTracker *tracker;        // of the caller, current in the helpers
+};
+
+ThreadPool::Scope::Scope(ThreadPool *pool) : previous_(current_pool) { current_pool = pool; }
+
+ThreadPool::Scope::~Scope() { current_pool = previous_; }
+
+ThreadPool *ThreadPool::current() { return current_pool; }
+
+ThreadPool::ThreadPool(int num_threads) : stopping_(false) {
+    for (int k = 0; k < num_threads - 1; k++) workers_.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    job_posted_.notify_all();
+    for (std::thread &worker : workers_) worker.join();
+}
+
+void ThreadPool::run(int32_t num_tasks, const std::function<void(int32_t)> &task, int max_helpers) {
+    Job job;
+    job.task = &task;
+    job.num_tasks = num_tasks;
+    job.next_task = 0;
+    job.num_helpers = 0;
+    job.max_helpers = std::min(max_helpers, static_cast<int>(workers_.size()));
+    job.tracker = MemoryTracker::current();
+    if (job.max_helpers > 0) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(&job);
+        }
+        job_posted_.notify_all();
+    }
+
+    work(&job);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    jobs_.erase(std::remove(jobs_.begin(), jobs_.end(), &job), jobs_.end());
+    helper_done_.wait(lock, [&]() { return job.num_helpers == 0; });
+    if (job.exception) std::rethrow_exception(job.exception);
+}
+
+/* first job with tasks left and room for a helper; mutex_ held */
+ThreadPool::Job *ThreadPool::findJob() {
+    for (Job *job : jobs_) {
+        if (job->next_task < job->num_tasks && job->num_helpers < job->max_helpers) return job;
+    }
+    return nullptr;
+}
+
+void ThreadPool::workerLoop() {
+    /* nested parallelFor() calls of a task run on this pool too */
+    Scope scope(this);
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        Job *job = nullptr;
+        job_posted_.wait(lock, [&]() { return stopping_ || (job = findJob()) != nullptr; });
+        if (stopping_) return;
+        job->num_helpers++;
+        lock.unlock();
+        work(job);
+        lock.lock();
+        job->num_helpers--;
+        helper_done_.notify_all();
+    }
+}
+
+void ThreadPool::work(Job *job) {
+    MemoryTracker::Scope scope(job->tracker);
+    for (int32_t task = job->next_task++; task < job->num_tasks; task = job->next_task++) {
+        try {
+            (*job->task)(task);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!job->exception) job->exception = std::current_exception();
+            job->next_task = job->num_tasks;
+        }
+    }
+}
+
+/*
+Run body over range split into stripes.
+num_threads <= 0 delegates to cv::parallel_for_ (OpenCV's shared pool); otherwise at most num_threads threads,
+the caller included, pull stripes dynamically, so concurrent callers each stay within their own budget. The threads
+are those of the current ThreadPool if there is one, and threads started for the call otherwise.
+nstripes <= 0 uses four stripes per thread.
+The memory tracker of the caller, if any, stays current in the workers.
+*/
+void parallelFor(const cv::Range &range, const std::function<void(const cv::Range &)> &body, int num_threads, double nstripes) {
+    if (range.end <= range.start) return;
+    MemoryTracker *tracker = MemoryTracker::current();
+    if (num_threads <= 0) {
+        if (!tracker) {
+            cv::parallel_for_(range, body, nstripes);
+            return;
+        }
+        cv::parallel_for_(range, [&](const cv::Range &stripe) {
+            MemoryTracker::Scope scope(tracker);
+            body(stripe);
+        }, nstripes);
+        return;
+    }
+
+    int32_t length = range.end - range.start;
+    int32_t num_stripes = (nstripes > 0) ? static_cast<int32_t>(nstripes) : 4 * num_threads;
+    num_stripes = std::max(1, std::min(num_stripes, length));
+    int32_t num_workers = std::min(num_threads, num_stripes);
+    if (num_workers == 1) {
+        body(range);
+        return;
+    }
+
+    auto stripe_range = [&](int32_t stripe) {
+        int32_t start = range.start + static_cast<int32_t>(int64_t(length) * stripe / num_stripes);
+        int32_t end = range.start + static_cast<int32_t>(int64_t(length) * (stripe + 1) / num_stripes);
+        return cv::Range(start, end);
+    };
+
+    if (ThreadPool *pool = ThreadPool::current()) {
+        pool->run(num_stripes, [&](int32_t stripe) { body(stripe_range(stripe)); }, num_workers - 1);
+        return;
+    }
+
+    std::atomic<int32_t> next_stripe(0);
+    std::exception_ptr exception;
+    std::mutex exception_mutex;
+    auto worker = [&]() {
+        MemoryTracker::Scope scope(tracker);
+        try {
+            for (int32_t stripe = next_stripe++; stripe < num_stripes; stripe = next_stripe++) body(stripe_range(stripe));
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(exception_mutex);
+            if (!exception) exception = std::current_exception();
+            next_stripe = num_stripes;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_workers - 1);
+    for (int32_t k = 0; k < num_workers - 1; k++) threads.emplace_back(worker);
+    worker();
+    for (std::thread &thread : threads) thread.join();
+    if (exception) std::rethrow_exception(exception);
+}
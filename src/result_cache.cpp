@@ -0,0 +1,425 @@
+#include "result_cache.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "hjs.h"
+
+namespace {
+
+const char kEntryMagic[8] = {'H', 'J', 'S', 'C', 'A', 'C', 'H', 'E'};
+const char kEntrySuffix[] = ".hjsc";
+const uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+
+/* arrays of an entry, in file order */
+enum EntrySection {
+    kSectionCounts = 0,  // uint32 run-length counts of the skeleton
+    kSectionDistanceTransform,
+    kSectionFlux,
+    kSectionArcAngle,
+    kSectionPointsX,
+    kSectionPointsY,
+    kSectionPointsRadius,
+    kSectionPointsFlux,
+    kSectionPointsArcAngle,
+    kSectionBranchLength,
+    kSectionBranchOffsets,
+    kSectionWidthProfile,
+    kSectionRadiusHistogram,
+    kNumSections
+};
+
+struct EntryHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t outputs;
+    uint64_t key[2];
+    int32_t image_width, image_height;  // result images (frame.cvmat)
+    int32_t frame_width, frame_height;  // run-length skeleton
+    uint64_t num_counts;
+    uint64_t num_points;
+    uint64_t num_branches, num_profile, num_radius_bins;  // descriptors
+    int32_t num_skeleton_points, num_end_points, num_junctions;
+    float total_length;
+    uint64_t file_size;
+};
+
+struct EntryLayout {
+    uint64_t offset[kNumSections];
+    uint64_t size[kNumSections];  // bytes, 0 if the section is absent
+    uint64_t file_size;
+};
+
+EntryLayout layoutEntry(const EntryHeader &header) {
+    uint64_t image_bytes = uint64_t(header.image_width) * header.image_height * sizeof(float);
+    uint64_t point_bytes = header.num_points * sizeof(float);
+    bool skeleton = header.outputs & (kOutputSkeleton | kOutputRunLength);
+    bool points = header.outputs & kOutputPoints;
+
+    EntryLayout layout;
+    layout.size[kSectionCounts] = skeleton ? header.num_counts * sizeof(uint32_t) : 0;
+    layout.size[kSectionDistanceTransform] = (header.outputs & kOutputDistanceTransform) ? image_bytes : 0;
+    layout.size[kSectionFlux] = (header.outputs & kOutputFlux) ? image_bytes : 0;
+    layout.size[kSectionArcAngle] = (header.outputs & kOutputArcAngle) ? image_bytes : 0;
+    for (int section = kSectionPointsX; section <= kSectionPointsArcAngle; section++) layout.size[section] = points ? point_bytes : 0;
+    bool descriptors = header.outputs & kOutputDescriptors;
+    layout.size[kSectionBranchLength] = descriptors ? header.num_branches * sizeof(float) : 0;
+    layout.size[kSectionBranchOffsets] = descriptors ? (header.num_branches + 1) * sizeof(int32_t) : 0;
+    layout.size[kSectionWidthProfile] = descriptors ? header.num_profile * sizeof(float) : 0;
+    layout.size[kSectionRadiusHistogram] = descriptors ? header.num_radius_bins * sizeof(int32_t) : 0;
+
+    uint64_t offset = sizeof(EntryHeader);
+    for (int section = 0; section < kNumSections; section++) {
+        offset = (offset + 63) / 64 * 64;
+        layout.offset[section] = offset;
+        offset += layout.size[section];
+    }
+    layout.file_size = offset;
+    return layout;
+}
+
+void copyImageIn(const cv::Mat &image, unsigned char *data) {
+    size_t row_size = image.cols * image.elemSize();
+    for (int y = 0; y < image.rows; y++) std::memcpy(data + y * row_size, image.ptr(y), row_size);
+}
+
+cv::Mat copyImageOut(const unsigned char *data, const EntryHeader &header) {
+    cv::Mat image(header.image_height, header.image_width, CV_32FC1);
+    std::memcpy(image.data, data, image.total() * image.elemSize());
+    return image;
+}
+
+template <typename T>
+void copyVectorIn(const std::vector<T> &values, unsigned char *data) {
+    if (!values.empty()) std::memcpy(data, values.data(), values.size() * sizeof(T));
+}
+
+template <typename T>
+void copyVectorOut(const unsigned char *data, uint64_t count, std::vector<T> &values) {
+    values.resize(count);
+    if (count > 0) std::memcpy(values.data(), data, count * sizeof(T));
+}
+
+bool endsWith(const std::string &text, const std::string &suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+struct EntryFile {
+    std::string path;
+    int64_t size;
+    struct timespec last_use;
+};
+
+/* entries of directory, oldest use first; temporary files of writers that died over an hour ago are removed */
+std::vector<EntryFile> listEntries(const std::string &directory) {
+    std::vector<EntryFile> entries;
+    DIR *handle = ::opendir(directory.c_str());
+    if (!handle) return entries;
+    time_t now = ::time(nullptr);
+    while (struct dirent *item = ::readdir(handle)) {
+        std::string name = item->d_name;
+        bool temporary = endsWith(name, ".tmp");
+        if (!endsWith(name, kEntrySuffix) && !temporary) continue;
+        EntryFile entry;
+        entry.path = directory + "/" + name;
+        struct stat status;
+        if (::stat(entry.path.c_str(), &status) != 0) continue;
+        if (temporary) {
+            if (now - status.st_mtime > 3600) ::unlink(entry.path.c_str());
+            continue;
+        }
+        entry.size = status.st_size;
+        entry.last_use = status.st_mtim;
+        entries.push_back(entry);
+    }
+    ::closedir(handle);
+    std::sort(entries.begin(), entries.end(), [](const EntryFile &a, const EntryFile &b) {
+        return a.last_use.tv_sec != b.last_use.tv_sec ? a.last_use.tv_sec < b.last_use.tv_sec : a.last_use.tv_nsec < b.last_use.tv_nsec;
+    });
+    return entries;
+}
+
+}  // namespace
+
+std::string CacheKey::toHex() const {
+    static const char kDigits[] = "0123456789abcdef";
+    std::string text(32, '0');
+    for (int lane = 0; lane < 2; lane++)
+        for (int k = 0; k < 16; k++) text[lane * 16 + k] = kDigits[(hash[lane] >> (60 - 4 * k)) & 0xf];
+    return text;
+}
+
+CacheKeyHasher::CacheKeyHasher() : length_(0), tail_size_(0) {
+    lanes_[0] = kPrime1;
+    lanes_[1] = kPrime2;
+}
+
+void CacheKeyHasher::mix(uint64_t word) {
+    lanes_[0] = (lanes_[0] ^ word) * kPrime1;
+    lanes_[0] = (lanes_[0] << 31) | (lanes_[0] >> 33);
+    lanes_[1] = (lanes_[1] ^ (word * kPrime2)) * kPrime1;
+    lanes_[1] = (lanes_[1] << 27) | (lanes_[1] >> 37);
+}
+
+void CacheKeyHasher::update(const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    length_ += size;
+    while (size > 0 && tail_size_ > 0 && tail_size_ < 8) {
+        tail_[tail_size_++] = *bytes++;
+        size--;
+    }
+    if (tail_size_ == 8) {
+        uint64_t word;
+        std::memcpy(&word, tail_, 8);
+        mix(word);
+        tail_size_ = 0;
+    }
+    for (; size >= 8; bytes += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes, 8);
+        mix(word);
+    }
+    std::memcpy(tail_ + tail_size_, bytes, size);
+    tail_size_ += size;
+}
+
+void CacheKeyHasher::updateImage(const cv::Mat &image) {
+    int32_t shape[3] = {image.rows, image.cols, image.type()};
+    update(shape, sizeof(shape));
+    size_t row_size = image.cols * image.elemSize();
+    for (int y = 0; y < image.rows; y++) update(image.ptr(y), row_size);
+}
+
+CacheKey CacheKeyHasher::digest() const {
+    CacheKeyHasher final_state(*this);
+    uint64_t word = 0;
+    std::memcpy(&word, final_state.tail_, final_state.tail_size_);
+    final_state.mix(word);
+    final_state.mix(length_);
+
+    /* avalanche each lane, then let them depend on each other */
+    CacheKey key;
+    for (int lane = 0; lane < 2; lane++) {
+        uint64_t h = final_state.lanes_[lane];
+        h ^= h >> 33;
+        h *= kPrime2;
+        h ^= h >> 29;
+        h *= kPrime1;
+        h ^= h >> 32;
+        key.hash[lane] = h;
+    }
+    key.hash[1] ^= key.hash[0] * kPrime2;
+    return key;
+}
+
+ResultCache::ResultCache(const std::string &directory, int64_t max_bytes)
+    : directory_(directory), max_bytes_(max_bytes), total_bytes_(0), num_hits_(0), num_misses_(0) {
+    if (::mkdir(directory_.c_str(), 0755) != 0 && errno != EEXIST)
+        throw std::runtime_error("cannot create cache directory " + directory_ + ": " + std::strerror(errno));
+    int64_t total = 0;
+    for (const EntryFile &entry : listEntries(directory_)) total += entry.size;
+    total_bytes_ = total;
+}
+
+ResultCache::~ResultCache() {}
+
+std::string ResultCache::entryPath(const CacheKey &key) const { return directory_ + "/" + key.toHex() + kEntrySuffix; }
+
+bool ResultCache::load(const CacheKey &key, int outputs, const BinaryFrame &frame, SkeletonResult &result) {
+    int descriptor = ::open(entryPath(key).c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        num_misses_++;
+        return false;
+    }
+    struct stat status;
+    void *mapping = MAP_FAILED;
+    if (::fstat(descriptor, &status) == 0 && status.st_size >= static_cast<off_t>(sizeof(EntryHeader)))
+        mapping = ::mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+    if (mapping == MAP_FAILED) {
+        ::close(descriptor);
+        num_misses_++;
+        return false;
+    }
+
+    const unsigned char *data = static_cast<const unsigned char *>(mapping);
+    EntryHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    EntryLayout layout = layoutEntry(header);
+    bool valid = std::memcmp(header.magic, kEntryMagic, sizeof(kEntryMagic)) == 0 && header.version == kResultCacheVersion &&
+                 header.key[0] == key.hash[0] && header.key[1] == key.hash[1] && header.outputs == outputs &&
+                 header.image_width == frame.cvmat.cols && header.image_height == frame.cvmat.rows &&
+                 header.frame_width == static_cast<int32_t>(frame.frame_width) &&
+                 header.frame_height == static_cast<int32_t>(frame.frame_height) &&
+                 header.file_size == layout.file_size && static_cast<uint64_t>(status.st_size) == layout.file_size;
+    if (valid) {
+        RunLengthMask skeleton;
+        if (outputs & (kOutputSkeleton | kOutputRunLength)) {
+            skeleton.height = header.frame_height;
+            skeleton.width = header.frame_width;
+            copyVectorOut(data + layout.offset[kSectionCounts], header.num_counts, skeleton.counts);
+        }
+        if (outputs & kOutputSkeleton) {
+            decodeRunLength(skeleton, frame.roi, result.skeleton_image);
+            cv::threshold(result.skeleton_image, result.skeleton_image, 0, 1, cv::THRESH_BINARY);
+        }
+        if (outputs & kOutputRunLength) result.skeleton_run_length = std::move(skeleton);
+        if (outputs & kOutputDistanceTransform) result.distance_transform_image = copyImageOut(data + layout.offset[kSectionDistanceTransform], header);
+        if (outputs & kOutputFlux) result.flux_image = copyImageOut(data + layout.offset[kSectionFlux], header);
+        if (outputs & kOutputArcAngle) result.arc_angle_image = copyImageOut(data + layout.offset[kSectionArcAngle], header);
+        if (outputs & kOutputPoints) {
+            copyVectorOut(data + layout.offset[kSectionPointsX], header.num_points, result.points.x);
+            copyVectorOut(data + layout.offset[kSectionPointsY], header.num_points, result.points.y);
+            copyVectorOut(data + layout.offset[kSectionPointsRadius], header.num_points, result.points.radius);
+            copyVectorOut(data + layout.offset[kSectionPointsFlux], header.num_points, result.points.flux);
+            copyVectorOut(data + layout.offset[kSectionPointsArcAngle], header.num_points, result.points.arc_angle);
+        }
+        if (outputs & kOutputDescriptors) {
+            SkeletonDescriptors &descriptors = result.descriptors;
+            descriptors.num_points = header.num_skeleton_points;
+            descriptors.num_end_points = header.num_end_points;
+            descriptors.num_junctions = header.num_junctions;
+            descriptors.total_length = header.total_length;
+            copyVectorOut(data + layout.offset[kSectionBranchLength], header.num_branches, descriptors.branch_length);
+            copyVectorOut(data + layout.offset[kSectionBranchOffsets], header.num_branches + 1, descriptors.branch_offsets);
+            copyVectorOut(data + layout.offset[kSectionWidthProfile], header.num_profile, descriptors.width_profile);
+            copyVectorOut(data + layout.offset[kSectionRadiusHistogram], header.num_radius_bins, descriptors.radius_histogram);
+        }
+        /* the modification time is the last use the eviction goes by */
+        ::futimens(descriptor, nullptr);
+    }
+    ::munmap(mapping, status.st_size);
+    ::close(descriptor);
+    (valid ? num_hits_ : num_misses_)++;
+    return valid;
+}
+
+void ResultCache::store(const CacheKey &key, int outputs, const BinaryFrame &frame, const SkeletonResult &result) {
+    /* the skeleton is kept as the run-length encoding of the whole frame */
+    RunLengthMask skeleton;
+    if (outputs & (kOutputSkeleton | kOutputRunLength)) {
+        if (result.skeleton_run_length.height > 0) {
+            skeleton = result.skeleton_run_length;
+        } else {
+            std::vector<cv::Point> pixels;
+            if (cv::countNonZero(result.skeleton_image) > 0) cv::findNonZero(result.skeleton_image, pixels);
+            std::vector<int32_t> x(pixels.size()), y(pixels.size());
+            for (size_t index = 0; index < pixels.size(); index++) {
+                x[index] = pixels[index].x + frame.roi.x;
+                y[index] = pixels[index].y + frame.roi.y;
+            }
+            encodeRunLength(x, y, frame.frame_height, frame.frame_width, skeleton);
+        }
+    }
+
+    EntryHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kEntryMagic, sizeof(kEntryMagic));
+    header.version = kResultCacheVersion;
+    header.outputs = outputs;
+    header.key[0] = key.hash[0];
+    header.key[1] = key.hash[1];
+    header.image_width = frame.cvmat.cols;
+    header.image_height = frame.cvmat.rows;
+    header.frame_width = frame.frame_width;
+    header.frame_height = frame.frame_height;
+    header.num_counts = skeleton.counts.size();
+    header.num_points = (outputs & kOutputPoints) ? result.points.size() : 0;
+    if (outputs & kOutputDescriptors) {
+        const SkeletonDescriptors &descriptors = result.descriptors;
+        header.num_branches = descriptors.numBranches();
+        header.num_profile = descriptors.width_profile.size();
+        header.num_radius_bins = descriptors.radius_histogram.size();
+        header.num_skeleton_points = descriptors.num_points;
+        header.num_end_points = descriptors.num_end_points;
+        header.num_junctions = descriptors.num_junctions;
+        header.total_length = descriptors.total_length;
+    }
+    EntryLayout layout = layoutEntry(header);
+    header.file_size = layout.file_size;
+
+    static std::atomic<uint64_t> temporary_counter(0);
+    std::string temporary_path = entryPath(key) + "." + std::to_string(::getpid()) + "." + std::to_string(temporary_counter++) + ".tmp";
+    int descriptor = ::open(temporary_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (descriptor < 0) return;
+    void *mapping = MAP_FAILED;
+    if (::ftruncate(descriptor, static_cast<off_t>(layout.file_size)) == 0)
+        mapping = ::mmap(nullptr, layout.file_size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    if (mapping == MAP_FAILED) {
+        ::close(descriptor);
+        ::unlink(temporary_path.c_str());
+        return;
+    }
+
+    unsigned char *data = static_cast<unsigned char *>(mapping);
+    std::memcpy(data, &header, sizeof(header));
+    if (layout.size[kSectionCounts] > 0) std::memcpy(data + layout.offset[kSectionCounts], skeleton.counts.data(), layout.size[kSectionCounts]);
+    if (layout.size[kSectionDistanceTransform] > 0) copyImageIn(result.distance_transform_image, data + layout.offset[kSectionDistanceTransform]);
+    if (layout.size[kSectionFlux] > 0) copyImageIn(result.flux_image, data + layout.offset[kSectionFlux]);
+    if (layout.size[kSectionArcAngle] > 0) copyImageIn(result.arc_angle_image, data + layout.offset[kSectionArcAngle]);
+    if (layout.size[kSectionPointsX] > 0) {
+        std::memcpy(data + layout.offset[kSectionPointsX], result.points.x.data(), layout.size[kSectionPointsX]);
+        std::memcpy(data + layout.offset[kSectionPointsY], result.points.y.data(), layout.size[kSectionPointsY]);
+        std::memcpy(data + layout.offset[kSectionPointsRadius], result.points.radius.data(), layout.size[kSectionPointsRadius]);
+        std::memcpy(data + layout.offset[kSectionPointsFlux], result.points.flux.data(), layout.size[kSectionPointsFlux]);
+        std::memcpy(data + layout.offset[kSectionPointsArcAngle], result.points.arc_angle.data(), layout.size[kSectionPointsArcAngle]);
+    }
+    if (outputs & kOutputDescriptors) {
+        const SkeletonDescriptors &descriptors = result.descriptors;
+        copyVectorIn(descriptors.branch_length, data + layout.offset[kSectionBranchLength]);
+        copyVectorIn(descriptors.branch_offsets, data + layout.offset[kSectionBranchOffsets]);
+        copyVectorIn(descriptors.width_profile, data + layout.offset[kSectionWidthProfile]);
+        copyVectorIn(descriptors.radius_histogram, data + layout.offset[kSectionRadiusHistogram]);
+    }
+
+    /* the data reaches the disk before the name does, so a crash cannot leave a complete-looking entry with holes */
+    bool written = ::msync(mapping, layout.file_size, MS_SYNC) == 0;
+    ::munmap(mapping, layout.file_size);
+    written = written && ::fsync(descriptor) == 0;
+    ::close(descriptor);
+    if (!written || ::rename(temporary_path.c_str(), entryPath(key).c_str()) != 0) {
+        ::unlink(temporary_path.c_str());
+        return;
+    }
+    int directory = ::open(directory_.c_str(), O_RDONLY | O_DIRECTORY);
+    if (directory >= 0) {
+        ::fsync(directory);
+        ::close(directory);
+    }
+    int64_t total = (total_bytes_ += static_cast<int64_t>(layout.file_size));
+    if (max_bytes_ > 0 && total > max_bytes_) evict();
+}
+
+void ResultCache::evict() {
+    /* one evicting process at a time; the others keep going and count on its scan */
+    std::string lock_path = directory_ + "/.lock";
+    int lock = ::open(lock_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (lock < 0) return;
+    if (::flock(lock, LOCK_EX | LOCK_NB) != 0) {
+        ::close(lock);
+        return;
+    }
+
+    std::vector<EntryFile> entries = listEntries(directory_);
+    int64_t total = 0;
+    for (const EntryFile &entry : entries) total += entry.size;
+    int64_t target = max_bytes_ / 10 * 9;
+    for (size_t index = 0; index < entries.size() && total > target; index++) {
+        /* a reader that mapped the entry keeps its pages */
+        if (::unlink(entries[index].path.c_str()) == 0 || errno == ENOENT) total -= entries[index].size;
+    }
+    total_bytes_ = total;
+
+    ::flock(lock, LOCK_UN);
+    ::close(lock);
+}
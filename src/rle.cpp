@@ -0,0 +1,137 @@
+#include "rle.h"
+
+#include <algorithm>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+/*
+COCO compressed counts string (pycocotools rleFrString): each count, as a difference to the count two runs
+before from the third one on, is stored in 5-bit groups with a continuation bit, offset by 48 into printable ASCII.
+*/
+void decodeRunLengthString(const std::string &counts_string, std::vector<uint32_t> &counts) {
+    counts.clear();
+    size_t position = 0;
+    while (position < counts_string.size()) {
+        int64_t value = 0;
+        int32_t num_groups = 0;
+        bool more = true;
+        while (more) {
+            CV_Assert(position < counts_string.size());
+            int32_t group = static_cast<int32_t>(counts_string[position]) - 48;
+            value |= static_cast<int64_t>(group & 0x1f) << (5 * num_groups);
+            more = (group & 0x20) != 0;
+            position++;
+            num_groups++;
+            if (!more && (group & 0x10)) value |= static_cast<int64_t>(~uint64_t(0) << (5 * num_groups));
+        }
+        if (counts.size() > 2) value += counts[counts.size() - 2];
+        CV_Assert(value >= 0);
+        counts.push_back(static_cast<uint32_t>(value));
+    }
+}
+
+/// inverse of decodeRunLengthString() (pycocotools rleToString)
+std::string encodeRunLengthString(const std::vector<uint32_t> &counts) {
+    std::string counts_string;
+    for (size_t index = 0; index < counts.size(); index++) {
+        int64_t value = counts[index];
+        if (index > 2) value -= counts[index - 2];
+        bool more = true;
+        while (more) {
+            int32_t group = static_cast<int32_t>(value & 0x1f);
+            value >>= 5;
+            more = (group & 0x10) ? value != -1 : value != 0;
+            if (more) group |= 0x20;
+            counts_string.push_back(static_cast<char>(group + 48));
+        }
+    }
+    return counts_string;
+}
+
+/*
+Bounding box of the foreground pixels, read from the runs without decoding; empty if there is no foreground.
+A run covering several columns spans the full height.
+*/
+cv::Rect runLengthBoundingBox(const RunLengthMask &mask) {
+    int64_t num_pixels = int64_t(mask.height) * mask.width;
+    int32_t x_min = mask.width, x_max = -1, y_min = mask.height, y_max = -1;
+    int64_t start = 0;
+    for (size_t index = 0; index < mask.counts.size(); index++) {
+        int64_t end = start + mask.counts[index];
+        CV_Assert(end <= num_pixels);
+        if (index % 2 == 1 && end > start) {
+            int32_t x_start = static_cast<int32_t>(start / mask.height);
+            int32_t x_end = static_cast<int32_t>((end - 1) / mask.height);
+            x_min = std::min(x_min, x_start);
+            x_max = std::max(x_max, x_end);
+            if (x_start == x_end) {
+                y_min = std::min(y_min, static_cast<int32_t>(start % mask.height));
+                y_max = std::max(y_max, static_cast<int32_t>((end - 1) % mask.height));
+            } else {
+                y_min = 0;
+                y_max = mask.height - 1;
+            }
+        }
+        start = end;
+    }
+    CV_Assert(start == num_pixels);
+    if (x_max < 0) return cv::Rect();
+    return cv::Rect(x_min, y_min, x_max - x_min + 1, y_max - y_min + 1);
+}
+
+/*
+Decode the part of the mask inside roi into mask_image (CV_8U, roi.size(), foreground 255).
+Only the runs overlapping roi are written.
+*/
+void decodeRunLength(const RunLengthMask &mask, const cv::Rect &roi, cv::Mat &mask_image) {
+    CV_Assert((roi & cv::Rect(0, 0, mask.width, mask.height)) == roi);
+    mask_image = cv::Mat::zeros(roi.size(), CV_8UC1);
+    int64_t roi_start = int64_t(roi.x) * mask.height;
+    int64_t roi_end = int64_t(roi.x + roi.width) * mask.height;
+    int64_t start = 0;
+    for (size_t index = 0; index < mask.counts.size() && start < roi_end; index++) {
+        int64_t end = start + mask.counts[index];
+        if (index % 2 == 1 && end > roi_start) {
+            for (int64_t position = std::max(start, roi_start); position < std::min(end, roi_end);) {
+                int32_t x = static_cast<int32_t>(position / mask.height);
+                int32_t y_start = static_cast<int32_t>(position % mask.height);
+                int32_t y_end = static_cast<int32_t>(std::min(end - int64_t(x) * mask.height, int64_t(mask.height)));
+                for (int32_t y = std::max(y_start, roi.y); y < std::min(y_end, roi.y + roi.height); y++) {
+                    mask_image.at<uchar>(y - roi.y, x - roi.x) = 255;
+                }
+                position = int64_t(x) * mask.height + y_end;
+            }
+        }
+        start = end;
+    }
+}
+
+/*
+Encode the pixels (x[i], y[i]) of a height x width frame; the pixel list needs no particular order.
+*/
+void encodeRunLength(const std::vector<int32_t> &x, const std::vector<int32_t> &y, const int32_t &height, const int32_t &width, RunLengthMask &mask) {
+    CV_Assert(x.size() == y.size());
+    std::vector<int64_t> positions(x.size());
+    for (size_t index = 0; index < x.size(); index++) {
+        CV_Assert(0 <= x[index] && x[index] < width && 0 <= y[index] && y[index] < height);
+        positions[index] = int64_t(x[index]) * height + y[index];
+    }
+    std::sort(positions.begin(), positions.end());
+    positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+
+    mask.height = height;
+    mask.width = width;
+    mask.counts.clear();
+    int64_t end = 0;  // end of the last foreground run
+    for (size_t index = 0; index < positions.size();) {
+        size_t run_end = index + 1;
+        while (run_end < positions.size() && positions[run_end] == positions[run_end - 1] + 1) run_end++;
+        mask.counts.push_back(static_cast<uint32_t>(positions[index] - end));
+        mask.counts.push_back(static_cast<uint32_t>(run_end - index));
+        end = positions[run_end - 1] + 1;
+        index = run_end;
+    }
+    int64_t num_pixels = int64_t(height) * width;
+    if (end < num_pixels || mask.counts.empty()) mask.counts.push_back(static_cast<uint32_t>(num_pixels - end));
+}
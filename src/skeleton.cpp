@@ -1,16 +1,22 @@
 #include "skeleton.h"
 
+#include <cstring>
 #include <opencv2/opencv.hpp>
 
+#include "parallel.h"
+
 /*
 Compute the average outward flux
+(only where mask is nonzero if a CV_8U mask is given; F is left untouched elsewhere)
 */
-void flux(const cv::Mat &Dx, const cv::Mat &Dy, cv::Mat &F) {
+void flux(const cv::Mat &Dx, const cv::Mat &Dy, cv::Mat &F, const cv::Mat &mask) {
     CV_Assert(F.type() == CV_32F);
+    CV_Assert(mask.empty() || (mask.type() == CV_8UC1 && mask.size() == F.size()));
     int32_t width = F.cols;
     int32_t height = F.rows;
     for (int32_t y = 1; y < height - 1; y++) {
         for (int32_t x = 1; x < width - 1; x++) {
+            if (!mask.empty() && mask.at<uchar>(y, x) == 0) continue;
             float flux_var = 0;
             for (int32_t ky = -1; ky <= 1; ky++) {
                 for (int32_t kx = -1; kx <= 1; kx++) {
@@ -26,29 +32,142 @@ void flux(const cv::Mat &Dx, const cv::Mat &Dy, cv::Mat &F) {
     }
 }
 
-std::vector<cv::Point> getContourPoints(const cv::Mat &mask_image) {
-    std::vector<std::vector<cv::Point>> contours_list;
-    std::vector<cv::Vec4i> hierarchy;
-    cv::findContours(mask_image, contours_list, hierarchy, cv::RETR_LIST, cv::CHAIN_APPROX_NONE);
+/*
+Sobel gradient and flux of D computed band_rows rows at a time: the gradient images only cover one band
+(plus the rows the stencils reach) instead of the whole frame. F matches the flux of the whole frame gradient.
+*/
+void fluxBanded(const cv::Mat &D, cv::Mat &F, int band_rows, const cv::Mat &mask) {
+    CV_Assert(D.type() == CV_32F && F.type() == CV_32F && D.size() == F.size() && band_rows > 0);
+    int32_t height = D.rows;
+    cv::Mat D_band, Dx_band, Dy_band;
+    for (int32_t y0 = 0; y0 < height; y0 += band_rows) {
+        int32_t y1 = std::min(height, y0 + band_rows);
+        // gradient rows read by the flux of rows [y0, y1), and the distance rows their Sobel stencil reads
+        int32_t g0 = std::max(0, y0 - 1), g1 = std::min(height, y1 + 1);
+        int32_t d0 = std::max(0, g0 - 1), d1 = std::min(height, g1 + 1);
 
-    std::vector<cv::Point> contour_points_concatenated;
-    for (std::vector<cv::Point> contours : contours_list) {
-        std::copy(contours.begin(), contours.end(), std::back_inserter(contour_points_concatenated));
+        // a copy, so that the Sobel border is the one of the whole frame at its first and last row
+        D.rowRange(d0, d1).copyTo(D_band);
+        cv::Sobel(D_band, Dx_band, CV_32F, 1, 0);
+        cv::Sobel(D_band, Dy_band, CV_32F, 0, 1);
+
+        // flux() skips the first and last row of its input: it fills exactly rows [y0, y1) of the frame interior
+        cv::Mat F_rows = F.rowRange(g0, g1);
+        flux(Dx_band.rowRange(g0 - d0, g1 - d0), Dy_band.rowRange(g0 - d0, g1 - d0), F_rows, mask.empty() ? mask : mask.rowRange(g0, g1));
     }
-    return contour_points_concatenated;
 }
 
-cv::Mat getContourMask(const cv::Mat &mask_image) {
-    cv::Mat contour_mask = cv::Mat::zeros(cv::Size(mask_image.cols, mask_image.rows), CV_32F);
+namespace {
 
-    std::vector<std::vector<cv::Point>> contours_list;
-    std::vector<cv::Vec4i> hierarchy;
-    cv::findContours(mask_image.clone(), contours_list, hierarchy, cv::RETR_LIST, cv::CHAIN_APPROX_NONE);
+/* boundary of a row from the 0/1 foreground of the rows above, at and below it, each padded by one pixel */
+void boundaryRow(const uchar *above, const uchar *center, const uchar *below, uchar *boundary_row, int32_t width) {
+    for (int32_t x = 0; x < width; x++) {
+        uchar interior = above[x + 1] & below[x + 1] & center[x] & center[x + 2];
+        boundary_row[x] = center[x + 1] & (interior ^ 1);
+    }
+}
+
+}  // namespace
+
+/*
+Boundary of the foreground (values above threshold) of a CV_8U mask in one pass: a pixel is on the boundary if it is
+foreground and one of its 4-neighbours is background (pixels outside the image count as background), i.e. the mask
+XOR its erosion by a 3x3 cross. Rows are scanned in parallel in chunks; the erosion of a row reads the rows above and
+below directly, with branch-free byte operations the compiler vectorizes. Each chunk collects its points and
+bounding box, and the points are concatenated in raster order. The boundary image of the whole frame is only
+written if build_mask is set; otherwise each row goes through a scratch row.
+
+The points are not in the order in which cv::findContours() traces them. Where they seed the thinning, candidates
+of equal flux can leave in another order, so a skeleton can move by a pixel compared to seeding in contour order.
+*/
+void extractBoundary(const cv::Mat &mask_image, MaskBoundary &boundary, int threshold, int num_threads, bool build_mask) {
+    CV_Assert(mask_image.type() == CV_8UC1);
+    const int32_t kChunkRows = 32;
+    int32_t width = mask_image.cols;
+    int32_t height = mask_image.rows;
+    int32_t num_chunks = (height + kChunkRows - 1) / kChunkRows;
+    boundary.mask.release();
+    if (build_mask) boundary.mask.create(mask_image.size(), CV_8UC1);
 
-    for (std::vector<cv::Point> contours : contours_list) {
-        for (cv::Point contour_point : contours) {
-            contour_mask.at<float>(contour_point.y, contour_point.x) = 1.0;
+    std::vector<std::vector<cv::Point>> chunk_points(num_chunks);
+    std::vector<cv::Rect> chunk_boxes(num_chunks);
+    uchar level = static_cast<uchar>(std::max(0, std::min(255, threshold)));
+    parallelFor(cv::Range(0, num_chunks), [&](const cv::Range &range) {
+        // foreground of the rows above, at and below the current one, with a background pixel at both ends
+        std::vector<uchar> rows(3 * size_t(width + 2) + (build_mask ? 0 : width), 0);
+        uchar *above = rows.data(), *center = above + width + 2, *below = center + width + 2;
+        uchar *scratch_row = below + width + 2;
+        // width, height and level are copied: stores through uchar pointers may alias captured references
+        auto load = [&mask_image, width, height, level](int32_t y, uchar *foreground) {
+            if (y < 0 || y >= height) {
+                std::fill(foreground + 1, foreground + width + 1, uchar(0));
+                return;
+            }
+            const uchar *row = mask_image.ptr<uchar>(y);
+            for (int32_t x = 0; x < width; x++) foreground[x + 1] = row[x] > level;
+        };
+
+        for (int32_t chunk = range.start; chunk < range.end; chunk++) {
+            int32_t y0 = chunk * kChunkRows, y1 = std::min(height, y0 + kChunkRows);
+            int32_t x_min = width, x_max = -1, y_min = height, y_max = -1;
+            std::vector<cv::Point> &points = chunk_points[chunk];
+            load(y0 - 1, above);
+            load(y0, center);
+            for (int32_t y = y0; y < y1; y++) {
+                load(y + 1, below);
+                uchar *boundary_row = build_mask ? boundary.mask.ptr<uchar>(y) : scratch_row;
+                boundaryRow(above, center, below, boundary_row, width);
+
+                /* foreground extent, then the boundary points of the row, skipping empty 8 byte words */
+                int32_t first = 0, last = width - 1;
+                while (first < width && !center[first + 1]) first++;
+                while (last > first && !center[last + 1]) last--;
+                if (first < width) {
+                    x_min = std::min(x_min, first);
+                    x_max = std::max(x_max, last);
+                    y_min = std::min(y_min, y);
+                    y_max = y;
+                    for (int32_t x = first; x <= last; x++) {
+                        if (x + 8 <= last + 1) {
+                            uint64_t word;
+                            std::memcpy(&word, boundary_row + x, sizeof(word));
+                            if (word == 0) {
+                                x += 7;
+                                continue;
+                            }
+                        }
+                        if (boundary_row[x]) points.push_back(cv::Point(x, y));
+                    }
+                }
+                std::swap(above, center);
+                std::swap(center, below);
+            }
+            if (x_max >= 0) chunk_boxes[chunk] = cv::Rect(x_min, y_min, x_max - x_min + 1, y_max - y_min + 1);
         }
+    }, num_threads);
+
+    size_t num_points = 0;
+    for (const std::vector<cv::Point> &points : chunk_points) num_points += points.size();
+    boundary.points.clear();
+    boundary.points.reserve(num_points);
+    boundary.bounding_box = cv::Rect();
+    for (int32_t chunk = 0; chunk < num_chunks; chunk++) {
+        boundary.points.insert(boundary.points.end(), chunk_points[chunk].begin(), chunk_points[chunk].end());
+        if (chunk_boxes[chunk].area() > 0) boundary.bounding_box = (boundary.bounding_box.area() > 0) ? (boundary.bounding_box | chunk_boxes[chunk]) : chunk_boxes[chunk];
     }
+}
+
+std::vector<cv::Point> getContourPoints(const cv::Mat &mask_image) {
+    MaskBoundary boundary;
+    extractBoundary(mask_image, boundary);
+    return boundary.points;
+}
+
+/* CV_32F, 1 on the boundary pixels */
+cv::Mat getContourMask(const cv::Mat &mask_image) {
+    MaskBoundary boundary;
+    extractBoundary(mask_image, boundary, 0, 0, true);
+    cv::Mat contour_mask;
+    boundary.mask.convertTo(contour_mask, CV_32F);
     return contour_mask;
 }
@@ -0,0 +1,197 @@
+#include "skeleton3d.h"
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace {
+
+const float kNoSite = std::numeric_limits<float>::infinity();
+
+/*
+Lower envelope of the parabolas (x - q)^2 + f[q] over the sites q with a finite f[q] (Felzenszwalb & Huttenlocher):
+d[x] = min_q (x - q)^2 + f[q], or kNoSite everywhere if there is no site. sites and boundaries hold n and n + 1 entries.
+*/
+void squaredDistance1D(const float *f, int32_t n, float *d, int32_t *sites, double *boundaries) {
+    auto parabola = [&](const int32_t &q) { return double(q) * q + double(f[q]); };
+    int32_t k = -1;
+    for (int32_t q = 0; q < n; q++) {
+        if (f[q] == kNoSite) continue;
+        double s = -std::numeric_limits<double>::infinity();
+        while (k >= 0) {
+            s = (parabola(q) - parabola(sites[k])) / (2.0 * (q - sites[k]));
+            if (s > boundaries[k]) break;
+            k--;
+        }
+        k++;
+        sites[k] = q;
+        boundaries[k] = (k == 0) ? -std::numeric_limits<double>::infinity() : s;
+        boundaries[k + 1] = std::numeric_limits<double>::infinity();
+    }
+    if (k < 0) {
+        std::fill(d, d + n, kNoSite);
+        return;
+    }
+    int32_t j = 0;
+    for (int32_t x = 0; x < n; x++) {
+        while (boundaries[j + 1] < x) j++;
+        float dx = float(x - sites[j]);
+        d[x] = dx * dx + f[sites[j]];
+    }
+}
+
+/* buffers of squaredDistance1D() for lines of up to length voxels */
+struct LineBuffers {
+    std::vector<float> f, d;
+    std::vector<int32_t> sites;
+    std::vector<double> boundaries;
+    explicit LineBuffers(int32_t length) : f(length), d(length), sites(length), boundaries(length + 1) {}
+    void run(int32_t n) { squaredDistance1D(f.data(), n, d.data(), sites.data(), boundaries.data()); }
+};
+
+/* one stripe per thread of the budget, so each is a contiguous slab that allocates its buffers (and its halo) once */
+inline double numSlabs(int num_threads) { return std::max(1, (num_threads > 0) ? num_threads : cv::getNumThreads()); }
+
+/* central differences, one-sided on the first and last voxel of a line */
+inline float difference(const float *line, int32_t position, int32_t length, int64_t stride) {
+    int32_t lower = std::max(position - 1, 0), upper = std::min(position + 1, length - 1);
+    if (upper == lower) return 0.f;
+    return (line[upper * stride] - line[lower * stride]) / float(upper - lower);
+}
+
+}  // namespace
+
+/*
+Exact Euclidean distance transform of a volume: distance_volume holds the distance of each voxel to the nearest zero
+voxel of mask_volume (the volume diagonal if there is none). Squared distances are computed by separable passes along
+x and y, in parallel over slabs of z-planes, then along z, in parallel over slabs of y-rows; each z-line is gathered
+for a whole row at once, so the passes read and write contiguous memory.
+*/
+void distanceTransform3D(const Volume<uint8_t> &mask_volume, Volume<float> &distance_volume, int num_threads) {
+    int32_t depth = mask_volume.depth, height = mask_volume.height, width = mask_volume.width;
+    CV_Assert(depth > 0 && height > 0 && width > 0 && mask_volume.size() == int64_t(depth) * height * width);
+    distance_volume = Volume<float>(depth, height, width);
+
+    parallelFor(cv::Range(0, depth), [&](const cv::Range &range) {
+        LineBuffers line(std::max(width, height));
+        for (int32_t z = range.start; z < range.end; z++) {
+            const uint8_t *mask_plane = mask_volume.plane(z);
+            float *plane = distance_volume.plane(z);
+            for (int32_t y = 0; y < height; y++) {
+                for (int32_t x = 0; x < width; x++) line.f[x] = mask_plane[int64_t(y) * width + x] ? kNoSite : 0.f;
+                line.run(width);
+                std::copy(line.d.begin(), line.d.begin() + width, plane + int64_t(y) * width);
+            }
+            for (int32_t x = 0; x < width; x++) {
+                for (int32_t y = 0; y < height; y++) line.f[y] = plane[int64_t(y) * width + x];
+                line.run(height);
+                for (int32_t y = 0; y < height; y++) plane[int64_t(y) * width + x] = line.d[y];
+            }
+        }
+    }, num_threads, numSlabs(num_threads));
+
+    float no_site_distance = std::sqrt(float(depth) * depth + float(height) * height + float(width) * width);
+    parallelFor(cv::Range(0, height), [&](const cv::Range &range) {
+        LineBuffers line(depth);
+        std::vector<float> lines(int64_t(width) * depth);  // the z-lines of one row, x-major
+        for (int32_t y = range.start; y < range.end; y++) {
+            for (int32_t z = 0; z < depth; z++) {
+                const float *row = distance_volume.plane(z) + int64_t(y) * width;
+                for (int32_t x = 0; x < width; x++) lines[int64_t(x) * depth + z] = row[x];
+            }
+            for (int32_t x = 0; x < width; x++) {
+                float *z_line = lines.data() + int64_t(x) * depth;
+                std::copy(z_line, z_line + depth, line.f.begin());
+                line.run(depth);
+                std::copy(line.d.begin(), line.d.begin() + depth, z_line);
+            }
+            for (int32_t z = 0; z < depth; z++) {
+                float *row = distance_volume.plane(z) + int64_t(y) * width;
+                for (int32_t x = 0; x < width; x++) {
+                    float squared_distance = lines[int64_t(x) * depth + z];
+                    row[x] = (squared_distance == kNoSite) ? no_site_distance : std::sqrt(squared_distance);
+                }
+            }
+        }
+    }, num_threads, numSlabs(num_threads));
+}
+
+/*
+Average outward flux of the gradient of D through the 26 neighbours of each voxel, generalizing flux():
+F = 1/26 sum_k <grad D(p + k), k / |k|>, with the gradient from central differences. Only computed on the voxels
+where mask_volume is nonzero, inside the volume border; F is 0 elsewhere. Returns the smallest flux.
+
+The volume is split into slabs of z-planes processed in parallel. Each slab keeps the gradient of three planes in a
+ring and computes the gradient of the plane above and below it (its halo) itself, so the threads share no buffer
+and the gradient never exists for the whole volume at once.
+*/
+float flux3D(const Volume<float> &D, const Volume<uint8_t> &mask_volume, Volume<float> &F, int num_threads) {
+    int32_t depth = D.depth, height = D.height, width = D.width;
+    CV_Assert(mask_volume.depth == depth && mask_volume.height == height && mask_volume.width == width);
+    F = Volume<float>(depth, height, width, 0.f);
+    if (depth < 3 || height < 3 || width < 3) return 0.f;
+
+    /* k / |k| / 26 of the 27 offsets in (z, y, x) raster order; 0 for the center */
+    float normals[27][3];
+    for (int32_t k = 0; k < 27; k++) {
+        int32_t kz = k / 9 - 1, ky = k / 3 % 3 - 1, kx = k % 3 - 1;
+        float norm = std::sqrt(float(kx * kx + ky * ky + kz * kz));
+        float scale = (norm > 0) ? 1.f / (26.f * norm) : 0.f;
+        normals[k][0] = kx * scale;
+        normals[k][1] = ky * scale;
+        normals[k][2] = kz * scale;
+    }
+
+    int64_t plane_size = int64_t(height) * width;
+    float F_min = 0.f;
+    std::mutex F_min_mutex;
+    parallelFor(cv::Range(1, depth - 1), [&](const cv::Range &range) {
+        std::vector<float> ring(3 * 3 * plane_size);  // x, y, z components of three planes
+        auto gradient = [&](int32_t z) { return ring.data() + (z % 3) * 3 * plane_size; };
+        auto computeGradient = [&](int32_t z) {
+            float *gradient_x = gradient(z), *gradient_y = gradient_x + plane_size, *gradient_z = gradient_y + plane_size;
+            const float *plane = D.plane(z);
+            for (int32_t y = 0; y < height; y++) {
+                for (int32_t x = 0; x < width; x++) {
+                    int64_t offset = int64_t(y) * width + x;
+                    gradient_x[offset] = difference(plane + int64_t(y) * width, x, width, 1);
+                    gradient_y[offset] = difference(plane + x, y, height, width);
+                    gradient_z[offset] = difference(D.data.data() + offset, z, depth, plane_size);
+                }
+            }
+        };
+
+        float slab_min = 0.f;
+        computeGradient(range.start - 1);
+        computeGradient(range.start);
+        for (int32_t z = range.start; z < range.end; z++) {
+            computeGradient(z + 1);
+            const uint8_t *mask_plane = mask_volume.plane(z);
+            float *F_plane = F.plane(z);
+            for (int32_t y = 1; y < height - 1; y++) {
+                for (int32_t x = 1; x < width - 1; x++) {
+                    int64_t offset = int64_t(y) * width + x;
+                    if (mask_plane[offset] == 0) continue;
+                    float flux_var = 0;
+                    for (int32_t k = 0; k < 27; k++) {
+                        if (k == 13) continue;
+                        const float *gradient_x = gradient(z + k / 9 - 1);
+                        int64_t neighbor = offset + int64_t(k / 3 % 3 - 1) * width + (k % 3 - 1);
+                        flux_var += gradient_x[neighbor] * normals[k][0] + gradient_x[plane_size + neighbor] * normals[k][1] +
+                                    gradient_x[2 * plane_size + neighbor] * normals[k][2];
+                    }
+                    F_plane[offset] = flux_var;
+                    slab_min = std::min(slab_min, flux_var);
+                }
+            }
+        }
+        std::lock_guard<std::mutex> lock(F_min_mutex);
+        F_min = std::min(F_min, slab_min);
+    }, num_threads, numSlabs(num_threads));
+    return F_min;
+}
@@ -0,0 +1,48 @@
+import cv2
+import numpy as np
+import pytest
+from pyhjs import BinaryFrame, Output, PyHJS
+
+
+def make_mask(size, seed):
+    """A disk with rectangular notches and a hole, different for each seed."""
+    rng = np.random.default_rng(seed)
+    y, x = np.mgrid[0:size, 0:size]
+    center = size / 2 + rng.uniform(-size / 16, size / 16, 2)
+    mask = (x - center[0]) ** 2 + (y - center[1]) ** 2 < (size * 0.4) ** 2
+    for _ in range(6):
+        x0, y0 = rng.integers(0, size - size // 8, 2)
+        mask[y0 : y0 + size // 8, x0 : x0 + size // 32] = False
+    mask[(x - center[0]) ** 2 + (y - center[1]) ** 2 < (size * 0.05) ** 2] = False
+    return mask.astype(np.uint8) * 255
+
+
+def components_and_holes(skeleton):
+    """8-connected components and 4-connected background components not touching the image border."""
+    num_components = cv2.connectedComponents(skeleton, connectivity=8)[0] - 1
+    background = np.pad((skeleton == 0).astype(np.uint8), 1, constant_values=1)
+    num_holes = cv2.connectedComponents(background, connectivity=4)[0] - 2
+    return num_components, num_holes
+
+
+def skeletonize(mask, factor):
+    hjs = PyHJS(2.5, 1.0)
+    hjs.set_coarse_to_fine(factor)
+    # the two-pass diffusion intersects two skeletons, which may split the full resolution one
+    hjs.compute(BinaryFrame(mask), enable_anisotropic_diffusion=False, outputs=Output.SKELETON | Output.FLUX)
+    return hjs.get_skeleton_image().copy(), hjs.get_flux_image().copy()
+
+
+@pytest.mark.parametrize("seed", range(4))
+@pytest.mark.parametrize("factor", [2, 4])
+def test_coarse_to_fine_matches_full_thinning(seed, factor):
+    mask = make_mask(512, seed)
+    expected, expected_flux = skeletonize(mask, 0)
+    skeleton, flux = skeletonize(mask, factor)
+
+    # the corridor was used: the flux is only computed around the coarse skeleton
+    assert np.count_nonzero(flux) < np.count_nonzero(expected_flux) // 2
+    assert components_and_holes(skeleton) == components_and_holes(expected)
+    # every pixel within the documented 2 pixels (chessboard distance) of the full resolution skeleton
+    distance = cv2.distanceTransform((expected == 0).astype(np.uint8), cv2.DIST_C, 3)
+    assert distance[skeleton > 0].max() <= 2
@@ -0,0 +1,70 @@
+import sys
+import threading
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+import pytest
+from pyhjs import BinaryFrame, PyHJS
+
+# generous bound of every wait: reaching it means a deadlock, not a slow machine
+TIMEOUT = 120
+
+
+def make_mask(size, seed):
+    """A disk with rectangular notches and a hole, different for each seed."""
+    rng = np.random.default_rng(seed)
+    y, x = np.mgrid[0:size, 0:size]
+    center = size / 2 + rng.uniform(-size / 16, size / 16, 2)
+    mask = (x - center[0]) ** 2 + (y - center[1]) ** 2 < (size * 0.4) ** 2
+    for _ in range(6):
+        x0, y0 = rng.integers(0, size - size // 8, 2)
+        mask[y0 : y0 + size // 8, x0 : x0 + size // 32] = False
+    mask[(x - center[0]) ** 2 + (y - center[1]) ** 2 < (size * 0.05) ** 2] = False
+    return mask.astype(np.uint8) * 255
+
+
+def skeletonize(mask, num_threads=0):
+    hjs = PyHJS(2.5, 1.0, 0, num_threads)
+    hjs.compute(BinaryFrame(mask))
+    return hjs.get_skeleton_image().copy(), hjs.get_distance_transform_image().copy()
+
+
+@pytest.mark.parametrize("num_threads", [0, 1, 2])
+def test_instances_in_threads_match_serial(num_threads):
+    masks = [make_mask(384, seed) for seed in range(8)]
+    serial = [skeletonize(mask, num_threads) for mask in masks]
+    with ThreadPoolExecutor(max_workers=4) as pool:
+        futures = [pool.submit(skeletonize, mask, num_threads) for mask in masks]
+        threaded = [future.result(timeout=TIMEOUT) for future in futures]
+    for (skeleton, distance), (expected_skeleton, expected_distance) in zip(threaded, serial):
+        assert np.array_equal(skeleton, expected_skeleton)
+        assert np.array_equal(distance, expected_distance)
+
+
+def test_compute_releases_gil():
+    """The main thread runs Python code while another thread is inside compute().
+
+    With a switch interval longer than the test, a thread only gives up the GIL on its own; the main thread, woken
+    by started, can then only get the GIL while compute() runs if compute() released it.
+    """
+    frame = BinaryFrame(make_mask(1536, 0))
+    hjs = PyHJS(2.5, 1.0)
+    started, done = threading.Event(), threading.Event()
+
+    def run():
+        started.set()
+        hjs.compute(frame)
+        done.set()
+
+    thread = threading.Thread(target=run)
+    switch_interval = sys.getswitchinterval()
+    sys.setswitchinterval(TIMEOUT)
+    try:
+        thread.start()
+        assert started.wait(TIMEOUT)
+        running = not done.is_set()
+    finally:
+        sys.setswitchinterval(switch_interval)
+    thread.join(TIMEOUT)
+    assert not thread.is_alive()
+    assert running
@@ -0,0 +1,94 @@
+import threading
+
+import numpy as np
+import pytest
+from pyhjs import BinaryFrame, Executor, Output, PyHJS
+
+
+def make_mask(size):
+    """A ring with a bar through it; larger sizes take longer."""
+    y, x = np.mgrid[0:size, 0:size]
+    radius = np.hypot(x - size / 2, y - size / 2)
+    mask = (radius < size * 0.4) & (radius > size * 0.15)
+    mask[size // 2 - size // 32 : size // 2 + size // 32, size // 8 : size - size // 8] = True
+    return mask.astype(np.uint8) * 255
+
+
+def empty_frame():
+    return BinaryFrame(np.zeros((0, 0), np.uint8))
+
+
+@pytest.fixture
+def hjs():
+    return PyHJS(2.5, 1.0, 0, 1)
+
+
+def test_ordered_delivery(hjs):
+    # large frames first, so that later frames finish earlier
+    masks = [make_mask(size) for size in [768, 640, 512, 384, 256, 128, 96, 64]]
+    delivered = []
+    with Executor(num_workers=4, max_pending=len(masks), ordered=True) as executor:
+        futures = [
+            executor.submit(
+                hjs, BinaryFrame(mask), outputs=Output.SKELETON, callback=lambda future, index=index: delivered.append(index)
+            )
+            for index, mask in enumerate(masks)
+        ]
+        executor.wait()
+    assert delivered == list(range(len(masks)))
+    for future, mask in zip(futures, masks):
+        hjs.compute(BinaryFrame(mask), outputs=Output.SKELETON)
+        assert np.array_equal(future.result().skeleton_image, hjs.get_skeleton_image())
+
+
+def test_submit_blocks_when_queue_is_full(hjs):
+    frame = BinaryFrame(make_mask(64))
+    release = threading.Event()
+    submitted = threading.Event()
+    executor = Executor(num_workers=1, max_pending=2)
+    try:
+        # the callback of the first frame holds its slot (and the only worker), the second frame fills the queue
+        executor.submit(hjs, frame, outputs=Output.SKELETON, callback=lambda future: release.wait(10))
+        executor.submit(hjs, frame, outputs=Output.SKELETON)
+
+        def submit_third():
+            executor.submit(hjs, frame, outputs=Output.SKELETON)
+            submitted.set()
+
+        thread = threading.Thread(target=submit_third)
+        thread.start()
+        assert not submitted.wait(0.5)
+        release.set()
+        assert submitted.wait(10)
+        thread.join()
+        executor.wait()
+    finally:
+        release.set()
+        executor.shutdown()
+
+
+def test_exception_reaches_future(hjs):
+    with Executor(num_workers=2, ordered=True) as executor:
+        failed = executor.submit(hjs, empty_frame())
+        succeeded = executor.submit(hjs, BinaryFrame(make_mask(64)), outputs=Output.SKELETON)
+        with pytest.raises(RuntimeError, match="empty"):
+            failed.result(timeout=10)
+        assert isinstance(failed.exception(), RuntimeError)
+        assert succeeded.result(timeout=10).skeleton_image.any()
+
+
+def test_pyhjs_submit(hjs):
+    mask = make_mask(128)
+    hjs.compute(BinaryFrame(mask), outputs=Output.SKELETON)
+    expected = hjs.get_skeleton_image().copy()
+
+    future = hjs.submit(BinaryFrame(mask), outputs=Output.SKELETON)
+    assert np.array_equal(future.result(timeout=10).skeleton_image, expected)
+    assert isinstance(hjs.executor, Executor)
+
+    with pytest.raises(RuntimeError):
+        hjs.submit(empty_frame()).result(timeout=10)
+
+    # the default executor survives a failed frame
+    assert np.array_equal(hjs.submit(BinaryFrame(mask), outputs=Output.SKELETON).result(timeout=10).skeleton_image, expected)
+    hjs.executor.shutdown()
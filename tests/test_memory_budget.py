@@ -0,0 +1,55 @@
+import numpy as np
+import pytest
+from pyhjs import BinaryFrame, MemoryStrategy, Output, PyHJS
+
+CROP = int(MemoryStrategy.CROP)
+PING_PONG_DIFFUSION = int(MemoryStrategy.PING_PONG_DIFFUSION)
+BANDED_FLUX = int(MemoryStrategy.BANDED_FLUX)
+
+
+def make_mask(size=384):
+    """A ring with a bar through it, away from the frame border."""
+    y, x = np.mgrid[0:size, 0:size]
+    radius = np.hypot(x - size / 2, y - size / 2)
+    mask = (radius < size * 0.3) & (radius > size * 0.1)
+    mask[size // 2 - size // 32 : size // 2 + size // 32, size // 4 : size - size // 4] = True
+    return mask.astype(np.uint8) * 255
+
+
+def make_full_mask(size=384):
+    """The same with a cross reaching the four frame borders, so that cropping gains nothing."""
+    mask = make_mask(size)
+    mask[size // 2 - 4 : size // 2 + 4, :] = 255
+    mask[:, size // 2 - 4 : size // 2 + 4] = 255
+    return mask
+
+
+def skeletonize(frame, budget):
+    hjs = PyHJS(2.5, 1.0)
+    hjs.set_memory_budget(budget)
+    hjs.compute(frame, enable_anisotropic_diffusion=True, outputs=Output.ALL)
+    images = (hjs.get_skeleton_image().copy(), hjs.get_flux_image().copy(), hjs.get_distance_transform_image().copy())
+    return images, hjs.get_memory_report()["strategies"]
+
+
+@pytest.mark.parametrize(
+    "make, strategies",
+    [
+        (make_mask, CROP),
+        (make_mask, CROP | PING_PONG_DIFFUSION),
+        (make_mask, CROP | PING_PONG_DIFFUSION | BANDED_FLUX),
+        (make_full_mask, PING_PONG_DIFFUSION),
+        (make_full_mask, PING_PONG_DIFFUSION | BANDED_FLUX),
+    ],
+)
+def test_budget_strategies_give_the_same_results(make, strategies):
+    frame = BinaryFrame(make())
+    expected, expected_strategies = skeletonize(frame, 0)
+    assert expected_strategies == 0
+
+    # the smallest budget the strategies fit in; the strategies are tried in order, so it selects exactly them
+    budget = PyHJS(2.5, 1.0).estimate_memory(frame, True, Output.ALL, strategies)
+    images, selected = skeletonize(frame, budget)
+    assert selected == strategies
+    for image, expected_image in zip(images, expected):
+        assert np.array_equal(image, expected_image)
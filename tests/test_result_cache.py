@@ -0,0 +1,47 @@
+import numpy as np
+from pyhjs import BinaryFrame, Output, PyHJS, ResultCache
+
+
+def make_mask(size=160):
+    """A cross with rounded arms, whose arc angle pruning depends on the threshold."""
+    y, x = np.mgrid[0:size, 0:size]
+    mask = (np.abs(x - size / 2) < size / 8) | (np.abs(y - size / 2) < size / 10)
+    mask &= np.hypot(x - size / 2, y - size / 2) < size * 0.45
+    return mask.astype(np.uint8) * 255
+
+
+def test_hit_serves_the_same_result(tmp_path):
+    cache = ResultCache(str(tmp_path))
+    hjs = PyHJS(2.5, 1.0)
+    hjs.set_result_cache(cache)
+    frame = BinaryFrame(make_mask())
+
+    hjs.compute(frame)
+    expected = hjs.get_skeleton_image().copy()
+    hjs.compute(frame)
+    assert cache.num_hits == 1
+    assert np.array_equal(hjs.get_skeleton_image(), expected)
+
+
+def test_reprune_after_cached_compute(tmp_path):
+    cache = ResultCache(str(tmp_path))
+    hjs = PyHJS(2.5, 1.0)
+    hjs.set_result_cache(cache)
+    reference = PyHJS(2.5, 1.0)
+    frame = BinaryFrame(make_mask())
+    outputs = Output.ALL | Output.REPRUNE
+
+    # the second compute() would be a hit; it must still keep what reprune() needs
+    hjs.compute(frame, outputs=outputs)
+    hjs.compute(frame, outputs=outputs)
+    hjs.reprune(45)
+    reference.compute(frame, outputs=outputs)
+    reference.reprune(45)
+    assert np.array_equal(hjs.get_skeleton_image(), reference.get_skeleton_image())
+
+    # the result stored by a compute() for reprune() serves plain compute() calls
+    other = PyHJS(2.5, 1.0)
+    other.set_result_cache(cache)
+    hits = cache.num_hits
+    other.compute(frame)
+    assert cache.num_hits == hits + 1
@@ -0,0 +1,504 @@
+/*
+hjs-batch: skeletonize many masks without Python.
+
+    hjs-batch [options] <mask file | directory>... -o <output directory>
+
+Masks are PNG (or any format readable by cv::imread), .npy (2D, any integer/bool/float dtype) or raw 8-bit files
+(--raw-size HxW); every nonzero pixel is foreground. Files are processed by --jobs threads pulling from a shared
+list, each with its own HamiltonJacobiSkeleton. Failures are reported and skipped; the exit status is 1 if any.
+*/
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "frame.h"
+#include "hjs.h"
+#include "parallel.h"
+#include "result_cache.h"
+#include "rle.h"
+
+struct BatchOptions
+{
+    float gamma = 2.5;
+    float epsilon = 1.0;
+    float threshold_arc_angle = 0;
+    float threshold_branch_length = 0;
+    float threshold_branch_salience = 0;
+    float threshold_branch_radius_ratio = 0;
+    bool enable_anisotropic_diffusion = true;
+    DiffusionMode diffusion_mode = kDiffusionTwoPass;
+    ThinningMode thinning_mode = kThinningSerial;
+    SkeletonEngine skeleton_engine = kEngineHamiltonJacobi;
+    int num_jobs = 0;
+    int num_threads = 1;
+    double memory_budget_mb = 0;
+    std::string cache_dir;
+    double cache_size_mb = 0;
+    int outputs = kOutputSkeleton;
+    std::string format = "png";
+    std::string output_dir;
+    int raw_height = 0, raw_width = 0;
+    std::vector<std::string> inputs;
+};
+
+static void printUsage()
+{
+    std::cerr
+        << "usage: hjs-batch [options] <mask file | directory | @list file>... -o <output directory>\n"
+           "  -o, --output DIR              output directory (required)\n"
+           "  --format png|npy|rle          skeleton output: PNG (0/255), memory-mapped .npy (0/1),\n"
+           "                                or one COCO RLE JSON line per mask in DIR/skeletons.jsonl\n"
+           "  --distance, --flux            also write the distance transform / flux as float32 .npy\n"
+           "  --gamma G                     (default 2.5)\n"
+           "  --epsilon E                   (default 1.0)\n"
+           "  --arc-angle DEG               inscribed arc angle pruning threshold (default 0: off)\n"
+           "  --branch-length L             branch pruning thresholds (default 0: off)\n"
+           "  --branch-salience S\n"
+           "  --branch-radius-ratio R\n"
+           "  --no-diffusion                disable anisotropic diffusion\n"
+           "  --diffusion-mode two-pass|single-pass\n"
+           "  --thinning serial|parallel    parallel: remove thinning candidates in flux bands on --threads\n"
+           "  --engine hj|guo-hall          guo-hall: fast parallel thinning without flux ordering\n"
+           "  -j, --jobs N                  masks processed concurrently (default: hardware concurrency)\n"
+           "  --threads N                   threads inside each computation (default 1, 0: OpenCV pool)\n"
+           "  --memory-budget MB            per-job memory budget; larger masks use lower-memory strategies\n"
+           "  --cache DIR                   reuse results of masks already skeletonized with the same options\n"
+           "  --cache-size MB               size limit of the cache, least recently used entries go first\n"
+           "                                (default 0: unbounded)\n"
+           "  --raw-size HxW                size of raw 8-bit inputs (*.raw)\n"
+           "Directories are searched recursively for *.png, *.npy and *.raw; @FILE reads one path per line.\n";
+}
+
+static bool endsWith(const std::string &text, const std::string &suffix)
+{
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static BatchOptions parseArguments(int argc, char **argv)
+{
+    BatchOptions options;
+    for (int k = 1; k < argc; k++)
+    {
+        std::string arg = argv[k];
+        auto value = [&]() -> std::string
+        {
+            if (k + 1 >= argc)
+                throw std::invalid_argument("missing value after " + arg);
+            return argv[++k];
+        };
+
+        if (arg == "-h" || arg == "--help")
+        {
+            printUsage();
+            std::exit(EXIT_SUCCESS);
+        }
+        else if (arg == "-o" || arg == "--output")
+            options.output_dir = value();
+        else if (arg == "--format")
+            options.format = value();
+        else if (arg == "--distance")
+            options.outputs |= kOutputDistanceTransform;
+        else if (arg == "--flux")
+            options.outputs |= kOutputFlux;
+        else if (arg == "--gamma")
+            options.gamma = std::stof(value());
+        else if (arg == "--epsilon")
+            options.epsilon = std::stof(value());
+        else if (arg == "--arc-angle")
+            options.threshold_arc_angle = std::stof(value());
+        else if (arg == "--branch-length")
+            options.threshold_branch_length = std::stof(value());
+        else if (arg == "--branch-salience")
+            options.threshold_branch_salience = std::stof(value());
+        else if (arg == "--branch-radius-ratio")
+            options.threshold_branch_radius_ratio = std::stof(value());
+        else if (arg == "--no-diffusion")
+            options.enable_anisotropic_diffusion = false;
+        else if (arg == "--diffusion-mode")
+        {
+            std::string mode = value();
+            if (mode != "two-pass" && mode != "single-pass")
+                throw std::invalid_argument("unknown diffusion mode " + mode);
+            options.diffusion_mode = (mode == "single-pass") ? kDiffusionSinglePass : kDiffusionTwoPass;
+        }
+        else if (arg == "--thinning")
+        {
+            std::string mode = value();
+            if (mode != "serial" && mode != "parallel")
+                throw std::invalid_argument("unknown thinning mode " + mode);
+            options.thinning_mode = (mode == "parallel") ? kThinningParallel : kThinningSerial;
+        }
+        else if (arg == "--engine")
+        {
+            std::string engine = value();
+            if (engine != "hj" && engine != "guo-hall")
+                throw std::invalid_argument("unknown skeleton engine " + engine);
+            options.skeleton_engine = (engine == "guo-hall") ? kEngineGuoHall : kEngineHamiltonJacobi;
+        }
+        else if (arg == "-j" || arg == "--jobs")
+            options.num_jobs = std::stoi(value());
+        else if (arg == "--threads")
+            options.num_threads = std::stoi(value());
+        else if (arg == "--memory-budget")
+            options.memory_budget_mb = std::stod(value());
+        else if (arg == "--cache")
+            options.cache_dir = value();
+        else if (arg == "--cache-size")
+            options.cache_size_mb = std::stod(value());
+        else if (arg == "--raw-size")
+        {
+            std::string size = value();
+            if (std::sscanf(size.c_str(), "%dx%d", &options.raw_height, &options.raw_width) != 2)
+                throw std::invalid_argument("--raw-size expects HxW");
+        }
+        else if (!arg.empty() && arg[0] == '-')
+            throw std::invalid_argument("unknown option " + arg);
+        else
+            options.inputs.push_back(arg);
+    }
+
+    if (options.output_dir.empty() || options.inputs.empty())
+        throw std::invalid_argument("inputs and an output directory are required");
+    if (options.format != "png" && options.format != "npy" && options.format != "rle")
+        throw std::invalid_argument("unknown format " + options.format);
+    if (options.format == "rle")
+        options.outputs = (options.outputs & ~kOutputSkeleton) | kOutputRunLength;
+    if (options.num_jobs <= 0)
+        options.num_jobs = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    return options;
+}
+
+/* input files with the name of their outputs (path relative to the input directory, '/' replaced by '__') */
+static void collectInputs(const BatchOptions &options, std::vector<std::string> &paths, std::vector<std::string> &names)
+{
+    for (const std::string &input : options.inputs)
+    {
+        if (input[0] == '@')
+        {
+            std::ifstream list(input.substr(1));
+            if (!list)
+                throw std::runtime_error("cannot read list " + input.substr(1));
+            for (std::string line; std::getline(list, line);)
+            {
+                if (line.empty())
+                    continue;
+                paths.push_back(line);
+                names.push_back(line.substr(line.find_last_of('/') + 1));
+            }
+            continue;
+        }
+
+        struct stat status;
+        if (stat(input.c_str(), &status) != 0)
+            throw std::runtime_error("cannot access " + input);
+        if (!S_ISDIR(status.st_mode))
+        {
+            paths.push_back(input);
+            names.push_back(input.substr(input.find_last_of('/') + 1));
+            continue;
+        }
+
+        std::vector<cv::String> files;
+        cv::glob(input, files, true);
+        std::sort(files.begin(), files.end());
+        std::string prefix = endsWith(input, "/") ? input : input + "/";
+        for (const cv::String &file : files)
+        {
+            std::string path = file;
+            if (!endsWith(path, ".png") && !endsWith(path, ".npy") && !endsWith(path, ".raw"))
+                continue;
+            std::string name = (path.compare(0, prefix.size(), prefix) == 0) ? path.substr(prefix.size()) : path;
+            for (size_t position = name.find('/'); position != std::string::npos; position = name.find('/', position + 2))
+                name.replace(position, 1, "__");
+            paths.push_back(path);
+            names.push_back(name);
+        }
+    }
+}
+
+static std::string stem(const std::string &name)
+{
+    size_t dot = name.find_last_of('.');
+    return (dot == std::string::npos) ? name : name.substr(0, dot);
+}
+
+/*
+NumPy .npy (format 1.x/2.x), 2D, little endian; converted to a 0/255 mask
+*/
+static cv::Mat readNpyMask(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    char magic[8];
+    if (!file.read(magic, 8) || std::memcmp(magic, "\x93NUMPY", 6) != 0)
+        throw std::runtime_error("not a .npy file");
+    uint32_t header_length = 0;
+    unsigned char length_bytes[4] = {0, 0, 0, 0};
+    file.read(reinterpret_cast<char *>(length_bytes), magic[6] == 1 ? 2 : 4);
+    header_length = length_bytes[0] | (length_bytes[1] << 8) | (length_bytes[2] << 16) | (uint32_t(length_bytes[3]) << 24);
+    std::string header(header_length, ' ');
+    file.read(&header[0], header_length);
+
+    auto field = [&](const std::string &key)
+    {
+        size_t position = header.find("'" + key + "'");
+        if (position == std::string::npos)
+            throw std::runtime_error("missing " + key + " in .npy header");
+        return header.substr(header.find(':', position) + 1);
+    };
+    std::string descr = field("descr");
+    descr = descr.substr(descr.find('\'') + 1);
+    descr = descr.substr(0, descr.find('\''));
+    std::string order = field("fortran_order");
+    bool fortran_order = order.find("True") < order.find(',');
+    int height = 0, width = 0;
+    if (std::sscanf(field("shape").c_str(), " (%d, %d)", &height, &width) != 2)
+        throw std::runtime_error("only 2D .npy masks are supported");
+
+    static const struct
+    {
+        const char *descr;
+        int type;
+    } kTypes[] = {{"|u1", CV_8U}, {"|b1", CV_8U}, {"|i1", CV_8S}, {"<u2", CV_16U}, {"<i2", CV_16S}, {"<i4", CV_32S}, {"<f4", CV_32F}, {"<f8", CV_64F}};
+    int type = -1;
+    for (const auto &known : kTypes)
+        if (descr == known.descr)
+            type = known.type;
+    if (type < 0)
+        throw std::runtime_error("unsupported .npy dtype " + descr);
+
+    /* a Fortran-ordered array is the C-ordered transpose */
+    cv::Mat values = fortran_order ? cv::Mat(width, height, type) : cv::Mat(height, width, type);
+    if (!file.read(reinterpret_cast<char *>(values.data), values.total() * values.elemSize()))
+        throw std::runtime_error("truncated .npy file");
+    if (fortran_order)
+        values = values.t();
+    return values != 0;
+}
+
+static cv::Mat readMask(const std::string &path, const BatchOptions &options)
+{
+    if (endsWith(path, ".npy"))
+        return readNpyMask(path);
+
+    if (endsWith(path, ".raw"))
+    {
+        if (options.raw_height <= 0 || options.raw_width <= 0)
+            throw std::runtime_error("--raw-size is required for raw inputs");
+        cv::Mat values(options.raw_height, options.raw_width, CV_8UC1);
+        std::ifstream file(path, std::ios::binary);
+        if (!file.read(reinterpret_cast<char *>(values.data), values.total()))
+            throw std::runtime_error("raw file smaller than --raw-size");
+        return values != 0;
+    }
+
+    cv::Mat image = cv::imread(path, cv::IMREAD_UNCHANGED);
+    if (image.empty())
+        throw std::runtime_error("cannot decode image");
+    if (image.channels() > 1)
+        cv::cvtColor(image, image, cv::COLOR_BGR2GRAY);
+    return image != 0;
+}
+
+/*
+Write a 2D CV_8U/CV_32F image as .npy through a shared file mapping: the rows are copied straight into the page cache.
+*/
+static void writeNpyMapped(const std::string &path, const cv::Mat &image)
+{
+    CV_Assert(image.dims == 2 && (image.type() == CV_8UC1 || image.type() == CV_32FC1));
+    std::ostringstream dictionary;
+    dictionary << "{'descr': '" << (image.type() == CV_8UC1 ? "|u1" : "<f4") << "', 'fortran_order': False, 'shape': (" << image.rows << ", "
+               << image.cols << "), }";
+    std::string header = dictionary.str();
+    size_t header_size = 10 + header.size() + 1;
+    header.append((64 - header_size % 64) % 64, ' ');
+    header.push_back('\n');
+    uint16_t header_length = static_cast<uint16_t>(header.size());
+
+    size_t row_size = image.cols * image.elemSize();
+    size_t file_size = 10 + header.size() + row_size * image.rows;
+    int descriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (descriptor < 0)
+        throw std::runtime_error("cannot create " + path + ": " + std::strerror(errno));
+    if (::ftruncate(descriptor, static_cast<off_t>(file_size)) != 0)
+    {
+        ::close(descriptor);
+        throw std::runtime_error("cannot resize " + path + ": " + std::strerror(errno));
+    }
+    void *mapping = ::mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    ::close(descriptor);
+    if (mapping == MAP_FAILED)
+        throw std::runtime_error("cannot map " + path + ": " + std::strerror(errno));
+
+    unsigned char *data = static_cast<unsigned char *>(mapping);
+    std::memcpy(data, "\x93NUMPY\x01\x00", 8);
+    data[8] = static_cast<unsigned char>(header_length & 0xff);
+    data[9] = static_cast<unsigned char>(header_length >> 8);
+    std::memcpy(data + 10, header.data(), header.size());
+    unsigned char *rows = data + 10 + header.size();
+    for (int y = 0; y < image.rows; y++)
+        std::memcpy(rows + y * row_size, image.ptr(y), row_size);
+    ::munmap(mapping, file_size);
+}
+
+/* the counts string uses ASCII 48..111, where only the backslash needs escaping */
+static std::string toJsonLine(const std::string &name, const RunLengthMask &mask)
+{
+    std::string counts = encodeRunLengthString(mask.counts);
+    std::string escaped;
+    escaped.reserve(counts.size());
+    for (char c : counts)
+    {
+        if (c == '\\')
+            escaped.push_back('\\');
+        escaped.push_back(c);
+    }
+    std::string escaped_name;
+    for (char c : name)
+    {
+        if (c == '\\' || c == '"')
+            escaped_name.push_back('\\');
+        escaped_name.push_back(c);
+    }
+    std::ostringstream line;
+    line << "{\"file\": \"" << escaped_name << "\", \"size\": [" << mask.height << ", " << mask.width << "], \"counts\": \"" << escaped << "\"}\n";
+    return line.str();
+}
+
+int main(int argc, char **argv)
+{
+    BatchOptions options;
+    std::vector<std::string> paths, names;
+    try
+    {
+        options = parseArguments(argc, argv);
+        collectInputs(options, paths, names);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "hjs-batch: " << e.what() << std::endl;
+        printUsage();
+        return EXIT_FAILURE;
+    }
+    ::mkdir(options.output_dir.c_str(), 0755);
+
+    std::FILE *rle_file = nullptr;
+    if (options.format == "rle")
+    {
+        rle_file = std::fopen((options.output_dir + "/skeletons.jsonl").c_str(), "w");
+        if (!rle_file)
+        {
+            std::cerr << "hjs-batch: cannot create " << options.output_dir << "/skeletons.jsonl" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* settings only: each job copies it with its own --threads workers */
+    HamiltonJacobiSkeleton skeletonizer(options.gamma, options.epsilon, options.threshold_arc_angle, 0);
+    skeletonizer.setBranchPruningParameters(options.threshold_branch_length, options.threshold_branch_salience, options.threshold_branch_radius_ratio);
+    skeletonizer.setDiffusionMode(options.diffusion_mode);
+    skeletonizer.setThinningMode(options.thinning_mode);
+    skeletonizer.setSkeletonEngine(options.skeleton_engine);
+    skeletonizer.setMemoryBudget(static_cast<int64_t>(options.memory_budget_mb * 1024 * 1024));
+    std::shared_ptr<ResultCache> cache;
+    if (!options.cache_dir.empty())
+    {
+        try
+        {
+            cache = std::make_shared<ResultCache>(options.cache_dir, static_cast<int64_t>(options.cache_size_mb * 1024 * 1024));
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "hjs-batch: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        skeletonizer.setResultCache(cache);
+    }
+
+    std::atomic<int64_t> num_done(0), num_failed(0);
+    std::mutex output_mutex;
+    auto start = std::chrono::steady_clock::now();
+    int num_files = static_cast<int>(paths.size());
+    int num_jobs = std::max(1, std::min(options.num_jobs, num_files));
+
+    /* one stripe per job, with one skeletonizer and pool for all its files; the jobs pull files dynamically */
+    std::atomic<int> next_file(0);
+    parallelFor(
+        cv::Range(0, num_jobs),
+        [&](const cv::Range &)
+        {
+            HamiltonJacobiSkeleton job_skeletonizer = skeletonizer;
+            job_skeletonizer.setNumThreads(options.num_threads);
+            for (int index = next_file++; index < num_files; index = next_file++)
+            {
+                const std::string &path = paths[index];
+                std::string output_stem = options.output_dir + "/" + stem(names[index]);
+                try
+                {
+                    cv::Mat mask = readMask(path, options);
+                    SkeletonResult result = job_skeletonizer.process(BinaryFrame(mask), options.enable_anisotropic_diffusion, options.outputs);
+                    if (options.format == "png")
+                    {
+                        cv::Mat skeleton_png = result.skeleton_image * 255;
+                        if (!cv::imwrite(output_stem + ".skeleton.png", skeleton_png))
+                            throw std::runtime_error("cannot write " + output_stem + ".skeleton.png");
+                    }
+                    else if (options.format == "npy")
+                    {
+                        writeNpyMapped(output_stem + ".skeleton.npy", result.skeleton_image);
+                    }
+                    else
+                    {
+                        std::string line = toJsonLine(names[index], result.skeleton_run_length);
+                        std::lock_guard<std::mutex> lock(output_mutex);
+                        std::fputs(line.c_str(), rle_file);
+                    }
+                    if (options.outputs & kOutputDistanceTransform)
+                        writeNpyMapped(output_stem + ".distance.npy", result.distance_transform_image);
+                    if (options.outputs & kOutputFlux)
+                        writeNpyMapped(output_stem + ".flux.npy", result.flux_image);
+                }
+                catch (const std::exception &e)
+                {
+                    num_failed++;
+                    std::lock_guard<std::mutex> lock(output_mutex);
+                    std::cerr << "hjs-batch: " << path << ": " << e.what() << std::endl;
+                }
+
+                int64_t done = ++num_done;
+                if (done % 1000 == 0)
+                {
+                    std::lock_guard<std::mutex> lock(output_mutex);
+                    std::cerr << done << " / " << num_files << std::endl;
+                }
+            }
+        },
+        num_jobs, num_jobs);
+
+    if (rle_file)
+        std::fclose(rle_file);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << num_done - num_failed << " masks skeletonized, " << num_failed << " failed, " << elapsed << " s ("
+              << (elapsed > 0 ? num_done / elapsed : 0) << " masks/s)" << std::endl;
+    if (cache)
+        std::cerr << cache->getNumHits() << " cache hits, " << cache->getNumMisses() << " misses" << std::endl;
+    return num_failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
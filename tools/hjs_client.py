@@ -0,0 +1,297 @@
+"""Client of hjs-server: the PyHJS API without loading OpenCV or pyhjs in the calling process.
+
+    from hjs_client import HJSClient, Output
+
+    hjs = HJSClient(gamma=2.5, epsilon=1.0, socket_path="/tmp/hjs.sock")
+    hjs.compute(mask)                      # 2D uint8/bool array, thresholded as BinaryFrame(mask) would be
+    skeleton = hjs.get_skeleton_image()
+
+    futures = [hjs.submit(mask) for mask in masks]   # up to num_slots frames in flight
+    results = [future.result() for future in futures]
+
+The client creates a POSIX shared memory ring of num_slots slots of slot_size bytes; a mask is written into a free
+slot and the server writes the results after it (see tools/hjs_server.cpp for the wire format). Result arrays are
+read-only views into the slot, valid until num_slots more frames are submitted; copy them to keep them longer.
+Results that do not fit in a slot raise RuntimeError: a slot needs about 14 bytes per pixel for Output.ALL.
+"""
+import itertools
+import socket
+import struct
+from enum import IntEnum, IntFlag
+from multiprocessing import shared_memory
+
+import numpy as np
+
+PROTOCOL_MAGIC = b"HJS1"
+HELLO = struct.Struct("<4sIQ64s")
+HELLO_REPLY = struct.Struct("<ii120s")
+PARAMETERS = struct.Struct("<7f5iq")
+REQUEST = struct.Struct("<QI5i" + PARAMETERS.format[1:])
+NUM_ARRAYS = 10
+REPLY = struct.Struct("<QI3i%dQ128s" % (2 * NUM_ARRAYS))
+
+
+class Output(IntFlag):
+    SKELETON = 1
+    DISTANCE_TRANSFORM = 2
+    FLUX = 4
+    POINTS = 8
+    RLE = 16
+    ARC_ANGLE = 32
+    ALL = 63
+
+
+class DiffusionMode(IntEnum):
+    TWO_PASS = 0
+    SINGLE_PASS = 1
+
+
+class SkeletonEngine(IntEnum):
+    HAMILTON_JACOBI = 0
+    GUO_HALL = 1
+
+
+class ThinningMode(IntEnum):
+    SERIAL = 0
+    PARALLEL = 1
+
+
+class SkeletonResult:
+    """Outputs of one frame, as SkeletonResult of pyhjs; None when not requested."""
+
+    def __init__(self, buffer, reply):
+        _, _, _, height, width = reply[:5]
+        arrays = [(reply[5 + 2 * k], reply[6 + 2 * k]) for k in range(NUM_ARRAYS)]
+
+        def view(index, dtype, shape=None):
+            offset, count = arrays[index]
+            if count == 0:
+                return None
+            array = np.frombuffer(buffer, dtype=dtype, count=count, offset=offset)
+            return array.reshape(shape) if shape else array
+
+        self.skeleton_image = view(0, np.uint8, (height, width))
+        self.distance_transform_image = view(1, np.float32, (height, width))
+        self.flux_image = view(2, np.float32, (height, width))
+        self.arc_angle_image = view(3, np.float32, (height, width))
+        self.points = None
+        if arrays[4][1] > 0:
+            self.points = {
+                "x": view(4, np.int32),
+                "y": view(5, np.int32),
+                "radius": view(6, np.float32),
+                "flux": view(7, np.float32),
+                "arc_angle": view(8, np.float32),
+            }
+        self.skeleton_rle = None
+        if arrays[9][1] > 0:
+            self.skeleton_rle = {"size": (height, width), "counts": bytes(view(9, np.uint8))}
+
+
+class RemoteFuture:
+    """Pending frame of HJSClient.submit()."""
+
+    def __init__(self, client):
+        self._client = client
+        self._result = None
+        self._error = None
+        self._done = False
+
+    def done(self):
+        return self._done
+
+    def result(self):
+        while not self._done:
+            self._client._receive_reply()
+        if self._error is not None:
+            raise self._error
+        return self._result
+
+
+class HJSClient:
+    def __init__(
+        self,
+        gamma=2.5,
+        epsilon=1.0,
+        threshold_arc_angle_inscribed_circle=0,
+        socket_path="/tmp/hjs.sock",
+        num_slots=4,
+        slot_size=64 << 20,
+    ):
+        slot_size = (slot_size + 63) // 64 * 64
+        self._parameters = {
+            "gamma": gamma,
+            "epsilon": epsilon,
+            "threshold_arc_angle": threshold_arc_angle_inscribed_circle,
+            "threshold_branch_length": 0.0,
+            "threshold_branch_salience": 0.0,
+            "threshold_branch_radius_ratio": 0.0,
+            "thinning_flux_band": 0.1,
+            "diffusion_mode": DiffusionMode.TWO_PASS,
+            "skeleton_engine": SkeletonEngine.HAMILTON_JACOBI,
+            "thinning_mode": ThinningMode.SERIAL,
+            "coarse_to_fine_factor": 0,
+            "coarse_to_fine_radius": 0,
+            "memory_budget": 0,
+        }
+        self._num_slots = num_slots
+        self._slot_size = slot_size
+        self._request_ids = itertools.count()
+        self._slot_futures = [None] * num_slots  # last frame submitted in each slot
+        self._next_slot = 0
+        self._pending = {}  # request id -> future, until its reply
+        self._result = None
+
+        self._memory = shared_memory.SharedMemory(create=True, size=num_slots * slot_size)
+        self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        try:
+            self._socket.connect(socket_path)
+            self._socket.sendall(HELLO.pack(PROTOCOL_MAGIC, num_slots, slot_size, ("/" + self._memory.name).encode()))
+            status, self.num_workers, message = HELLO_REPLY.unpack(self._receive(HELLO_REPLY.size))
+            if status != 0:
+                raise RuntimeError("hjs-server: " + message.rstrip(b"\0").decode())
+        except Exception:
+            self._memory.unlink()
+            self.close()
+            raise
+        # the server holds its own mapping: the name is no longer needed, and nothing leaks if this process dies
+        self._memory.unlink()
+
+    def close(self):
+        if self._socket is not None:
+            self._socket.close()
+            self._socket = None
+        if self._memory is not None:
+            try:
+                self._memory.close()
+            except BufferError:
+                pass  # result views are still alive; the mapping goes with them
+            self._memory = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def set_parameters(self, gamma, epsilon, threshold_arc_angle_inscribed_circle=0):
+        self._parameters.update(gamma=gamma, epsilon=epsilon, threshold_arc_angle=threshold_arc_angle_inscribed_circle)
+
+    def set_branch_pruning_parameters(self, threshold_branch_length, threshold_branch_salience=0, threshold_branch_radius_ratio=0):
+        self._parameters.update(
+            threshold_branch_length=threshold_branch_length,
+            threshold_branch_salience=threshold_branch_salience,
+            threshold_branch_radius_ratio=threshold_branch_radius_ratio,
+        )
+
+    def set_diffusion_mode(self, diffusion_mode):
+        self._parameters["diffusion_mode"] = diffusion_mode
+
+    def get_diffusion_mode(self):
+        return DiffusionMode(self._parameters["diffusion_mode"])
+
+    def set_skeleton_engine(self, skeleton_engine):
+        self._parameters["skeleton_engine"] = skeleton_engine
+
+    def get_skeleton_engine(self):
+        return SkeletonEngine(self._parameters["skeleton_engine"])
+
+    def set_thinning_mode(self, thinning_mode, flux_band=0.1):
+        self._parameters.update(thinning_mode=thinning_mode, thinning_flux_band=flux_band)
+
+    def get_thinning_mode(self):
+        return ThinningMode(self._parameters["thinning_mode"])
+
+    def get_thinning_flux_band(self):
+        return self._parameters["thinning_flux_band"]
+
+    def set_coarse_to_fine(self, factor, radius=0):
+        self._parameters.update(coarse_to_fine_factor=factor, coarse_to_fine_radius=radius)
+
+    def get_coarse_to_fine_factor(self):
+        return self._parameters["coarse_to_fine_factor"]
+
+    def get_coarse_to_fine_radius(self):
+        return self._parameters["coarse_to_fine_radius"]
+
+    def set_memory_budget(self, budget_bytes):
+        self._parameters["memory_budget"] = budget_bytes
+
+    def get_memory_budget(self):
+        return self._parameters["memory_budget"]
+
+    def submit(self, mask, enable_anisotropic_diffusion=True, outputs=Output.ALL):
+        """Send a frame without waiting for it; blocks while every slot is in flight."""
+        mask = np.asarray(mask)
+        if mask.dtype == bool:
+            mask = mask.view(np.uint8)
+        if mask.ndim != 2 or mask.dtype != np.uint8:
+            raise ValueError("mask must be a 2D uint8 or bool array")
+        height, width = mask.shape
+        if height * width > self._slot_size:
+            raise ValueError("mask larger than slot_size")
+
+        slot = self._next_slot
+        self._next_slot = (slot + 1) % self._num_slots
+        while self._slot_futures[slot] is not None and not self._slot_futures[slot].done():
+            self._receive_reply()
+        slot_mask = np.ndarray((height, width), dtype=np.uint8, buffer=self._memory.buf, offset=slot * self._slot_size)
+        slot_mask[...] = mask
+
+        request_id = next(self._request_ids)
+        future = RemoteFuture(self)
+        self._slot_futures[slot] = future
+        self._pending[request_id] = future
+        p = self._parameters
+        parameters = (
+            p["gamma"], p["epsilon"], p["threshold_arc_angle"],
+            p["threshold_branch_length"], p["threshold_branch_salience"], p["threshold_branch_radius_ratio"],
+            p["thinning_flux_band"],
+            int(p["diffusion_mode"]), int(p["skeleton_engine"]), int(p["thinning_mode"]),
+            p["coarse_to_fine_factor"], p["coarse_to_fine_radius"],
+            p["memory_budget"],
+        )  # fmt: skip
+        self._socket.sendall(REQUEST.pack(request_id, slot, height, width, int(enable_anisotropic_diffusion), int(outputs), 0, *parameters))
+        return future
+
+    def compute(self, mask, enable_anisotropic_diffusion=True, outputs=Output.ALL):
+        self._result = self.submit(mask, enable_anisotropic_diffusion, outputs).result()
+
+    def get_skeleton_image(self):
+        return self._result.skeleton_image
+
+    def get_distance_transform_image(self):
+        return self._result.distance_transform_image
+
+    def get_flux_image(self):
+        return self._result.flux_image
+
+    def get_arc_angle_image(self):
+        return self._result.arc_angle_image
+
+    def get_skeleton_points(self):
+        return self._result.points
+
+    def get_skeleton_rle(self):
+        return self._result.skeleton_rle
+
+    def _receive(self, size):
+        data = bytearray()
+        while len(data) < size:
+            chunk = self._socket.recv(size - len(data))
+            if not chunk:
+                raise ConnectionError("hjs-server closed the connection")
+            data += chunk
+        return bytes(data)
+
+    def _receive_reply(self):
+        """Complete the future of the next reply; replies arrive in completion order."""
+        reply = REPLY.unpack(self._receive(REPLY.size))
+        future = self._pending.pop(reply[0])
+        slot, status = reply[1], reply[2]
+        if status != 0:
+            future._error = RuntimeError("hjs-server: " + reply[-1].rstrip(b"\0").decode())
+        else:
+            start = slot * self._slot_size
+            future._result = SkeletonResult(self._memory.buf[start : start + self._slot_size].toreadonly(), reply)
+        future._done = True
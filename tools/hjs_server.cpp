@@ -0,0 +1,607 @@
+/*
+hjs-server: a long-running skeletonization worker shared by local processes.
+
+    hjs-server [options] [--socket PATH]
+
+Clients (see tools/hjs_client.py) connect over a Unix domain socket and exchange masks and results through a
+POSIX shared memory ring they create: num_slots slots of slot_size bytes. The socket only carries the fixed-size
+messages below; a client writes its mask into a free slot, sends a ComputeRequest naming the slot, and reads the
+arrays of the ComputeReply from the same slot. Frames of every connection are scheduled on one SkeletonExecutor,
+and their parallel regions (--threads) run on one ThreadPool, so the node runs a single set of threads and a single
+copy of the library however many clients and parameter sets there are.
+
+Wire format (native little endian, no padding):
+    client -> server  ClientHello, then any number of ComputeRequest
+    server -> client  HelloReply, then one ComputeReply per request, in completion order (match them by id)
+In a slot, the mask is a C-contiguous uint8 height x width image at offset 0 (nonzero is foreground); the server
+writes the results after it, each array at a 64 byte aligned offset given in ComputeReply::arrays.
+A slot belongs to the server from the request until its reply, and to the client otherwise.
+*/
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "frame.h"
+#include "hjs.h"
+#include "result_cache.h"
+#include "rle.h"
+#include "skeleton_executor.h"
+
+static const char kProtocolMagic[4] = {'H', 'J', 'S', '1'};
+
+/* first message of a connection */
+struct ClientHello
+{
+    char magic[4];         // "HJS1"
+    uint32_t num_slots;
+    uint64_t slot_size;    // [bytes]
+    char shm_name[64];     // POSIX shared memory object of num_slots * slot_size bytes, created by the client
+};
+
+struct HelloReply
+{
+    int32_t status;        // 0: ok, otherwise message holds the error and the server closes the connection
+    int32_t num_workers;   // frames computed concurrently by the server
+    char message[120];
+};
+
+/* HamiltonJacobiSkeleton settings; the thread budget of a frame is the server's --threads */
+struct ComputeParameters
+{
+    float gamma, epsilon, threshold_arc_angle;
+    float threshold_branch_length, threshold_branch_salience, threshold_branch_radius_ratio;
+    float thinning_flux_band;
+    int32_t diffusion_mode, skeleton_engine, thinning_mode;
+    int32_t coarse_to_fine_factor, coarse_to_fine_radius;
+    int64_t memory_budget;  // [bytes], 0: no budget
+};
+
+struct ComputeRequest
+{
+    uint64_t id;           // echoed in the reply
+    uint32_t slot;
+    int32_t height, width;
+    int32_t enable_anisotropic_diffusion;
+    int32_t outputs;       // SkeletonOutput flags
+    int32_t reserved;
+    ComputeParameters parameters;
+};
+
+/* arrays of a reply, in this order */
+enum ResultArray
+{
+    kArraySkeleton = 0,    // uint8 height x width
+    kArrayDistanceTransform,  // float32 height x width
+    kArrayFlux,            // float32 height x width
+    kArrayArcAngle,        // float32 height x width
+    kArrayPointsX,         // int32
+    kArrayPointsY,         // int32
+    kArrayPointsRadius,    // float32
+    kArrayPointsFlux,      // float32
+    kArrayPointsArcAngle,  // float32
+    kArrayRunLength,       // COCO compressed counts string
+    kNumResultArrays
+};
+
+struct ArrayRef
+{
+    uint64_t offset;       // from the start of the slot [bytes]
+    uint64_t count;        // elements, 0 when the output was not requested
+};
+
+struct ComputeReply
+{
+    uint64_t id;
+    uint32_t slot;
+    int32_t status;        // 0: ok, otherwise message holds the error
+    int32_t height, width;
+    ArrayRef arrays[kNumResultArrays];
+    char message[128];
+};
+
+static_assert(sizeof(ClientHello) == 80, "ClientHello layout");
+static_assert(sizeof(HelloReply) == 128, "HelloReply layout");
+static_assert(sizeof(ComputeParameters) == 56, "ComputeParameters layout");
+static_assert(sizeof(ComputeRequest) == 88, "ComputeRequest layout");
+static_assert(sizeof(ComputeReply) == 312, "ComputeReply layout");
+
+struct ServerOptions
+{
+    std::string socket_path = "/tmp/hjs.sock";
+    int num_workers = 0;
+    int max_pending = 0;
+    int num_threads = 1;
+    std::string cache_dir;
+    double cache_size_mb = 0;
+};
+
+static void printUsage()
+{
+    std::cerr
+        << "usage: hjs-server [options]\n"
+           "  --socket PATH                 Unix domain socket to listen on (default /tmp/hjs.sock)\n"
+           "  -j, --workers N               frames computed concurrently (default: hardware concurrency)\n"
+           "  --max-pending N               frames queued or running before clients are held back\n"
+           "                                (default: twice the workers)\n"
+           "  --threads N                   threads inside each computation, from one pool shared by all frames\n"
+           "                                (default 1, 0: OpenCV pool)\n"
+           "  --cache DIR                   result cache shared by every client (see ResultCache)\n"
+           "  --cache-size MB               size limit of the cache (default 0: unbounded)\n"
+           "The socket is created with mode 0600: only processes of the same user can connect.\n";
+}
+
+static ServerOptions parseArguments(int argc, char **argv)
+{
+    ServerOptions options;
+    for (int k = 1; k < argc; k++)
+    {
+        std::string arg = argv[k];
+        auto value = [&]() -> std::string
+        {
+            if (k + 1 >= argc)
+                throw std::invalid_argument("missing value after " + arg);
+            return argv[++k];
+        };
+
+        if (arg == "-h" || arg == "--help")
+        {
+            printUsage();
+            std::exit(EXIT_SUCCESS);
+        }
+        else if (arg == "--socket")
+            options.socket_path = value();
+        else if (arg == "-j" || arg == "--workers")
+            options.num_workers = std::stoi(value());
+        else if (arg == "--max-pending")
+            options.max_pending = std::stoi(value());
+        else if (arg == "--threads")
+            options.num_threads = std::stoi(value());
+        else if (arg == "--cache")
+            options.cache_dir = value();
+        else if (arg == "--cache-size")
+            options.cache_size_mb = std::stod(value());
+        else
+            throw std::invalid_argument("unknown option " + arg);
+    }
+    if (options.socket_path.size() >= sizeof(sockaddr_un::sun_path))
+        throw std::invalid_argument("socket path too long");
+    return options;
+}
+
+static bool readFully(int descriptor, void *buffer, size_t size)
+{
+    char *data = static_cast<char *>(buffer);
+    while (size > 0)
+    {
+        ssize_t received = ::recv(descriptor, data, size, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        data += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+static bool writeFully(int descriptor, const void *buffer, size_t size)
+{
+    const char *data = static_cast<const char *>(buffer);
+    while (size > 0)
+    {
+        ssize_t sent = ::send(descriptor, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+/* truncated to the message field, which stays NUL terminated */
+template <size_t N>
+static void setMessage(char (&message)[N], const std::string &text) { std::strncpy(message, text.c_str(), N - 1); }
+
+/*
+A connected client: its socket and the mapping of its ring.
+Pending frames hold the session, so the mapping outlives the connection until their replies are dropped.
+*/
+class Session
+{
+public:
+    Session(int descriptor) : descriptor_(descriptor), mapping_(nullptr), mapping_size_(0), num_slots_(0), slot_size_(0) {}
+
+    ~Session()
+    {
+        if (mapping_)
+            ::munmap(mapping_, mapping_size_);
+        ::close(descriptor_);
+    }
+
+    Session(const Session &) = delete;
+    Session &operator=(const Session &) = delete;
+
+    /* maps the ring named by the hello; throws with the reason sent back to the client */
+    void attach(const ClientHello &hello)
+    {
+        if (std::memcmp(hello.magic, kProtocolMagic, sizeof(kProtocolMagic)) != 0)
+            throw std::runtime_error("protocol mismatch");
+        if (hello.num_slots == 0 || hello.slot_size == 0 || hello.slot_size % 64 != 0)
+            throw std::runtime_error("num_slots and slot_size must be positive, slot_size a multiple of 64");
+        if (hello.num_slots > SIZE_MAX / hello.slot_size)
+            throw std::runtime_error("num_slots * slot_size overflows");
+
+        std::string name(hello.shm_name, strnlen(hello.shm_name, sizeof(hello.shm_name)));
+        if (name.empty() || name[0] != '/')
+            name = "/" + name;
+        int shm_descriptor = ::shm_open(name.c_str(), O_RDWR, 0);
+        if (shm_descriptor < 0)
+            throw std::runtime_error("cannot open shared memory " + name + ": " + std::strerror(errno));
+        struct stat status;
+        size_t ring_size = static_cast<size_t>(hello.num_slots) * hello.slot_size;
+        if (::fstat(shm_descriptor, &status) != 0 || static_cast<size_t>(status.st_size) < ring_size)
+        {
+            ::close(shm_descriptor);
+            throw std::runtime_error("shared memory " + name + " smaller than num_slots * slot_size");
+        }
+        void *mapping = ::mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_descriptor, 0);
+        ::close(shm_descriptor);
+        if (mapping == MAP_FAILED)
+            throw std::runtime_error("cannot map shared memory " + name + ": " + std::strerror(errno));
+
+        mapping_ = static_cast<char *>(mapping);
+        mapping_size_ = ring_size;
+        num_slots_ = hello.num_slots;
+        slot_size_ = static_cast<size_t>(hello.slot_size);
+    }
+
+    /* replies come from the executor's workers, so writes are serialized; a gone client is ignored */
+    void send(const void *message, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        writeFully(descriptor_, message, size);
+    }
+
+    int getDescriptor() const { return descriptor_; }
+
+    char *getSlot(uint32_t slot) const { return mapping_ + slot * slot_size_; }
+
+    uint32_t getNumSlots() const { return num_slots_; }
+
+    size_t getSlotSize() const { return slot_size_; }
+
+private:
+    int descriptor_;
+    char *mapping_;
+    size_t mapping_size_;
+    uint32_t num_slots_;
+    size_t slot_size_;
+    std::mutex write_mutex_;
+};
+
+/* pool: the workers shared by every session (null with --threads 0 or 1, then num_threads applies) */
+static std::shared_ptr<const HamiltonJacobiSkeleton> makeSkeletonizer(const ComputeParameters &parameters, int num_threads,
+                                                                      const std::shared_ptr<ThreadPool> &pool,
+                                                                      const std::shared_ptr<ResultCache> &cache)
+{
+    if (parameters.diffusion_mode != kDiffusionTwoPass && parameters.diffusion_mode != kDiffusionSinglePass)
+        throw std::runtime_error("unknown diffusion mode");
+    if (parameters.skeleton_engine != kEngineHamiltonJacobi && parameters.skeleton_engine != kEngineGuoHall)
+        throw std::runtime_error("unknown skeleton engine");
+    if (parameters.thinning_mode != kThinningSerial && parameters.thinning_mode != kThinningParallel)
+        throw std::runtime_error("unknown thinning mode");
+
+    std::shared_ptr<HamiltonJacobiSkeleton> skeletonizer = std::make_shared<HamiltonJacobiSkeleton>(
+        parameters.gamma, parameters.epsilon, parameters.threshold_arc_angle, 0);
+    if (pool)
+        skeletonizer->setThreadPool(pool);
+    else
+        skeletonizer->setNumThreads(num_threads);
+    skeletonizer->setBranchPruningParameters(parameters.threshold_branch_length, parameters.threshold_branch_salience,
+                                             parameters.threshold_branch_radius_ratio);
+    skeletonizer->setDiffusionMode(static_cast<DiffusionMode>(parameters.diffusion_mode));
+    skeletonizer->setSkeletonEngine(static_cast<SkeletonEngine>(parameters.skeleton_engine));
+    skeletonizer->setThinningMode(static_cast<ThinningMode>(parameters.thinning_mode), parameters.thinning_flux_band);
+    skeletonizer->setCoarseToFine(parameters.coarse_to_fine_factor, parameters.coarse_to_fine_radius);
+    skeletonizer->setMemoryBudget(parameters.memory_budget);
+    skeletonizer->setResultCache(cache);
+    return skeletonizer;
+}
+
+/*
+Lay the requested outputs out in the slot after the mask, each array 64 byte aligned.
+Throws if they do not fit; the client then needs larger slots.
+*/
+static void writeResult(const SkeletonResult &result, char *slot, size_t slot_size, size_t mask_size, ComputeReply &reply)
+{
+    size_t offset = mask_size;
+    auto reserve = [&](ResultArray array, size_t count, size_t element_size) -> char *
+    {
+        offset = (offset + 63) / 64 * 64;
+        if (offset + count * element_size > slot_size)
+            throw std::runtime_error("results exceed the slot size");
+        reply.arrays[array].offset = offset;
+        reply.arrays[array].count = count;
+        char *data = slot + offset;
+        offset += count * element_size;
+        return data;
+    };
+    auto placeImage = [&](ResultArray array, const cv::Mat &image)
+    {
+        if (image.empty())
+            return;
+        size_t row_size = image.cols * image.elemSize();
+        char *data = reserve(array, image.total(), image.elemSize());
+        for (int y = 0; y < image.rows; y++)
+            std::memcpy(data + y * row_size, image.ptr(y), row_size);
+    };
+    auto placeVector = [&](ResultArray array, const void *values, size_t count, size_t element_size)
+    {
+        if (count > 0)
+            std::memcpy(reserve(array, count, element_size), values, count * element_size);
+    };
+
+    placeImage(kArraySkeleton, result.skeleton_image);
+    placeImage(kArrayDistanceTransform, result.distance_transform_image);
+    placeImage(kArrayFlux, result.flux_image);
+    placeImage(kArrayArcAngle, result.arc_angle_image);
+    const SkeletonPoints &points = result.points;
+    placeVector(kArrayPointsX, points.x.data(), points.x.size(), sizeof(int32_t));
+    placeVector(kArrayPointsY, points.y.data(), points.y.size(), sizeof(int32_t));
+    placeVector(kArrayPointsRadius, points.radius.data(), points.radius.size(), sizeof(float));
+    placeVector(kArrayPointsFlux, points.flux.data(), points.flux.size(), sizeof(float));
+    placeVector(kArrayPointsArcAngle, points.arc_angle.data(), points.arc_angle.size(), sizeof(float));
+    if (result.skeleton_run_length.height > 0)
+    {
+        std::string counts = encodeRunLengthString(result.skeleton_run_length.counts);
+        placeVector(kArrayRunLength, counts.data(), counts.size(), 1);
+    }
+}
+
+/* reads the requests of a client until it disconnects; frames go to the shared executor */
+static void serveConnection(const std::shared_ptr<Session> &session, SkeletonExecutor &executor, const ServerOptions &options,
+                            const std::shared_ptr<ThreadPool> &pool, const std::shared_ptr<ResultCache> &cache)
+{
+    ClientHello hello;
+    if (!readFully(session->getDescriptor(), &hello, sizeof(hello)))
+        return;
+    HelloReply hello_reply;
+    std::memset(&hello_reply, 0, sizeof(hello_reply));
+    hello_reply.num_workers = executor.getNumWorkers();
+    try
+    {
+        session->attach(hello);
+    }
+    catch (const std::exception &e)
+    {
+        hello_reply.status = 1;
+        setMessage(hello_reply.message, e.what());
+        session->send(&hello_reply, sizeof(hello_reply));
+        return;
+    }
+    session->send(&hello_reply, sizeof(hello_reply));
+
+    /* the instance is rebuilt only when a request changes the parameters; it starts no threads of its own */
+    ComputeParameters current_parameters;
+    std::shared_ptr<const HamiltonJacobiSkeleton> skeletonizer;
+
+    ComputeRequest request;
+    while (readFully(session->getDescriptor(), &request, sizeof(request)))
+    {
+        ComputeReply reply;
+        std::memset(&reply, 0, sizeof(reply));
+        reply.id = request.id;
+        reply.slot = request.slot;
+        reply.height = request.height;
+        reply.width = request.width;
+        try
+        {
+            size_t mask_size = static_cast<size_t>(request.height) * static_cast<size_t>(std::max(request.width, 0));
+            if (request.slot >= session->getNumSlots())
+                throw std::runtime_error("slot out of range");
+            if (request.height <= 0 || request.width <= 0 || mask_size > session->getSlotSize())
+                throw std::runtime_error("mask does not fit in a slot");
+            if (!skeletonizer || std::memcmp(&current_parameters, &request.parameters, sizeof(ComputeParameters)) != 0)
+            {
+                skeletonizer = makeSkeletonizer(request.parameters, options.num_threads, pool, cache);
+                current_parameters = request.parameters;
+            }
+
+            /* the frame reads the mask in place; it holds the session, so the slot stays mapped */
+            char *slot = session->getSlot(request.slot);
+            cv::Mat mask(request.height, request.width, CV_8UC1, slot);
+            std::shared_ptr<Session> owner = session;
+            executor.submit(
+                skeletonizer, BinaryFrame(mask, owner), request.enable_anisotropic_diffusion != 0, request.outputs,
+                [owner, slot, mask_size, reply](SkeletonResult &result, std::exception_ptr error) mutable
+                {
+                    try
+                    {
+                        if (error)
+                            std::rethrow_exception(error);
+                        writeResult(result, slot, owner->getSlotSize(), mask_size, reply);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        std::memset(reply.arrays, 0, sizeof(reply.arrays));
+                        reply.status = 1;
+                        setMessage(reply.message, e.what());
+                    }
+                    owner->send(&reply, sizeof(reply));
+                });
+        }
+        catch (const std::exception &e)
+        {
+            reply.status = 1;
+            setMessage(reply.message, e.what());
+            session->send(&reply, sizeof(reply));
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ServerOptions options;
+    try
+    {
+        options = parseArguments(argc, argv);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "hjs-server: " << e.what() << std::endl;
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    std::shared_ptr<ResultCache> cache;
+    if (!options.cache_dir.empty())
+    {
+        try
+        {
+            cache = std::make_shared<ResultCache>(options.cache_dir, static_cast<int64_t>(options.cache_size_mb * 1024 * 1024));
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "hjs-server: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, options.socket_path.c_str(), sizeof(address.sun_path) - 1);
+    ::unlink(options.socket_path.c_str());
+    if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::chmod(options.socket_path.c_str(), 0600) != 0 || ::listen(listener, SOMAXCONN) != 0)
+    {
+        std::cerr << "hjs-server: cannot listen on " << options.socket_path << ": " << std::strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    /*
+    SIGINT/SIGTERM are blocked before any thread is started, so every thread inherits the mask and none of them is
+    interrupted; the signals are read from a signalfd that the accept loop polls next to the listening socket.
+    */
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    int error = ::pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+    int signal_descriptor = (error == 0) ? ::signalfd(-1, &stop_signals, SFD_CLOEXEC) : -1;
+    if (signal_descriptor < 0 || ::fcntl(listener, F_SETFL, ::fcntl(listener, F_GETFL) | O_NONBLOCK) != 0)
+    {
+        std::cerr << "hjs-server: cannot wait for signals: " << std::strerror(error != 0 ? error : errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    /* one pool for the parallel regions of every frame, however many sessions and parameter sets there are */
+    std::shared_ptr<ThreadPool> pool = (options.num_threads > 1) ? std::make_shared<ThreadPool>(options.num_threads) : nullptr;
+    SkeletonExecutor executor(options.num_workers, options.max_pending);
+    std::cerr << "hjs-server: listening on " << options.socket_path << " with " << executor.getNumWorkers() << " workers" << std::endl;
+
+    /* the reader owns the session, so a client that leaves releases its socket and ring with its last frame */
+    struct Connection
+    {
+        std::weak_ptr<Session> session;
+        std::shared_ptr<std::atomic<bool>> done;
+        std::thread reader;
+    };
+    std::list<Connection> connections;
+
+    for (;;)
+    {
+        pollfd descriptors[2];
+        descriptors[0].fd = listener;
+        descriptors[1].fd = signal_descriptor;
+        descriptors[0].events = descriptors[1].events = POLLIN;
+        if (::poll(descriptors, 2, -1) < 0)
+        {
+            if (errno != EINTR)
+            {
+                std::cerr << "hjs-server: poll: " << std::strerror(errno) << std::endl;
+                break;
+            }
+            continue;
+        }
+        if (descriptors[1].revents & POLLIN)
+            break;
+        if (!(descriptors[0].revents & POLLIN))
+            continue;
+
+        /* the listener is non-blocking: a client that left between poll() and accept() must not stall the loop */
+        int descriptor = ::accept(listener, nullptr, nullptr);
+        if (descriptor < 0)
+        {
+            if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN && errno != EWOULDBLOCK)
+                std::cerr << "hjs-server: accept: " << std::strerror(errno) << std::endl;
+            continue;
+        }
+
+        for (auto connection = connections.begin(); connection != connections.end();)
+        {
+            if (!*connection->done)
+            {
+                ++connection;
+                continue;
+            }
+            connection->reader.join();
+            connection = connections.erase(connection);
+        }
+
+        std::shared_ptr<Session> session = std::make_shared<Session>(descriptor);
+        std::shared_ptr<std::atomic<bool>> done = std::make_shared<std::atomic<bool>>(false);
+        Connection connection;
+        connection.session = session;
+        connection.done = done;
+        connection.reader = std::thread(
+            [session, done, &executor, &options, &pool, &cache]() mutable
+            {
+                serveConnection(session, executor, options, pool, cache);
+                session.reset();
+                *done = true;
+            });
+        session.reset();
+        connections.push_back(std::move(connection));
+    }
+
+    /* stop reading requests, let the queued frames reply, then leave */
+    ::close(signal_descriptor);
+    ::close(listener);
+    ::unlink(options.socket_path.c_str());
+    for (Connection &connection : connections)
+        if (std::shared_ptr<Session> session = connection.session.lock())
+            ::shutdown(session->getDescriptor(), SHUT_RD);
+    for (Connection &connection : connections)
+        connection.reader.join();
+    executor.shutdown();
+    std::cerr << "hjs-server: stopped" << std::endl;
+    return EXIT_SUCCESS;
+}